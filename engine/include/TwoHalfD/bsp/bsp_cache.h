@@ -0,0 +1,28 @@
+#ifndef BSP_CACHE_H
+#define BSP_CACHE_H
+
+#include "TwoHalfD/bsp/bsp_manager.h"
+
+#include <cstdint>
+#include <string>
+
+namespace TwoHalfD {
+
+// Bump whenever BSP construction, the graph build or the on-disk layout changes, so stale caches are rebuilt
+static constexpr uint32_t BSP_CACHE_VERSION = 5;
+
+// Binary cache of a finished BSP: segments, node array and node boxes, leaves (bounds and floor sections), the navigation graph and the
+// PVS. Files are keyed by a hash of the level file and the settings that affect the build; a missing, stale or malformed file just makes
+// load() fail so the caller falls back to a normal build. Loading reads each array straight into place; nothing is recomputed.
+class BSPCache {
+  public:
+    static uint64_t computeKey(const std::string &levelFilePath, int seed, BSPBuildMode buildMode, float defaultFloorHeight, float eyeHeight);
+
+    // bspManager must already be init()ed with the same level geometry the cache was written for
+    static bool load(const std::string &cachePath, uint64_t key, BSPManager &bspManager);
+    static bool save(const std::string &cachePath, uint64_t key, const BSPManager &bspManager);
+};
+
+} // namespace TwoHalfD
+
+#endif
@@ -4,7 +4,7 @@
 #include "TwoHalfD/types/bsp_types.h"
 #include "TwoHalfD/types/math_types.h"
 
-#include <unordered_map>
+#include <cstdint>
 #include <vector>
 
 namespace TwoHalfD {
@@ -19,17 +19,31 @@ struct BSPGraphEdge {
     int doorId = -1;  // -1 = no door; otherwise references a door entity by id
 };
 
+// Graph node i is BSP leaf i
 struct BSPGraphNode {
-    const BSPNode *bspNode;
+    const BSPLeaf *leaf;
     XYVectorf centroid;
     float floorHeight;
     std::vector<BSPGraphEdge> edges;
 };
 
+class BSPCache;
+
 class BSPGraph {
+    friend class BSPCache; // reads and restores the built tree and graph
+
   public:
-    void build(BSPNode *root, const std::vector<Segment> &segments, float defaultFloorHeight);
+    // nodeBounds is parallel to bspNodes
+    void build(const std::vector<BSPNode> &bspNodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+               const std::vector<BSPBounds> &nodeBounds, float defaultFloorHeight);
+    // Patches the graph after the BSP restructured some leaves in place (dynamic walls): nodes are added for new leaves, and only the
+    // changed leaves are unlinked and re-linked against the leaves they now touch. nodeBounds must already be up to date.
+    void relinkLeaves(const std::vector<BSPNode> &bspNodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                      const std::vector<BSPBounds> &nodeBounds, const std::vector<int> &changedLeaves, float defaultFloorHeight);
     void setDoor(int nodeA, int nodeB, int doorId);
+    // Whether both graphs link the same nodes, with the portals between each pair adding up to the same width within tolerance. Doors
+    // and where exactly the portals sit are not compared.
+    bool hasSameEdges(const BSPGraph &other, float tolerance) const;
 
     int getNodeCount() const {
         return static_cast<int>(m_nodes.size());
@@ -41,23 +55,23 @@ class BSPGraph {
         return m_nodes[index];
     }
     int findNodeForPoint(const XYVectorf &point) const;
-    int getNodeIndex(const BSPNode *node) const;
     const std::vector<BSPGraphNode> &getNodes() const {
         return m_nodes;
     }
 
     std::vector<XYVectorf> findPath(const XYVectorf &start, const XYVectorf &end, float entityWidth, float maxHeightDiff, float maxStepDown, float maxDistance) const;
+    // Same, for a caller that already knows which nodes the endpoints are in
+    std::vector<XYVectorf> findPath(int startNode, int endNode, const XYVectorf &start, const XYVectorf &end, float entityWidth,
+                                    float maxHeightDiff, float maxStepDown, float maxDistance) const;
 
   private:
     std::vector<BSPGraphNode> m_nodes;
-    std::unordered_map<const BSPNode *, int> m_nodeIndexMap;
 
-    void _collectLeaves(BSPNode *node, float defaultFloorHeight);
-    void _processInternalNode(BSPNode *node, const std::vector<Segment> &segments);
-    void _collectLeavesTouchingSplitter(BSPNode *node, const XYVectorf &splitterP0, const XYVectorf &splitterDir,
-                                        std::vector<std::pair<int, std::pair<float, float>>> &result);
-    std::vector<std::pair<float, float>> _getUnblockedIntervals(float tA, float tB, const XYVectorf &splitterP0, const XYVectorf &splitterDir,
-                                                                const std::vector<Segment> &segments);
+    void _collectLeaves(const std::vector<BSPLeaf> &leaves, float defaultFloorHeight);
+    static void _computeNodeShape(BSPGraphNode &graphNode, float defaultFloorHeight);
+    void _linkAdjacentLeaves(int nodeA, int nodeB, const std::vector<BSPNode> &bspNodes, const std::vector<BSPLeaf> &leaves,
+                             const std::vector<Segment> &segments, const std::vector<BSPBounds> &nodeBounds);
+    void _addEdges(int nodeA, int nodeB, const XYVectorf &lineP0, const XYVectorf &lineDir, const std::vector<std::pair<float, float>> &openings);
 };
 
 } // namespace TwoHalfD
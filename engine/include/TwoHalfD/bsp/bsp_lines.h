@@ -0,0 +1,79 @@
+#ifndef BSP_LINES_H
+#define BSP_LINES_H
+
+#include "TwoHalfD/types/bsp_types.h"
+#include "TwoHalfD/types/math_types.h"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace TwoHalfD {
+
+// Leaves meeting across splitter lines, shared by BSPGraph edges, BSPPortals pieces and BSPPVS portals so they all pair the same leaves
+
+// The line through p0 along the unit direction dir, of which only [tMin, tMax] is looked at
+struct BSPLine {
+    XYVectorf p0;
+    XYVectorf dir;
+    float tMin = std::numeric_limits<float>::lowest();
+    float tMax = std::numeric_limits<float>::max();
+};
+
+// A leaf with boundary edges on a line, and the stretch of the line they cover
+struct LineTouch {
+    int leaf;
+    float tMin;
+    float tMax;
+};
+
+// A segment lying on a line, and the stretch of the line it covers
+struct LineSegment {
+    int segmentID;
+    float tMin;
+    float tMax;
+};
+
+// Stretch of a splitter's line where a leaf on its front side meets a leaf on its back side
+struct LineOverlap {
+    int frontLeaf;
+    int backLeaf;
+    float tMin;
+    float tMax;
+};
+
+// Everything lying on one splitter's line. Colinear segments are sent to the front when splitting, so the segments below the node are
+// every segment on the line within its area. Kept between calls so the vectors are reused.
+struct SplitterLine {
+    BSPLine line;
+    std::vector<LineTouch> frontTouches;
+    std::vector<LineTouch> backTouches;
+    std::vector<LineOverlap> overlaps;
+    std::vector<LineSegment> segments; // the splitter and the segments on its line below it, by tMin
+};
+
+// Splitting on a line through a leaf's edge leaves a sliver with its points on one line, which no one can stand in or see through
+bool hasArea(const Polygon &bounds);
+
+// The stretch of the line covered by the polygon's edges lying on it. Every edge counts: a split can leave a repeated vertex, so the first
+// edge found there may have no length. Returns false when the edges cover none of it.
+bool extentOnLine(const Polygon &bounds, const BSPLine &line, float &tMin, float &tMax);
+
+// Leaves with area below nodeIndex that touch the line, and the segments lying on it; either output may be null. nodeBounds is parallel
+// to nodes, and subtrees whose box is clear of the line's looked-at stretch are skipped.
+void collectOnLine(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                   const std::vector<BSPBounds> &nodeBounds, uint32_t nodeIndex, const BSPLine &line, std::vector<LineTouch> *touches,
+                   std::vector<LineSegment> *lineSegments);
+
+// Fills out for an internal node's splitter, or only for the stretch of its line alongside the box within if one is given. Returns false
+// when the splitter has no length.
+bool collectSplitterLine(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                         const std::vector<BSPBounds> &nodeBounds, uint32_t nodeIndex, SplitterLine &out, const BSPBounds *within = nullptr);
+
+// The parts of [tMin, tMax] that none of the blockers, sorted by tMin, cover
+void openStretches(const std::vector<LineSegment> &blockers, float tMin, float tMax, std::vector<std::pair<float, float>> &out);
+
+} // namespace TwoHalfD
+
+#endif
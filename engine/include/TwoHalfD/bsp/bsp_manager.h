@@ -2,12 +2,17 @@
 #define BSP_MANAGER_H
 
 #include "TwoHalfD/bsp/bsp_graph.h"
+#include "TwoHalfD/bsp/bsp_portals.h"
+#include "TwoHalfD/bsp/bsp_pvs.h"
+#include "TwoHalfD/bsp/column_occlusion.h"
 #include "TwoHalfD/engine_types.h"
 #include <cstddef>
+#include <limits>
 #include <memory>
-#include <queue>
+#include <optional>
+#include <span>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace TwoHalfD {
@@ -18,9 +23,69 @@ struct OptimalCostPartitioning {
     int numBack;
 };
 
+struct PartitioningStats {
+    int bestSeed = -1;
+    float bestScore = std::numeric_limits<float>::max();
+    int seedsEvaluated = 0; // seeds whose tree was built to completion
+    int seedsPruned = 0;    // seeds abandoned once their split cost exceeded the best score
+    unsigned int threadCount = 0;
+};
+
+// Nodes, leaves and splitter segments of a (sub)tree under construction, linked by sink-local indices. Subtrees built on another
+// thread fill their own sink, which is appended back in back-then-front order so the result matches a serial build.
+struct BSPBuildSink {
+    std::vector<BSPNode> nodes;
+    std::vector<BSPLeaf> leaves;
+    std::vector<Segment> segments;
+};
+
+// Working storage for partitioning. Every segment a build touches, inputs and the pieces split off them, lives in pool, and a node's
+// segment list is a range of indices into pool. Children append their ranges past their parent's and both vectors are truncated as
+// the recursion unwinds, so a worker that keeps one BSPScratch across seeds stops allocating once it has seen its deepest tree.
+struct BSPScratch {
+    std::vector<Segment> pool;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> backIndices; // back half of the node being partitioned, before it is appended after the front half
+};
+
+struct IndexRange {
+    size_t begin;
+    size_t end;
+
+    size_t size() const {
+        return end - begin;
+    }
+    bool empty() const {
+        return begin == end;
+    }
+};
+
+// The camera's horizontal view wedge as two side planes through the camera, normals pointing inwards. Disabled for a field of view of
+// 180 degrees or more, where two planes no longer bound it.
+struct ViewWedge {
+    XYVectorf origin;
+    XYVectorf leftNormal;
+    XYVectorf rightNormal;
+    bool enabled = false;
+};
+
+// One frame's traversal output. Owned by the caller and refilled by BSPManager::update every frame; the vector keeps its capacity, so
+// after the first few frames drawing a level no longer allocates.
+struct DrawList {
+    std::vector<DrawCommand> commands;
+
+    void clear() {
+        commands.clear();
+    }
+};
+
 static constexpr float BSP_EPSILON = 0.01f;
 
+class BSPCache;
+
 class BSPManager {
+    friend class BSPCache; // reads and restores the built tree and graph
+
   public:
     BSPManager() = default;
 
@@ -29,10 +94,15 @@ class BSPManager {
               int seed);
 
     // Construction
+    void setBuildMode(BSPBuildMode buildMode);
     void buildBSPTree();
     void buildGraph();
+    // Potentially visible sets over the static tree; eyeHeight is how far above the floor the camera's eye sits. Dynamic walls never
+    // block sight, so this has to run before any are inserted.
+    void buildPVS(float eyeHeight);
     std::unordered_map<int, float> insertSprites(const std::unordered_map<int, SpriteEntity> &entities);
     float moveSprite(int entityId, TwoHalfD::XYVectorf newPos);
+    void moveSprites(std::span<const std::pair<int, TwoHalfD::XYVectorf>> moves);
 
     float insertEffect(int effectId, TwoHalfD::XYVectorf pos);
     void removeEffect(int effectId);
@@ -41,15 +111,27 @@ class BSPManager {
     void updateColourOverlay(int id, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
     void removeColourOverlay(int id);
 
+    // Dynamic walls (doors, destructibles): only the affected leaves are restructured and only their graph edges re-linked
+    int insertWall(const Wall &wall);
+    bool removeWall(int dynamicWallId);
+    // Whether the graph, as patched by dynamic walls, links the same leaves as a fresh build of the tree would. Builds a whole graph to
+    // compare against, so it is for tests and debugging rather than every edit.
+    bool validateGraph() const;
+
     // Core functions
-    TwoHalfD::BSPNode *findConvexSection(const TwoHalfD::XYVectorf &point);
+    TwoHalfD::BSPLeaf *findConvexSection(const TwoHalfD::XYVectorf &point);
+    // For a point tracked from tick to tick: leafHint is where it was found last time (-1 at first) and is updated to its leaf now, so
+    // a point that stayed in or near its leaf is found without descending the tree
+    TwoHalfD::BSPLeaf *findConvexSection(const TwoHalfD::XYVectorf &point, int &leafHint);
+    // Leaf and floor height for every point in one walk down the tree, for crowds. The outputs must be as long as points; a point gets
+    // leaf -1 and floor height 0 only when there is no tree.
+    void findLeaves(std::span<const TwoHalfD::XYVectorf> points, std::span<int> leafIndices, std::span<float> floorHeights);
 
-    // Traverse logic
-    std::pair<std::vector<TwoHalfD::DrawCommand>, std::unordered_set<int>> update(TwoHalfD::Position &cameraPos);
-    void traverse(TwoHalfD::BSPNode *node, std::vector<TwoHalfD::DrawCommand> &commands, std::unordered_set<int> &floorSectionIds,
-                  const TwoHalfD::Position &cameraPos);
-    void traverse(TwoHalfD::BSPNode *node, std::vector<TwoHalfD::DrawCommand> &commands, std::unordered_set<int> &floorSectionIds,
-                  const TwoHalfD::Position &cameraPos, const TwoHalfD::XYVectorf &cameraDir);
+    // Traverse logic. Clears drawList and fills it back to front. Subtrees whose region lies outside the field of view are skipped, and
+    // with BSPTraversal::FrontToBack so is anything hidden behind nearer walls. BSPTraversal::Portal only visits what can be seen
+    // through portals from the camera's leaf.
+    void update(const TwoHalfD::CameraObject &camera, const TwoHalfD::EngineSettings &settings, DrawList &drawList);
+    void traverse(DrawList &drawList, const TwoHalfD::Position &cameraPos, const ViewWedge &view);
 
     // Getters
     TwoHalfD::Segment &getSegment(int id);
@@ -59,6 +141,7 @@ class BSPManager {
 
     // BSP optimization
     int findBestPartitioning();
+    const PartitioningStats &getPartitioningStats() const;
 
     // Collision
     std::vector<TwoHalfD::Segment> findSegmentIntersection(const TwoHalfD::XYVectorf &p1, const float radius);
@@ -75,48 +158,180 @@ class BSPManager {
     float m_defaultFloorHeight = 0.f;
     int m_defaultFloorTextureId = -1;
     int m_seed = -1;
+    BSPBuildMode m_buildMode = BSPBuildMode::SeedSearch;
+
+    std::vector<TwoHalfD::BSPNode> m_nodes;                     // m_nodes[0] is the root
+    std::vector<TwoHalfD::BSPLeaf> m_leaves;                    // indexed by BSPNode::leafIndex and by BSPGraph node index
+    std::vector<TwoHalfD::BSPBounds> m_nodeBounds;              // parallel to m_nodes
+    float m_cullMargin = 128.f; // sprites and effects are billboards around their position, so keep regions this close to the view
+    std::unordered_map<int, std::vector<int>> m_overlayLeafMap; // overlayId → leaf indices
+
+    // Where each sprite and effect sits in BSPLeaf::billboards. Indexed by handle rather than ID so that reordering a leaf's list every
+    // frame costs no hash lookups; the ID maps are only consulted when the game moves, adds or removes something.
+    struct BillboardSlot {
+        int leafIndex = -1; // -1 while outside every leaf
+        uint32_t index = 0;
+    };
+    std::vector<BillboardSlot> m_billboardSlots;
+    std::vector<uint32_t> m_freeBillboardHandles;
+    std::unordered_map<int, uint32_t> m_spriteHandles; // entityId → handle
+    std::unordered_map<int, uint32_t> m_effectHandles; // effectId → handle
 
-    std::unique_ptr<TwoHalfD::BSPNode> m_root;
-    std::unordered_map<int, TwoHalfD::BSPNode *> m_spriteNodeMap;               // entityId → BSP node
-    std::unordered_map<int, std::vector<TwoHalfD::BSPNode *>> m_overlayNodeMap; // overlayId → leaf nodes
-    std::unordered_map<int, XYVectorf> m_spritePositions;                       // entityId → position (for traverse)
-    std::unordered_map<int, TwoHalfD::BSPNode *> m_effectNodeMap;               // effectId → BSP node
-    std::unordered_map<int, XYVectorf> m_effectPositions;                       // effectId → position (for traverse)
+    // findLeaves and moveSprites scratch
+    std::vector<float> m_locateX;
+    std::vector<float> m_locateY;
+    std::vector<uint32_t> m_locateIds; // index into the caller's points
+    std::vector<uint32_t> m_locateSides;
+    std::vector<uint32_t> m_relocateHandles;
+    std::vector<int> m_relocateIds;
+    std::vector<TwoHalfD::XYVectorf> m_relocatePoints;
+    std::vector<int> m_relocateLeaves;
+    std::vector<float> m_relocateHeights;
+
+    int m_cameraLeaf = -1;                 // where update() last found the camera, the starting point for finding it next frame
+    TwoHalfD::ColumnOcclusion m_occlusion; // screen coverage for front-to-back traversal, reused every frame
+
+    // The whole tree's back-to-front order for the last camera position, as a flat list of steps. Traversal walks it forwards (or
+    // backwards for front to back) instead of recursing, and it is only patched where the camera has crossed a splitter since.
+    struct TraversalStep {
+        uint32_t nodeIndex;
+        int32_t jump; // Enter: the step after the matching Exit. Exit: the step before the matching Enter.
+        enum Kind : uint8_t { Enter, Segment, Exit, Leaf } kind;
+    };
+    std::vector<TraversalStep> m_traversalOrder;
+    std::vector<uint32_t> m_orderPositions; // parallel to m_nodes: Enter or Leaf step, BSP_NULL_INDEX for nodes not in the tree
+    std::vector<uint8_t> m_orderSides;      // parallel to m_nodes: whether the camera was in front of the splitter when it was written
+    std::vector<double> m_orderDueAt;       // parallel to m_nodes: travel total at which the splitter's side must be tested again
+    std::vector<std::pair<double, uint32_t>> m_orderDueHeap; // min-heap of (due at, node); entries not matching m_orderDueAt are stale
+    std::vector<uint32_t> m_dueNodes;       // _updateTraversalOrder scratch
+    std::vector<uint32_t> m_flippedNodes;   // _updateTraversalOrder scratch
+    double m_orderTravel = 0.0;             // distance the camera has moved since the order was last written in full
+    XYVectorf m_orderCameraPos;
+    bool m_traversalOrderValid = false;
+
+    // PVS restriction of traversal. m_nodeVisibility is recomputed whenever the camera moves to another cluster or the tree changes.
+    static constexpr uint8_t PVS_REGION = 1;     // a leaf below the node is in the camera cluster's PVS
+    static constexpr uint8_t PVS_BILLBOARDS = 2; // ... or next to one, so its sprites and effects may reach into view
+    static constexpr uint8_t PVS_SEGMENT = 4;    // ... or a splitter below it lies against a visible leaf across an ancestor's line
+    TwoHalfD::BSPPVS m_pvs;
+    std::vector<uint8_t> m_pvsRow;         // decompressed row of m_pvsCluster
+    std::vector<uint8_t> m_nodeVisibility; // parallel to m_nodes
+    int m_pvsCluster = -1;                 // cluster m_nodeVisibility was computed for, -1 when stale
+    std::vector<std::pair<XYVectorf, XYVectorf>> m_pvsOpenLines; // _markVisibleNodes scratch: ancestor splitters (start, direction) with a visible back
+    bool m_pvsActive = false;              // whether this frame's traversal is restricted to m_nodeVisibility
+
+    // Portal traversal. The tables are built on first use and dropped whenever the tree changes.
+    TwoHalfD::BSPPortals m_portals;
+    std::vector<uint8_t> m_portalNodeFlags;    // parallel to m_nodes, the PVS flags on the paths to this frame's leaves and segments
+    std::vector<uint32_t> m_portalMarkedNodes; // nodes with flags set, cleared again after the frame
+
+    // A dynamic region is a leaf of the static tree that dynamic walls have since been inserted into. Its original bounds and floor are
+    // kept so the region can be rebuilt from scratch when one of its walls is removed.
+    struct DynamicRegion {
+        Polygon bounds;
+        std::unique_ptr<FloorSection> floorSection;
+        int pvsCluster = -1;
+        std::vector<uint32_t> ancestors; // static nodes from the root down to the region root's parent
+    };
+    struct DynamicWall {
+        std::unique_ptr<Wall> wall;    // owned here so segments can point at it
+        std::vector<uint32_t> regions; // root node indices of the regions its fragments went into
+    };
+    std::unordered_map<int, DynamicWall> m_dynamicWalls;          // dynamicWallId → wall
+    std::unordered_map<uint32_t, DynamicRegion> m_dynamicRegions; // region root node index → region
+    int m_nextDynamicWallId = 0;
+    std::vector<uint32_t> m_freeNodes;
+    std::vector<int> m_freeLeaves;
+    std::vector<int> m_freeSegments;
     TwoHalfD::BSPGraph m_graph;
     std::vector<TwoHalfD::Segment> m_segments;
     size_t m_segmentID = 0;
     float m_splitWeight = 3.f;
+    size_t m_heuristicCandidates = 32;  // splitters scored per node in heuristic mode
+    float m_nonAxisAlignedPenalty = 0.5f; // heuristic tie breakers: prefer axis-aligned walls over diagonals and floor edges
+    float m_floorBoundaryPenalty = 0.25f;
+    size_t m_parallelBuildThreshold = 256; // subtrees with fewer segments than this are always built on the calling thread
     int m_startSeed = 0;
     int m_endSeed = 20000;
+    PartitioningStats m_partitioningStats;
 
-    void _buildBSPTree(TwoHalfD::BSPNode *node, const std::vector<TwoHalfD::Segment> &inputSegments, Polygon bounds, int floorSectionId,
-                       struct OptimalCostPartitioning &cost, bool saveSegments = true);
-    std::pair<std::vector<TwoHalfD::Segment>, std::vector<TwoHalfD::Segment>> _splitSpace(TwoHalfD::BSPNode *node,
-                                                                                          const std::vector<TwoHalfD::Segment> &inputSegments,
-                                                                                          struct OptimalCostPartitioning &cost,
-                                                                                          bool saveSegments = true);
+    uint32_t _buildBSPTree(BSPScratch &scratch, IndexRange range, Polygon bounds, int floorSectionId, struct OptimalCostPartitioning &cost,
+                           BSPBuildSink &sink, int parallelDepth = 0);
+    std::pair<IndexRange, IndexRange> _splitSpace(TwoHalfD::BSPNode *node, BSPScratch &scratch, IndexRange range,
+                                                  struct OptimalCostPartitioning &cost, BSPBuildSink *sink = nullptr, size_t splitterOffset = 0);
+    size_t _selectSplitter(const BSPScratch &scratch, IndexRange range) const;
 
     // Construction
-    void _addSegment(TwoHalfD::Segment &&segment, TwoHalfD::BSPNode *node);
-    float _insertSprite(TwoHalfD::BSPNode *node, int entityId, TwoHalfD::XYVectorf pos);
-    float _insertEffect(TwoHalfD::BSPNode *node, int effectId, TwoHalfD::XYVectorf pos);
+    void _addSegment(TwoHalfD::Segment &&segment, TwoHalfD::BSPNode *node, BSPBuildSink &sink);
+    uint32_t _addLeaf(BSPBuildSink &sink, Polygon bounds, int leafFloorSectionId, int floorSectionId);
+    uint32_t _appendSink(BSPBuildSink &sink, BSPBuildSink &&subtree);
+    void _commitSink(BSPBuildSink &&sink);
+    float _insertSprite(int entityId, TwoHalfD::XYVectorf pos);
+    float _insertEffect(int effectId, TwoHalfD::XYVectorf pos);
+    uint32_t _billboardHandle(std::unordered_map<int, uint32_t> &handles, int id);
+    float _placeBillboard(uint32_t handle, int id, bool isEffect, TwoHalfD::XYVectorf pos, int leafIndex);
+    float _linkBillboard(const TwoHalfD::BSPLeafBillboard &billboard, int leafIndex);
+    void _unlinkBillboard(uint32_t handle);
+    void _clearBillboards();
+    float _leafFloorHeight(const TwoHalfD::BSPLeaf &leaf) const;
+
+    // Dynamic walls
+    void _resetDynamicState();
+    void _insertDynamicSegment(uint32_t nodeIndex, const TwoHalfD::Segment &segment, uint32_t regionRoot, std::vector<int> &changedLeaves,
+                               std::vector<uint32_t> &regions, std::vector<uint32_t> &path);
+    void _splitLeaf(uint32_t nodeIndex, const TwoHalfD::Segment &segment, std::vector<int> &changedLeaves);
+    void _rebuildRegion(uint32_t regionRoot, const Wall *removedWall, std::vector<int> &changedLeaves);
+    void _refreshRegions(const std::vector<std::pair<uint32_t, std::vector<uint32_t>>> &regions, const std::vector<int> &changedLeaves,
+                         const Wall &wall);
+    void _refitNodeBounds(uint32_t regionRoot, const std::vector<uint32_t> &ancestors);
+    void _spliceTraversalOrder(uint32_t regionRoot, const std::vector<uint32_t> &ancestors);
+    void _refreshVisibility(uint32_t nodeIndex, const std::vector<uint32_t> &ancestors);
+    uint32_t _allocateNode();
+    int _allocateLeaf();
+    int _allocateSegment(const TwoHalfD::Segment &segment);
+    static std::unique_ptr<FloorSection> _cloneFloorSection(const FloorSection *floorSection, const Polygon &bounds);
 
     // Colour overlay helpers
-    void _insertColourOverlayTriangle(BSPNode *node, const Polygon &triangle, int id, float height, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+    void _insertColourOverlayTriangle(uint32_t nodeIndex, const Polygon &triangle, int id, float height, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
     static std::vector<Polygon> _triangulate(const Polygon &polygon);
 
     // Core functionality
-    TwoHalfD::BSPNode *_findConvexSection(const TwoHalfD::XYVectorf &point, TwoHalfD::BSPNode *node);
+    int _findLeaf(const TwoHalfD::XYVectorf &point) const;
+    int _findLeaf(const TwoHalfD::XYVectorf &point, int hintLeaf) const;
+    int _findLeafNear(const TwoHalfD::XYVectorf &point, int hintLeaf) const;
+    void _findLeaves(uint32_t nodeIndex, size_t begin, size_t end, std::span<int> leafIndices, std::span<float> floorHeights);
+    bool _isInsideLevel(const TwoHalfD::XYVectorf &point) const;
+    bool _isInsideLeaf(int leafIndex, const TwoHalfD::XYVectorf &point) const;
+    void _invalidateNodeCaches();
+    void _computeNodeBounds();
+    const TwoHalfD::BSPBounds &_computeNodeBounds(uint32_t nodeIndex);
+    bool _isVisible(uint32_t nodeIndex, const ViewWedge &view) const;
+    void _traverseFrontToBack(DrawList &drawList, const TwoHalfD::Position &cameraPos, const ViewWedge &view);
+    void _updateTraversalOrder(const TwoHalfD::XYVectorf &cameraPos);
+    uint32_t _writeTraversalOrder(uint32_t nodeIndex, uint32_t position, const TwoHalfD::XYVectorf &cameraPos);
+    void _scheduleSideCheck(uint32_t nodeIndex, const TwoHalfD::XYVectorf &cameraPos);
+    void _sortLeafBillboards(TwoHalfD::BSPLeaf &leaf, const TwoHalfD::XYVectorf &cameraPos);
+    void _updatePVSVisibility(const TwoHalfD::XYVectorf &cameraPos);
+    uint8_t _markVisibleNodes(uint32_t nodeIndex);
+    uint8_t _leafVisibility(int leafIndex) const;
+    bool _liesOnOpenLine(const TwoHalfD::Segment &splitter) const;
+    bool _isClusterVisible(int cluster) const;
+    bool _traversePortals(const TwoHalfD::CameraObject &camera, const TwoHalfD::EngineSettings &settings, DrawList &drawList);
+    void _traversePortalOrder(uint32_t nodeIndex, DrawList &drawList, const TwoHalfD::Position &cameraPos);
+    void _markPortalPath(uint32_t nodeIndex, uint8_t flags);
+    void _buildPortals();
 
     // BSP optimization
-    float _findIndividualPartitioning(int seed, std::vector<TwoHalfD::Segment> segments);
+    std::vector<TwoHalfD::Segment> _makeInputSegments() const;
+    std::optional<float> _findIndividualPartitioning(int seed, BSPScratch &scratch, size_t segmentCount, float costBound);
+    bool _evaluatePartitioning(BSPScratch &scratch, IndexRange range, struct OptimalCostPartitioning &cost, float costBound);
 
     // Find bounding box of a set of segments
     std::pair<Polygon, Polygon> _splitConvexShape(const Polygon &vertices, const TwoHalfD::Segment &splitter);
     TwoHalfD::Polygon _getInitialBounds(const std::vector<TwoHalfD::Segment> &segments);
 
     // Collision
-    void _findSegmentIntersections(const TwoHalfD::XYVectorf &p1, float radius, TwoHalfD::BSPNode *node,
+    void _findSegmentIntersections(const TwoHalfD::XYVectorf &p1, float radius, uint32_t nodeIndex,
                                    std::vector<TwoHalfD::Segment> &intersectedSegments);
 
     // Path smoothing
@@ -0,0 +1,127 @@
+#ifndef BSP_PORTALS_H
+#define BSP_PORTALS_H
+
+#include "TwoHalfD/types/bsp_types.h"
+#include "TwoHalfD/types/math_types.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace TwoHalfD {
+
+// Render portals for traversal that starts at the camera's leaf. Every leaf's boundary is cut into pieces along the splitter lines it
+// lies on; a piece knows the leaf across it and the segment drawn on it, if any. Unlike BSPGraph edges, which any wall closes, sight
+// passes through a piece unless its wall reaches from the lowest floor up past everything behind it and the eye.
+//
+// A flood follows pieces outwards from the camera leaf, carrying the view window as an interval of angles from the view direction and
+// narrowing it to each portal it passes. What it reaches is recorded per leaf and segment for the caller to draw in BSP order.
+class BSPPortals {
+  public:
+    // nodeBounds is parallel to nodes. A wall only blocks sight if it starts at or below sightBottom and ends at or above both sightTop
+    // and the eye.
+    void build(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+               const std::vector<BSPBounds> &nodeBounds, float sightBottom, float sightTop);
+    // Brings the tables up to date after the wall was put in or taken out, restructuring the subtrees below regionRoots: their node
+    // links are redone, and only the pieces of changedLeaves, of the leaves across from them and of leaves meeting along the wall are cut
+    // again. Nodes, leaves and segments may have been appended since the build.
+    void update(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                const std::vector<BSPBounds> &nodeBounds, const std::vector<uint32_t> &regionRoots, const std::vector<int> &changedLeaves,
+                const Segment &wall);
+    void clear();
+
+    bool isBuilt() const {
+        return m_built;
+    }
+    float getSightTop() const {
+        return m_sightTop;
+    }
+
+    // Floods from startLeaf through whatever can be seen within [windowMin, windowMax]. Returns false when the flood ran over its step
+    // budget, in which case what it recorded is incomplete.
+    bool flood(int startLeaf, const XYVectorf &cameraPos, float cameraDirection, float eyeHeight, float windowMin, float windowMax,
+               const std::vector<Segment> &segments);
+
+    // Results of the last flood
+    const std::vector<int> &getVisibleLeaves() const {
+        return m_visibleLeaves;
+    }
+    // Leaves across a piece of a visible leaf that were not reached themselves; their sprites and effects may still reach into view
+    const std::vector<int> &getNeighbourLeaves() const {
+        return m_neighbourLeaves;
+    }
+    const std::vector<int> &getVisibleSegments() const {
+        return m_visibleSegments;
+    }
+    bool isLeafVisible(int leafIndex) const {
+        return m_leafStates[leafIndex].visibleStamp == m_stamp;
+    }
+    bool isSegmentVisible(int segmentID) const {
+        return m_segmentStamps[segmentID] == m_stamp;
+    }
+
+    uint32_t getLeafNode(int leafIndex) const {
+        return m_leafNodes[leafIndex];
+    }
+    // Node whose splitter the segment is. Segments colinear with an earlier splitter are not under every leaf that borders them.
+    uint32_t getSegmentNode(int segmentID) const {
+        return m_segmentNodes[segmentID];
+    }
+    uint32_t getParent(uint32_t nodeIndex) const {
+        return m_nodeParents[nodeIndex];
+    }
+
+  private:
+    struct Piece {
+        XYVectorf v1; // ordered so the leaf lies to the left of v1 → v2
+        XYVectorf v2;
+        int targetLeaf; // -1 when nothing is across
+        int segmentID;  // -1 for an open stretch
+    };
+    struct PieceRange {
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+    struct LeafState {
+        uint32_t visibleStamp = 0;
+        uint32_t neighbourStamp = 0;
+        int firstWindow = -1; // windows the leaf has been flooded with in this stamp, linked through m_windows
+    };
+    struct Window {
+        float min;
+        float max;
+        int next;
+    };
+    bool m_built = false;
+    std::vector<PieceRange> m_pieceRanges; // leaf → its pieces in m_pieces
+    std::vector<Piece> m_pieces;
+    size_t m_deadPieces = 0;               // pieces left behind in m_pieces by update, no longer in any leaf's range
+    std::vector<uint32_t> m_leafNodes;    // leaf → its node
+    std::vector<uint32_t> m_segmentNodes; // segment → the node it splits
+    std::vector<uint32_t> m_nodeParents; // BSP_NULL_INDEX for the root
+    float m_sightBottom = 0.f;
+    float m_sightTop = 0.f;
+
+    // Flood state, stamped so nothing has to be cleared between floods
+    uint32_t m_stamp = 0;
+    std::vector<LeafState> m_leafStates;
+    std::vector<uint32_t> m_segmentStamps;
+    std::vector<int> m_visibleLeaves;
+    std::vector<int> m_neighbourLeaves;
+    std::vector<int> m_visibleSegments;
+    std::vector<Window> m_windows;
+    size_t m_steps = 0;
+    size_t m_stepBudget = 0;
+    XYVectorf m_cameraPos;
+    XYVectorf m_direction;
+    float m_eyeHeight = 0.f;
+
+    void _linkNodes(const std::vector<BSPNode> &nodes, uint32_t rootIndex, std::vector<uint32_t> *internalNodes);
+    bool _flood(int leaf, float windowMin, float windowMax, const std::vector<Segment> &segments);
+    bool _clipToWindow(const Piece &piece, float windowMin, float windowMax, float &clippedMin, float &clippedMax) const;
+    bool _blocksSight(const Segment &segment) const;
+    float _angleOf(const XYVectorf &point) const;
+};
+
+} // namespace TwoHalfD
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BSP_PVS_H
+#define BSP_PVS_H
+
+#include "TwoHalfD/types/bsp_types.h"
+#include "TwoHalfD/types/math_types.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace TwoHalfD {
+
+// Potentially visible sets. Every leaf of the static tree is a cluster, and each cluster's row holds one bit per cluster that can be seen
+// from anywhere inside it. Only walls nothing can be seen over or under block sight: ones reaching from sightBottom or lower up to
+// sightTop or higher. Rows are stored run-length compressed (a zero byte is followed by the number of zero bytes it stands for).
+class BSPPVS {
+    friend class BSPCache; // reads and restores the compressed rows
+
+  public:
+    // nodeBounds is parallel to nodes
+    void build(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+               const std::vector<BSPBounds> &nodeBounds, float sightBottom, float sightTop);
+    void clear();
+
+    bool empty() const {
+        return m_clusterCount == 0;
+    }
+    int getClusterCount() const {
+        return m_clusterCount;
+    }
+    size_t getCompressedSize() const {
+        return m_rows.size();
+    }
+    // Expands cluster's row into out, bit i of byte i / 8 set when cluster i may be visible
+    void decompressRow(int cluster, std::vector<uint8_t> &out) const;
+
+  private:
+    int m_clusterCount = 0;
+    std::vector<uint32_t> m_rowOffsets; // cluster → start of its row in m_rows, plus one past the last row
+    std::vector<uint8_t> m_rows;
+
+    // A stretch of shared leaf boundary that sight can pass through, directed from one leaf into the other
+    struct Portal {
+        XYVectorf p0;
+        XYVectorf p1;
+        int target;
+    };
+    // Line-of-sight flow state for one source cluster; each worker thread has its own
+    struct FlowScratch {
+        std::vector<uint64_t> visible;
+        std::vector<uint8_t> onPath;
+        std::vector<int> floodStack;
+        size_t steps = 0;
+        bool overBudget = false;
+    };
+
+    std::vector<std::vector<Portal>> m_portals; // leaf → portals leading out of it, only kept while building
+
+    void _collectPortals(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                         const std::vector<BSPBounds> &nodeBounds, float sightBottom, float sightTop);
+    void _computeRow(int cluster, FlowScratch &scratch, std::vector<uint8_t> &row) const;
+    void _flow(int leaf, XYVectorf source0, XYVectorf source1, const XYVectorf &pass0, const XYVectorf &pass1, size_t depth, FlowScratch &scratch) const;
+    void _floodReachable(int cluster, FlowScratch &scratch) const;
+};
+
+} // namespace TwoHalfD
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef COLUMN_OCCLUSION_H
+#define COLUMN_OCCLUSION_H
+
+#include "TwoHalfD/engine_types.h"
+
+#include <utility>
+#include <vector>
+
+namespace TwoHalfD {
+
+// Per-screen-column coverage for front-to-back BSP traversal. Each column keeps the run of rows that no nearer wall has painted yet;
+// walls are projected exactly like Renderer::renderSegment and shrink that run from its ends, and a column whose run is empty is solid.
+// Solid columns are linked to the next open one so runs of them are skipped in one step. Walls are assumed to be opaque.
+//
+// The renderer keeps one too, fed its draw list from the end, so a billboard is tested against exactly the walls painted over it.
+class ColumnOcclusion {
+  public:
+    // Starts an empty screen for this frame's camera
+    void reset(const CameraObject &camera, const EngineSettings &settings, float defaultFloorHeight);
+
+    bool isFull() const {
+        return m_openColumns == 0;
+    }
+
+    // Whether any pixel of the wall quad between heights bottom and top is still uncovered. The quad is then added as an occluder.
+    bool addWall(const XYVectorf &v1, const XYVectorf &v2, float bottom, float top);
+    // Whether any column the box, grown by margin on every side, projects onto is not yet solid
+    bool isRegionVisible(const BSPBounds &bounds, float margin);
+    // Whether any column under a camera-facing billboard of the given half width is not yet solid
+    bool isBillboardVisible(const XYVectorf &pos, float halfWidth);
+    // First and one past the last column in which some pixel of the screen rectangle is still uncovered; equal when none is
+    std::pair<int, int> visibleColumns(float left, float right, float top, float bottom);
+
+  private:
+    XYVectorf m_cameraPos;
+    XYVectorf m_direction;
+    XYVectorf m_plane;
+    float m_focalLength = 0.f;
+    float m_eyeHeight = 0.f;
+    float m_defaultFloorHeight = 0.f;
+    int m_width = 0;
+    int m_height = 0;
+
+    std::vector<int> m_openTop;    // first row not yet covered
+    std::vector<int> m_openBottom; // one past the last row not yet covered
+    std::vector<int> m_nextOpen;   // m_nextOpen[x] == x for open columns, otherwise a column at or before the next open one
+    int m_openColumns = 0;
+
+    int _findOpen(int column);
+    bool _anyOpen(float xMin, float xMax);
+};
+
+} // namespace TwoHalfD
+
+#endif
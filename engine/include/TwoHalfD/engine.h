@@ -22,6 +22,7 @@ class Engine {
 
     TwoHalfD::LevelMaker m_levelMaker;
     CameraObject m_cameraObject;
+    int m_cameraLeaf = -1; // BSP leaf the camera was last found in
 
     // Level data owned by Engine after initialization
     std::unordered_map<int, TextureSignature> m_textures;
@@ -32,6 +33,11 @@ class Engine {
 
     EngineClocks m_engineClocks;
 
+    // Headless bookkeeping; timings are only kept in headless mode so a long windowed session does not grow them
+    uint64_t m_framesRendered = 0;
+    double m_pendingUpdateMs = 0.0;
+    std::vector<FrameTiming> m_frameTimings;
+
     sf::RenderWindow m_window;
     TwoHalfD::BSPManager m_bspManager;
     TwoHalfD::Renderer m_renderer;
@@ -42,13 +48,17 @@ class Engine {
 
   public:
     Engine(const EngineSettings &engineSettings)
-        : m_engineSettings(engineSettings), m_engineState(EngineState::None), m_cameraObject(),
-          m_engineClocks(EngineClocks{m_engineSettings.graphicsFpsCap, m_engineSettings.gameFpsCap}),
-          m_window(sf::VideoMode(engineSettings.windowDim.x, engineSettings.windowDim.y), "Two Half D"),
+        : m_engineSettings(engineSettings), m_engineState(EngineState::None),
+          m_levelMaker(!(engineSettings.headless && engineSettings.renderBackend == RenderBackend::Software)), m_cameraObject(),
+          m_engineClocks(EngineClocks{m_engineSettings.graphicsFpsCap, m_engineSettings.gameFpsCap, false, false, m_engineSettings.fixedTimestep}),
           m_renderer(m_window, m_engineSettings, m_engineClocks), m_inputManager(m_window) {
 
-        m_window.setVerticalSyncEnabled(false);
-        m_window.setFramerateLimit(0);
+        // Headless the window is never opened; polling it yields no events
+        if (!m_engineSettings.headless) {
+            m_window.create(sf::VideoMode(engineSettings.windowDim.x, engineSettings.windowDim.y), "Two Half D");
+            m_window.setVerticalSyncEnabled(false);
+            m_window.setFramerateLimit(0);
+        }
         m_engineState = EngineState::initialised;
     }
 
@@ -83,9 +93,19 @@ class Engine {
 
     void render();
 
+    // Frame capture, mainly for headless runs. saveFrame writes the last rendered frame at resolution.
+    uint64_t getFramesRendered() const;
+    bool saveFrame(const std::string &filePath, FrameCaptureFormat format) const;
+    const std::vector<FrameTiming> &getFrameTimings() const;
+    bool saveFrameTimings(const std::string &filePath) const; // CSV, one row per frame
+
     void addColourOverlay(int id, const TwoHalfD::Polygon &vertices, float height, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
     void updateColourOverlay(int id, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
     void removeColourOverlay(int id);
+
+    // Walls added at runtime (doors, destructibles); returns an id for removeWall
+    int addWall(const TwoHalfD::Wall &wall);
+    void removeWall(int wallId);
 };
 
 } // namespace TwoHalfD
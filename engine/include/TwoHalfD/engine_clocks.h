@@ -11,15 +11,17 @@ class EngineClocks {
     double m_gameFpsCap;
     bool m_graphicsFpsUncapped;
     bool m_gamesFpsUncapped;
+    double m_fixedGameTimestep; // seconds, 0 when game time follows the wall clock
     TimeDelta m_graphicsTimeDelta{1 / m_graphicsFpsCap};
     TimeDelta m_gameTimeDelta{1 / m_gameFpsCap};
     CircularBuffer<double, 30, true> m_graphicFpsSample{};
     CircularBuffer<double, 30, true> m_gameFpsSample{};
 
   public:
-    EngineClocks(double graphicsFpsCap = 100.0, double gameFpsCap = 60.0, bool graphicsFpsUncapped = false, bool gamesFpsUncapped = false)
+    EngineClocks(double graphicsFpsCap = 100.0, double gameFpsCap = 60.0, bool graphicsFpsUncapped = false, bool gamesFpsUncapped = false,
+                 double fixedGameTimestep = 0.0)
         : m_graphicsFpsCap(graphicsFpsCap), m_gameFpsCap(gameFpsCap), m_graphicsFpsUncapped(graphicsFpsUncapped),
-          m_gamesFpsUncapped(gamesFpsUncapped) {}
+          m_gamesFpsUncapped(gamesFpsUncapped), m_fixedGameTimestep(fixedGameTimestep) {}
 
     bool graphicsTimeDeltaPassed();
     bool gameTimeDeltaPassed();
@@ -17,6 +17,24 @@ namespace TwoHalfD {
 
 using ObjectId = std::uint64_t;
 
+enum class RenderBackend {
+    OpenGL,   // shaders on the GPU through SFML
+    Software, // SoftwareRenderer on the CPU, uploaded to the window each frame
+};
+
+enum class FrameCaptureFormat {
+    RawRGBA, // width * height * 4 bytes, RGBA, top row first, no header
+    PNG,
+};
+
+// Time spent on one rendered frame in headless mode; updateMs covers the game updates run since the previous frame. With the OpenGL
+// backend renderMs is the time to submit the frame, which the GPU may still be drawing.
+struct FrameTiming {
+    uint64_t frame;
+    double updateMs;
+    double renderMs;
+};
+
 struct EngineSettings {
     sf::Vector2i windowDim = {960, 540};
     sf::Vector2i resolution = {960, 540};
@@ -32,6 +50,18 @@ struct EngineSettings {
     bool cameraCollision = true;
     float heightClipping = 10.f; // How much difference in floor height is allowed before clipping occurs
 
+    BSPBuildMode bspBuildMode = BSPBuildMode::SeedSearch; // overridden by a level's bspBuildMode line
+    bool useBSPCache = true; // load/save the built BSP and graph as <level file>.bspcache next to the level
+    BSPTraversal bspTraversal = BSPTraversal::FrontToBack;
+
+    RenderBackend renderBackend = RenderBackend::OpenGL;
+    unsigned int softwareRenderThreads = 0; // 0 uses every hardware thread
+
+    // Headless renders offscreen at resolution with no window, no input and no HUD, every time render is called. With the Software
+    // backend the GPU is not touched at all, so it runs with no display attached.
+    bool headless = false;
+    double fixedTimestep = 0.0; // seconds of game time per update when above 0, with an update due on every call; otherwise the wall clock
+
     float gravity = 0.01f;
     float maxFallSpeed = 15.f;
     bool canMoveWhileFalling = false;
@@ -48,6 +78,7 @@ struct Level {
 
     float cameraHeightStart;
     int seed = -1; // BSP seed, -1 means auto find best seed
+    std::optional<BSPBuildMode> bspBuildMode;
 
     int defaultFloorTextureId = -1;
     XYVectorf defaultFloorStart;
@@ -77,10 +108,6 @@ struct CameraObject {
     std::optional<bool> canMoveWhileFallingOverride = false;
 };
 
-struct RenderZBuffer {
-    std::vector<float> nearestWallRayDist;
-};
-
 enum class EngineState {
     None,
     initialised,
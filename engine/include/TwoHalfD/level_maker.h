@@ -22,6 +22,7 @@ enum EntityTypes {
     floorDefault,
     floorSection,
     animationTemplate,
+    bspBuildMode,
 };
 
 class LevelMaker {
@@ -31,9 +32,10 @@ class LevelMaker {
     std::vector<TwoHalfD::SpriteEntity> m_spriteEntities;
     std::unordered_map<int, TwoHalfD::TextureSignature> m_textures;
     const std::string m_defaultTextureFilePath = fs::path(ASSETS_DIR) / "textures/pattern_18_debug.png";
+    bool m_uploadTextures; // false leaves every TextureSignature::texture empty, for running without a GPU
 
   public:
-    LevelMaker() : m_entityId(0){};
+    explicit LevelMaker(bool uploadTextures = true) : m_entityId(0), m_uploadTextures(uploadTextures){};
 
     TwoHalfD::Level parseLevelFile(std::string levelFilePath);
 
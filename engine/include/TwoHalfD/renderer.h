@@ -2,12 +2,18 @@
 #define RENDERER_H
 
 #include <SFML/Graphics.hpp>
+#include <array>
 #include <filesystem>
+#include <memory>
+#include <vector>
 
 #include "TwoHalfD/bsp/bsp_manager.h"
+#include "TwoHalfD/bsp/column_occlusion.h"
 #include "TwoHalfD/engine_clocks.h"
 #include "TwoHalfD/engine_types.h"
 #include "TwoHalfD/entity_manager.h"
+#include "TwoHalfD/software_renderer.h"
+#include "TwoHalfD/texture_atlas.h"
 
 namespace TwoHalfD {
 
@@ -20,7 +26,10 @@ class Renderer {
     void setData(const std::unordered_map<int, TextureSignature> *textures, const EntityManager *entityManager, float defaultFloorHeight,
                  int defaultFloorTextureId, XYVectorf defaultFloorStart);
 
-    void render(const CameraObject &camera, BSPManager &bsp);
+    // Returns false when the frame cap skipped the frame; headless every call renders one
+    bool render(const CameraObject &camera, BSPManager &bsp);
+    // The last rendered frame at resolution, before it is scaled to the window
+    void captureFrame(sf::Image &image) const;
 
   private:
     sf::RenderWindow &m_window;
@@ -30,21 +39,90 @@ class Renderer {
     sf::RenderTexture m_renderTexture;
     sf::Shader m_perspectiveShader;
     sf::Shader m_floorShader;
-    RenderZBuffer m_renderZBuffer{};
+    sf::Shader m_billboardShader;
+    sf::Shader m_colourOverlayShader;
+    DrawList m_drawList; // refilled by BSPManager::update every frame
+
+    // Set when settings.renderBackend is Software; its frames are uploaded to m_softwareFrame and drawn under the HUD
+    std::unique_ptr<SoftwareRenderer> m_softwareRenderer;
+    sf::Texture m_softwareFrame;
+
+    // Consecutive walls on the same atlas page are drawn in one call. Each wall is a quad whose vertices carry 1/z and the wall ratio over z
+    // in their texture coordinates and the wall's index in the batch in their red channel, which picks its entries in wallParams and
+    // wallRects.
+    static constexpr size_t MAX_BATCH_WALLS = 64; // size of the arrays in perspectiveShader.frag
+    struct SegmentBatch {
+        const sf::Texture *texture = nullptr; // atlas page
+        std::vector<sf::Vertex> vertices;       // four per wall
+        std::vector<sf::Glsl::Vec2> wallParams; // per wall: height of its top, 1 / (height * scaleY)
+        std::vector<sf::Glsl::Vec4> wallRects;  // per wall: the texture's uvRect on the page
+    };
+    SegmentBatch m_segmentBatch;
+
+    // Sprites, their overlays and effects drawn one after another on the same atlas page go out in one call the same way. Each is a
+    // quad carrying its texture coordinate in repeats of the texture and, in its colour, its index in the batch and its shade.
+    static constexpr size_t MAX_BATCH_BILLBOARDS = 64; // size of the array in billboardShader.frag
+    struct BillboardBatch {
+        const sf::Texture *texture = nullptr; // atlas page
+        std::vector<sf::Vertex> vertices;     // four per billboard
+        std::vector<sf::Glsl::Vec4> rects;    // per billboard: the texture's uvRect on the page
+    };
+    BillboardBatch m_billboardBatch;
+
+    // This frame's billboard quads, built and culled against the walls drawn over them before anything is drawn
+    struct BillboardQuad {
+        const AtlasRegion *region;
+        sf::FloatRect screenRect;
+        sf::Vector2f repeatsStart; // texture coordinate at the top left, in repeats of the texture
+        sf::Vector2f repeatsEnd;   // and at the bottom right
+        sf::Uint8 shade;
+    };
+    ColumnOcclusion m_billboardOcclusion;
+    std::vector<BillboardQuad> m_billboardQuads;
+    std::vector<std::pair<uint32_t, uint32_t>> m_commandQuads; // per draw command, its range in m_billboardQuads
+    std::vector<sf::Vector2f> m_floorVertices;     // scratch for projected floor polygons
+    std::vector<sf::Vector2f> m_floorClipVertices; // scratch for clipping them to the rows within FLOOR_DISTANCE_CUTOFF
+    std::vector<sf::Vertex> m_overlayVertices;     // scratch for a colour overlay's triangle fan
+
+    // Floors are resolved before anything else is drawn. Each floor in the draw list gets a slot in draw order, 0 being the default
+    // floor, and its polygon, cut down to the rows it is shaded on, is written into m_floorIds in that slot's colour, so every pixel
+    // ends up holding the last floor drawn over it. One full-screen pass of floorshader.frag then shades all of them. Walls, billboards
+    // and colour overlays leave out the pixels a floor drawn after them covers, which gives the same picture as drawing each floor in
+    // its place in the list.
+    static constexpr size_t FLOOR_SLOTS_PER_PASS = 64; // size of the arrays in floorshader.frag
+    static constexpr size_t MAX_FLOOR_SLOTS = 65536;   // what the red and green channels of m_floorIds can hold
+    struct FloorSlot {
+        const AtlasRegion *region; // nullptr when there is nothing to draw
+        sf::Glsl::Vec4 texture;    // where the texture starts in the world, the texture's size in pixels
+        float relativeHeight;      // eye height above the floor
+    };
+    sf::RenderTexture m_floorIds;
+    std::vector<FloorSlot> m_floorSlots;
+    std::vector<sf::Vertex> m_floorIdVertices;
+    std::vector<uint32_t> m_commandFloorOrder; // per draw command, the slot of the last floor at or before it
+    std::array<sf::Vertex, 4> m_floorQuad;     // the full-screen quad the floor passes are drawn on
+    float m_floorOrder = 0.f;                  // the same for the batches being filled
 
     // Data sources (non-owning)
     const std::unordered_map<int, TextureSignature> *m_textures = nullptr;
+    TextureAtlas m_textureAtlas; // every surface and billboard samples the level textures from here
     const EntityManager *m_entityManager = nullptr;
     float m_defaultFloorHeight = 0.f;
     int m_defaultFloorTextureId = -1;
     XYVectorf m_defaultFloorStart{};
 
+    bool usesGpu() const;
+    void renderHeadless(const CameraObject &camera, BSPManager &bsp);
     void renderBSP(const CameraObject &camera, BSPManager &bsp);
-    void renderSegment(Segment segment, const CameraObject &camera);
-    void renderSprite(const SpriteEntity &spriteEntity, const CameraObject &camera);
-    void renderEffect(const AnimationEffect &effect, const CameraObject &camera);
-    void renderFloorSection(const FloorSection *floorSection, const CameraObject &camera);
+    void renderSegment(const Segment &segment, const CameraObject &camera);
+    void flushSegments();
+    void cullBillboards(const CameraObject &camera, BSPManager &bsp);
+    void buildSpriteQuads(const SpriteEntity &spriteEntity, const CameraObject &camera);
+    void buildEffectQuads(const AnimationEffect &effect, const CameraObject &camera);
+    void addBillboard(const BillboardQuad &billboard);
+    void flushBillboards();
     void renderColourOverlay(const FloorColourOverlay *overlay, const CameraObject &camera);
+    void buildFloorIds(const CameraObject &camera);
     void renderFloor(const CameraObject &camera);
     void renderOverlays(const CameraObject &camera);
 };
@@ -0,0 +1,24 @@
+// Sprites, their overlays and effects arrive batched as screen-aligned quads. Each vertex carries its texture coordinate in repeats of
+// the texture, the billboard's index in the batch in its red channel and the distance shade in its green channel.
+uniform sampler2D texture; // atlas page
+uniform vec4 billboardRects[64]; // per billboard: its texture's region on the page
+uniform sampler2D floorIds; // slot of the last floor drawn over each pixel, red plus 256 times green
+uniform vec2 resolution;
+uniform float floorOrder;   // slot of the last floor drawn before this batch
+
+void main() {
+    // A floor drawn after the billboard covers it
+    vec4 id = texture2D(floorIds, gl_FragCoord.xy / resolution);
+    if (floor(id.r * 255.0 + 0.5) + 256.0 * floor(id.g * 255.0 + 0.5) > floorOrder + 0.5) {
+        discard;
+    }
+
+    int billboard = int(gl_Color.r * 255.0 + 0.5);
+
+    // The page does not repeat, so wrap into the billboard's region here
+    vec2 texCord = billboardRects[billboard].xy + fract(gl_TexCoord[0].xy) * billboardRects[billboard].zw;
+    vec4 pixel = texture2D(texture, texCord);
+    pixel.rgb *= gl_Color.g;
+
+    gl_FragColor = pixel;
+}
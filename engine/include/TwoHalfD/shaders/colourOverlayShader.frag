@@ -0,0 +1,12 @@
+// Colour overlays tint the floor under them; the part of one that a floor drawn after it covers is left out
+uniform sampler2D floorIds; // slot of the last floor drawn over each pixel, red plus 256 times green
+uniform vec2 resolution;
+uniform float floorOrder; // slot of the last floor drawn before this overlay
+
+void main() {
+    vec4 id = texture2D(floorIds, gl_FragCoord.xy / resolution);
+    if (floor(id.r * 255.0 + 0.5) + 256.0 * floor(id.g * 255.0 + 0.5) > floorOrder + 0.5) {
+        discard;
+    }
+    gl_FragColor = gl_Color;
+}
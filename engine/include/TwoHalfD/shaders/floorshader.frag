@@ -1,8 +1,12 @@
-uniform vec2 textureStartCord;
-uniform sampler2D texture;
-uniform vec2 textureSize;
+// Every floor is shaded in one full-screen pass. floorIds holds, for each pixel, the slot of the last floor drawn over it in painter's
+// order: the red channel plus 256 times the green, 0 for the default floor. A pass covers 64 slots from slotBase, all on one atlas page.
+uniform sampler2D texture; // atlas page
+uniform sampler2D floorIds;
+uniform float slotBase;
+uniform vec4 floorRects[64];    // per slot: its texture's region on the page
+uniform vec4 floorTextures[64]; // per slot: where its texture starts in the world in xy, the texture's size in pixels in zw
+uniform float floorHeights[64]; // per slot: eye height above the floor, 0 for slots this pass does not draw
 uniform vec2 cameraPos;
-uniform float relativeCameraHeight;
 uniform vec2 n_plane;
 uniform vec2 direction;
 uniform float focalLength;
@@ -10,37 +14,47 @@ uniform vec2 resolution;
 uniform float distanceCutoff;
 uniform float shaderScale;
 
-bool pointInsidePolygon(vec2 p);
-
 void main() {
+    vec4 id = texture2D(floorIds, gl_FragCoord.xy / resolution);
+    float slot = floor(id.r * 255.0 + 0.5) + 256.0 * floor(id.g * 255.0 + 0.5) - slotBase;
+    if (slot < 0.0 || slot > 63.5) {
+        discard;
+    }
+    int floorSlot = int(slot + 0.5);
+
     vec2 pixelCord = gl_FragCoord.xy;
     pixelCord.y = resolution.y - pixelCord.y;
 
+    // The default floor only ever covers the lower half of the screen
+    if (slot + slotBase < 0.5 && pixelCord.y < resolution.y / 2.0) {
+        discard;
+    }
+
     float pixelsFromCenterY = pixelCord.y - resolution.y / 2.0;
     float pixelsFromCenterX = pixelCord.x - resolution.x / 2.0;
-    
+
+    float relativeCameraHeight = floorHeights[floorSlot];
     float perpWorldDistance = (relativeCameraHeight * focalLength) / pixelsFromCenterY;
 
+    // Floor sections are cut to these rows before they go into floorIds, so this only trims the default floor
     if ((perpWorldDistance < 0.001 || perpWorldDistance > distanceCutoff)) {
         discard;
-        return;
     }
-    
+
     float planeDist = perpWorldDistance * pixelsFromCenterX / focalLength;
     vec2 planeScaled = n_plane * planeDist;
     vec2 directionScaled = direction * perpWorldDistance;
 
     vec2 worldPos = cameraPos + planeScaled + directionScaled;
 
-    vec2 floorPos = worldPos - textureStartCord;
-    vec2 texCord = mod(floorPos, textureSize) / textureSize;
+    vec2 floorPos = worldPos - floorTextures[floorSlot].xy;
+    vec2 textureSize = floorTextures[floorSlot].zw;
+    vec2 texCord = floorRects[floorSlot].xy + mod(floorPos, textureSize) / textureSize * floorRects[floorSlot].zw;
 
     vec4 pixel = texture2D(texture, texCord);
 
     float shade = min(1., shaderScale / perpWorldDistance);
     pixel.rgb *= shade;
 
-
     gl_FragColor = pixel;
-    
-}
\ No newline at end of file
+}
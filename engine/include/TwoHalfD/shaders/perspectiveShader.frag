@@ -1,53 +1,42 @@
-uniform float wallLen;
-uniform float startRatio;
-uniform float endRatio;
-uniform sampler2D texture;
-uniform vec2 texSize;
-uniform vec2 topLeft;
-uniform vec2 bottomLeft;
-uniform vec2 bottomRight;
-uniform vec2 topRight;
-uniform float leftDepth;
-uniform float rightDepth;
+// Walls arrive batched. Each vertex carries 1/z and the wall ratio over z in its texture coordinates, both of which interpolate
+// linearly in screen space, and the wall's index in the batch in its red channel.
+uniform sampler2D texture; // atlas page
+uniform vec2 wallParams[64]; // per wall: height of its top, 1 / (height * scaleY)
+uniform vec4 wallRects[64];  // per wall: its texture's region on the page
 uniform vec2 resolution;
 uniform float shaderScale;
-uniform float wallHeightFloorHeighDiff;
-uniform float wallHeight;
-uniform float scaleX;
-uniform float scaleY;
+uniform float focalLength;
+uniform float eyeHeight;
+uniform float floorHeight;
+uniform sampler2D floorIds; // slot of the last floor drawn over each pixel, red plus 256 times green
+uniform float floorOrder;   // slot of the last floor drawn before this batch
 
 void main() {
-    vec2 pixelCord = gl_FragCoord.xy;
-    pixelCord.y = resolution.y - pixelCord.y;
-    float width = topRight.x - topLeft.x;
-    
-    if (abs(width) < 0.001) {
+    // A floor drawn after the wall covers it
+    vec4 id = texture2D(floorIds, gl_FragCoord.xy / resolution);
+    if (floor(id.r * 255.0 + 0.5) + 256.0 * floor(id.g * 255.0 + 0.5) > floorOrder + 0.5) {
         discard;
     }
-    
-    float n_xCord = (pixelCord.x - topLeft.x) / width;
-    
-    float invZ = leftDepth * (1.0 - n_xCord) + rightDepth * n_xCord;
-    float z = 1.0 / invZ;
-    
-    float worldPos_over_z = (startRatio * leftDepth) * (1.0 - n_xCord) + 
-                            (endRatio * rightDepth) * n_xCord;
-    float worldPos = worldPos_over_z * z;
-    float texX = worldPos / scaleX;
 
-    float topY = topLeft.y * (1.0 - n_xCord) + topRight.y * n_xCord;
-    float bottomY = bottomLeft.y * (1.0 - n_xCord) + bottomRight.y * n_xCord;
+    float pixelY = resolution.y - gl_FragCoord.y;
 
-    float rawTexY = (pixelCord.y - topY) / (bottomY - topY);
+    float invZ = gl_TexCoord[0].y;
+    float z = 1.0 / invZ;
 
-    if ((1. - rawTexY) * wallHeight < wallHeightFloorHeighDiff) {
+    // Height in the world of the point on the wall this pixel sees
+    float worldHeight = eyeHeight - (pixelY - resolution.y * 0.5) * z / focalLength;
+    if (worldHeight < floorHeight) {
         discard;
-        return;
     }
 
-    float texY = rawTexY / scaleY;
+    int wall = int(gl_Color.r * 255.0 + 0.5);
+    vec2 params = wallParams[wall];
+
+    float texX = gl_TexCoord[0].x * z;
+    float texY = (params.x - worldHeight) * params.y;
 
-    vec2 texCord = vec2(texX, texY);
+    // The page does not repeat, so wrap into the wall's region here
+    vec2 texCord = wallRects[wall].xy + fract(vec2(texX, texY)) * wallRects[wall].zw;
     vec4 pixel = texture2D(texture, texCord);
 
     float distanceFromCamera = z;
@@ -55,4 +44,4 @@ void main() {
     pixel.rgb *= shade;
 
     gl_FragColor = pixel;
-}
\ No newline at end of file
+}
@@ -0,0 +1,163 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include "TwoHalfD/bsp/bsp_manager.h"
+#include "TwoHalfD/engine_types.h"
+#include "TwoHalfD/entity_manager.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace TwoHalfD {
+
+// CPU rasterizer for the same draw list the shader path draws, for machines without a GPU and as a baseline to profile against. It
+// follows the shaders pixel for pixel: coverage is decided at pixel centres, textures are sampled nearest and repeat, and colours are
+// shaded by distance and alpha blended the way sf::BlendAlpha does. The HUD text is left to the caller.
+//
+// Each frame is projected once on the calling thread into screen-space primitives. The screen is then cut into strips of rows that
+// worker threads claim one at a time, each drawing every primitive in draw order clipped to its strip, so no two threads touch the same
+// pixel and painter's order holds within every strip.
+class SoftwareRenderer {
+  public:
+    explicit SoftwareRenderer(const EngineSettings &settings);
+    ~SoftwareRenderer();
+
+    SoftwareRenderer(const SoftwareRenderer &) = delete;
+    SoftwareRenderer &operator=(const SoftwareRenderer &) = delete;
+
+    void setData(const std::unordered_map<int, TextureSignature> *textures, const EntityManager *entityManager, float defaultFloorHeight,
+                 int defaultFloorTextureId, XYVectorf defaultFloorStart);
+
+    void render(const CameraObject &camera, BSPManager &bsp);
+
+    // RGBA, 8 bits a channel in that byte order, top row first; the layout sf::Texture::update and sf::Image::create take
+    const std::vector<uint32_t> &getFramebuffer() const {
+        return m_framebuffer;
+    }
+    const uint8_t *getPixels() const {
+        return reinterpret_cast<const uint8_t *>(m_framebuffer.data());
+    }
+    unsigned int getWidth() const {
+        return m_width;
+    }
+    unsigned int getHeight() const {
+        return m_height;
+    }
+
+  private:
+    struct SoftwareTexture {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        std::vector<uint32_t> pixels;
+    };
+
+    struct RasterWall {
+        float x1, x2;
+        float top1, top2;
+        float bottom1, bottom2;
+        float invZ1, invZ2;
+        float uOverZ1, uOverZ2; // wall ratio / scaleX / z
+        float topHeight;
+        float invHeightScale; // 1 / (height * scaleY)
+        const SoftwareTexture *texture;
+    };
+    // Textured floor drawn as the triangle fan over m_polygonVertices[firstVertex, firstVertex + vertexCount)
+    struct RasterFloor {
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        float relativeHeight;
+        XYVectorf textureStart;
+        const SoftwareTexture *texture;
+    };
+    // Axis-aligned textured rectangle; the texture coordinates run from 0 at the left and top to uMax and vMax in texels, wrapping
+    struct RasterBillboard {
+        float left, top, right, bottom;
+        float uMax, vMax;
+        uint32_t shade; // 0 to 255, multiplied into the texels' colour
+        const SoftwareTexture *texture;
+    };
+    struct RasterColourOverlay {
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t colour;
+    };
+    struct RasterCommand {
+        enum class Type { Wall, Floor, Billboard, ColourOverlay } type;
+        uint32_t index;
+    };
+
+    struct FrameConstants {
+        float halfX, halfY;
+        float focalLength;
+        float eyeHeight;
+        float defaultFloorHeight;
+        float shaderScale;
+        XYVectorf cameraPos;
+        XYVectorf direction;
+        XYVectorf plane;
+    };
+
+    static constexpr int STRIP_HEIGHT = 8;
+
+    const EngineSettings &m_settings;
+    unsigned int m_width = 0;
+    unsigned int m_height = 0;
+    std::vector<uint32_t> m_framebuffer;
+
+    // Data sources (non-owning)
+    const EntityManager *m_entityManager = nullptr;
+    float m_defaultFloorHeight = 0.f;
+    int m_defaultFloorTextureId = -1;
+    XYVectorf m_defaultFloorStart{};
+    std::vector<SoftwareTexture> m_textures; // indexed by texture id, empty where there is none
+
+    // This frame, projected
+    DrawList m_drawList;
+    FrameConstants m_frame{};
+    std::vector<RasterCommand> m_commands;
+    std::vector<RasterWall> m_walls;
+    std::vector<RasterFloor> m_floors;
+    std::vector<RasterBillboard> m_billboards;
+    std::vector<RasterColourOverlay> m_colourOverlays;
+    std::vector<sf::Vector2f> m_polygonVertices;
+    std::vector<sf::Vector2f> m_projectScratch;
+
+    // Worker threads wait for m_frameNumber to move on, then claim strips from m_nextStrip until none are left
+    std::vector<std::thread> m_workers;
+    std::mutex m_workMutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_workDone;
+    uint64_t m_frameNumber = 0;
+    unsigned int m_workersBusy = 0;
+    bool m_stopping = false;
+    std::atomic<int> m_nextStrip{0};
+    int m_stripCount = 0;
+
+    const SoftwareTexture *_findTexture(int textureId) const;
+    void _prepareFrame(const CameraObject &camera, BSPManager &bsp);
+    void _prepareSegment(const Segment &segment, const CameraObject &camera);
+    void _prepareFloor(const Polygon &vertices, float height, int textureId, XYVectorf textureStart, const CameraObject &camera);
+    void _prepareSprite(const SpriteEntity &spriteEntity, const CameraObject &camera);
+    void _prepareEffect(const AnimationEffect &effect, const CameraObject &camera);
+    void _prepareColourOverlay(const FloorColourOverlay &overlay, const CameraObject &camera);
+
+    void _workerLoop();
+    void _drawStrips();
+    void _drawStrip(int rowBegin, int rowEnd);
+    void _drawWall(const RasterWall &wall, int rowBegin, int rowEnd);
+    void _drawFloor(const RasterFloor &floor, int rowBegin, int rowEnd);
+    void _drawFloorSpan(const RasterFloor &floor, int row, int xBegin, int xEnd);
+    void _drawBillboard(const RasterBillboard &billboard, int rowBegin, int rowEnd);
+    void _drawColourOverlay(const RasterColourOverlay &overlay, int rowBegin, int rowEnd);
+    template <typename SpanFn>
+    void _rasterizeFan(uint32_t firstVertex, uint32_t vertexCount, int rowBegin, int rowEnd, SpanFn &&drawSpan) const;
+};
+
+} // namespace TwoHalfD
+
+#endif
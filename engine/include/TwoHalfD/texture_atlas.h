@@ -0,0 +1,52 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "TwoHalfD/types/animation_types.h"
+#include "TwoHalfD/types/entity_types.h"
+
+#include <SFML/Graphics/Glsl.hpp>
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace TwoHalfD {
+
+struct AtlasRegion {
+    int page = -1;
+    sf::IntRect pixelRect;  // where the texture sits on its page, in pixels
+    sf::Glsl::Vec4 uvRect; // the same as left, top, width, height in normalized page coordinates, for the shaders
+};
+
+// Packs the level's textures into a few large pages at load time so surfaces with different textures can be drawn without rebinding.
+// Pages do not repeat on their own: a shader wraps a texture coordinate t into its region as uvRect.xy + fract(t) * uvRect.zw. Each
+// region is surrounded by a one pixel copy of its edges so sampling right at the border stays inside the texture.
+class TextureAtlas {
+  public:
+    void build(const std::unordered_map<int, TextureSignature> &textures,
+               const std::unordered_map<int, AnimationTemplate> *animationTemplates = nullptr);
+    void clear();
+
+    const AtlasRegion *findRegion(int textureId) const;
+    const sf::Texture &getPage(int page) const {
+        return *m_pages[page];
+    }
+    size_t getPageCount() const {
+        return m_pages.size();
+    }
+
+  private:
+    static constexpr unsigned int MAX_PAGE_SIZE = 2048;
+    static constexpr unsigned int BORDER = 1;
+
+    std::vector<std::unique_ptr<sf::Texture>> m_pages; // sf::Texture cannot be moved, so pages stay put behind pointers
+    std::vector<AtlasRegion> m_regions;                 // indexed by texture id, page -1 where there is none
+
+    void _copyWithBorder(sf::Image &page, const sf::Image &image, unsigned int x, unsigned int y) const;
+};
+
+} // namespace TwoHalfD
+
+#endif
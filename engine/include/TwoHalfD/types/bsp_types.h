@@ -3,12 +3,25 @@
 
 #include "TwoHalfD/types/entity_types.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <memory>
-#include <unordered_set>
 #include <vector>
 
 namespace TwoHalfD {
 
+enum class BSPBuildMode {
+    SeedSearch, // shuffle segments with the level seed (or search for the best seed) and split on them in order
+    Heuristic,  // score sampled candidate splitters at every node, no seed involved
+};
+
+enum class BSPTraversal {
+    BackToFront, // emit everything in the view wedge far to near
+    FrontToBack, // walk near to far, dropping walls, floors and billboards hidden behind nearer walls, then emit far to near
+    Portal,      // flood through portals from the camera's leaf, then emit what was reached far to near
+};
+
 struct Segment {
     XYVectorf v1;
     XYVectorf v2;
@@ -27,21 +40,65 @@ struct Segment {
     }
 };
 
+inline constexpr uint32_t BSP_NULL_INDEX = std::numeric_limits<uint32_t>::max();
+
+// Hot per-node data, stored contiguously in BSPManager's node array and linked by index. A point p is in front of an internal
+// node's splitter when dot(normal, p) > offset. Leaves have no children and point into the leaf side table instead.
 struct BSPNode {
-    std::unique_ptr<BSPNode> front;
-    std::unique_ptr<BSPNode> back;
+    XYVectorf normal; // unit normal of the splitter, pointing to its front side
+    float offset = 0.f;
+
+    uint32_t front = BSP_NULL_INDEX;
+    uint32_t back = BSP_NULL_INDEX;
 
-    std::unordered_set<int> spriteIds;
-    std::unordered_set<int> effectIds;
+    int segmentID = -1; // splitter segment (internal nodes)
+    int leafIndex = -1; // index into the leaf table (leaves)
+
+    bool isLeaf() const {
+        return leafIndex != -1;
+    }
+
+    float signedDistance(const XYVectorf &point) const {
+        return normal.x * point.x + normal.y * point.y - offset;
+    }
+
+    bool isInfront(const XYVectorf &point) const {
+        return signedDistance(point) > 0.f;
+    }
+};
+
+// Axis-aligned box around a node's whole convex region. Everything drawn from the node's subtree (splitters, floors, overlays, sprite
+// positions) lies inside it, so it is what view culling tests. Stored beside the node array rather than in BSPNode to keep nodes small.
+struct BSPBounds {
+    XYVectorf min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    XYVectorf max{std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+    void expand(const XYVectorf &point) {
+        min = {std::min(min.x, point.x), std::min(min.y, point.y)};
+        max = {std::max(max.x, point.x), std::max(max.y, point.y)};
+    }
+    void expand(const BSPBounds &other) {
+        min = {std::min(min.x, other.min.x), std::min(min.y, other.min.y)};
+        max = {std::max(max.x, other.max.x), std::max(max.y, other.max.y)};
+    }
+};
+
+// A sprite or effect linked into a leaf, with its position kept alongside so drawing never has to look it up
+struct BSPLeafBillboard {
+    XYVectorf pos;
+    float distSquared; // to the camera as of the last frame the leaf was drawn
+    int id;
+    uint32_t handle; // BSPManager's slot for the billboard, which tracks where in which leaf it is
+    bool isEffect;
+};
+
+// Cold per-leaf data, only touched once traversal or a query has reached the leaf
+struct BSPLeaf {
+    std::vector<BSPLeafBillboard> billboards; // far to near as of the last frame the leaf was drawn
     Polygon bounds;
     std::unique_ptr<FloorSection> floorSection = nullptr;
     std::vector<FloorColourOverlay> colourOverlays;
-
-    XYVectorf splitterP0;
-    XYVectorf splitterP1;
-    XYVectorf splitterVec;
-
-    int segmentID = -1;
+    int pvsCluster = -1; // PVS row of the static leaf this one is or was split from, -1 without a PVS
 };
 
 struct DrawCommand {
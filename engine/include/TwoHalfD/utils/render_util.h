@@ -0,0 +1,51 @@
+#ifndef RENDER_UTIL_H
+#define RENDER_UTIL_H
+
+#include "TwoHalfD/engine_types.h"
+
+#include <vector>
+
+namespace TwoHalfD {
+
+inline constexpr float FLOOR_DISTANCE_CUTOFF = 3000.f; // floors are not drawn further away than this
+
+// Screen-space quad of a wall, or of the step a floor section's boundary makes, after clipping to the near plane. The v1 end is the one
+// further left on screen.
+struct ProjectedWall {
+    float x1, x2;
+    float top1, bottom1;
+    float top2, bottom2;
+    float invZ1, invZ2;   // 1 / perpendicular distance at each end
+    float ratio1, ratio2; // position along the wall at each end
+    int textureId;
+    float wallHeightStart;
+    float height;
+    float scaleX;
+    float scaleY;
+};
+
+// Screen-space placement of a sprite or effect standing at a point
+struct ProjectedBillboard {
+    float screenX; // centre
+    float top;
+    float bottom;
+    float distance; // perpendicular distance from the camera
+};
+
+// Both return false when nothing is in front of the near plane, or the wall is off screen
+bool projectSegment(const Segment &segment, const CameraObject &camera, const EngineSettings &settings, ProjectedWall &out);
+bool projectBillboard(const XYVectorf &pos, float heightStart, float height, const CameraObject &camera, const EngineSettings &settings,
+                      ProjectedBillboard &out);
+
+// Clips a floor-level polygon to the part in front of the near plane and projects it to screen space; out ends up with fewer than three
+// points when nothing is left. relativeHeight is how far the eye is above the polygon.
+void projectFloorPolygon(const Polygon &vertices, float relativeHeight, const CameraObject &camera, const EngineSettings &settings,
+                         std::vector<sf::Vector2f> &out);
+
+// Clips a screen-space polygon to the rows between minY and maxY, with scratch as working space. polygon ends up with fewer than three
+// points when nothing is left.
+void clipPolygonRows(std::vector<sf::Vector2f> &polygon, float minY, float maxY, std::vector<sf::Vector2f> &scratch);
+
+} // namespace TwoHalfD
+
+#endif
@@ -0,0 +1,348 @@
+#include "TwoHalfD/bsp/bsp_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'2', 'H', 'D', 'B', 'S', 'P', '\0', '\0'};
+
+// All records are fixed-size and written in native byte order; the header stores the record sizes so a cache written by a build
+// with a different layout is rejected instead of misread.
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSizes; // sizeof(BSPNode) | sizeof(CachedSegment) << 8 | sizeof(CachedLeaf) << 16 | sizeof(BSPGraphEdge) << 24
+    uint64_t key;
+    uint64_t wallCount;
+    uint64_t segmentCount;
+    uint64_t nodeCount;
+    uint64_t leafCount;
+    uint64_t vertexCount;
+    uint64_t graphEdgeCount;
+    uint64_t pvsClusterCount; // 0 without a PVS
+    uint64_t pvsByteCount;
+};
+
+struct CachedSegment {
+    TwoHalfD::XYVectorf v1;
+    TwoHalfD::XYVectorf v2;
+    int32_t wallIndex;      // index into BSPManager::m_walls, -1 for floor boundaries
+    int32_t floorSectionId; // key into BSPManager::m_floorSections, -1 for walls
+    float wallRatioStart;
+    float wallRatioEnd;
+};
+
+// Leaf bounds live in one shared vertex array; a leaf's floor section (if any) uses the same polygon as its bounds
+struct CachedLeaf {
+    uint32_t vertexBegin;
+    uint32_t vertexCount;
+    int32_t hasFloorSection;
+    int32_t floorSectionId;
+    int32_t floorTextureId;
+    int32_t floorIsCCW;
+    TwoHalfD::XYVectorf floorTextureStart;
+    float floorHeight;
+    // Navigation graph node for this leaf; its edges are graphEdgeBegin .. graphEdgeBegin + graphEdgeCount in the edge array
+    float graphFloorHeight;
+    TwoHalfD::XYVectorf graphCentroid;
+    uint32_t graphEdgeBegin;
+    uint32_t graphEdgeCount;
+    int32_t pvsCluster;
+};
+
+static_assert(std::is_trivially_copyable_v<TwoHalfD::BSPNode>);
+static_assert(std::is_trivially_copyable_v<TwoHalfD::BSPBounds>);
+static_assert(std::is_trivially_copyable_v<TwoHalfD::BSPGraphEdge>);
+static_assert(std::is_trivially_copyable_v<CachedSegment>);
+static_assert(std::is_trivially_copyable_v<CachedLeaf>);
+
+constexpr uint32_t recordSizes() {
+    return static_cast<uint32_t>(sizeof(TwoHalfD::BSPNode)) | static_cast<uint32_t>(sizeof(CachedSegment)) << 8 |
+           static_cast<uint32_t>(sizeof(CachedLeaf)) << 16 | static_cast<uint32_t>(sizeof(TwoHalfD::BSPGraphEdge)) << 24;
+}
+
+// Bounds-checked sequential reader over the cache file. Arrays are read straight into the vectors the manager ends up owning.
+class CacheReader {
+  public:
+    explicit CacheReader(const std::string &path) : m_file(path, std::ios::binary | std::ios::ate) {
+        if (!m_file.is_open()) return;
+        const std::streamoff size = m_file.tellg();
+        m_size = size > 0 ? static_cast<uint64_t>(size) : 0;
+        m_file.seekg(0);
+    }
+
+    bool isOpen() const {
+        return m_file.is_open();
+    }
+    uint64_t size() const {
+        return m_size;
+    }
+
+    template <typename T> bool read(T &value) {
+        return readArray(&value, 1);
+    }
+
+    template <typename T> bool readArray(T *out, uint64_t count) {
+        if (count > (m_size - m_offset) / sizeof(T)) return false;
+        const size_t bytes = static_cast<size_t>(count) * sizeof(T);
+        if (bytes > 0 && !m_file.read(reinterpret_cast<char *>(out), static_cast<std::streamsize>(bytes))) return false;
+        m_offset += bytes;
+        return true;
+    }
+
+  private:
+    std::ifstream m_file;
+    uint64_t m_size = 0;
+    uint64_t m_offset = 0;
+};
+
+template <typename T> void writeArray(std::ofstream &out, const T *data, size_t count) {
+    if (count > 0) out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i{}; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+uint64_t TwoHalfD::BSPCache::computeKey(const std::string &levelFilePath, int seed, BSPBuildMode buildMode, float defaultFloorHeight,
+                                        float eyeHeight) {
+    uint64_t hash = 14695981039346656037ull;
+
+    std::ifstream levelFile(levelFilePath, std::ios::binary);
+    char buffer[4096];
+    while (levelFile.read(buffer, sizeof(buffer)) || levelFile.gcount() > 0) {
+        hash = fnv1a(hash, buffer, static_cast<size_t>(levelFile.gcount()));
+    }
+
+    const uint32_t version = BSP_CACHE_VERSION;
+    const int32_t mode = static_cast<int32_t>(buildMode);
+    hash = fnv1a(hash, &version, sizeof(version));
+    hash = fnv1a(hash, &seed, sizeof(seed));
+    hash = fnv1a(hash, &mode, sizeof(mode));
+    hash = fnv1a(hash, &defaultFloorHeight, sizeof(defaultFloorHeight));
+    hash = fnv1a(hash, &eyeHeight, sizeof(eyeHeight));
+    return hash;
+}
+
+bool TwoHalfD::BSPCache::load(const std::string &cachePath, uint64_t key, BSPManager &bspManager) {
+    CacheReader reader(cachePath);
+    if (!reader.isOpen()) return false;
+
+    CacheHeader header;
+    if (!reader.read(header)) return false;
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != BSP_CACHE_VERSION ||
+        header.recordSizes != recordSizes() || header.key != key || header.wallCount != bspManager.m_walls.size()) {
+        return false;
+    }
+    // Check the counts against the file size before allocating anything from them
+    const uint64_t payload = reader.size() - sizeof(CacheHeader);
+    if (header.segmentCount > payload || header.nodeCount > payload || header.leafCount > payload || header.vertexCount > payload ||
+        header.graphEdgeCount > payload || header.pvsClusterCount > payload || header.pvsByteCount > payload) {
+        return false;
+    }
+    const uint64_t pvsOffsetCount = header.pvsClusterCount > 0 ? header.pvsClusterCount + 1 : 0;
+    if (header.segmentCount * sizeof(CachedSegment) + header.nodeCount * (sizeof(BSPNode) + sizeof(BSPBounds)) +
+            header.leafCount * sizeof(CachedLeaf) + header.vertexCount * sizeof(XYVectorf) + header.graphEdgeCount * sizeof(BSPGraphEdge) +
+            pvsOffsetCount * sizeof(uint32_t) + header.pvsByteCount !=
+        payload) {
+        return false;
+    }
+
+    std::vector<CachedSegment> cachedSegments(header.segmentCount);
+    std::vector<BSPNode> nodes(header.nodeCount);
+    std::vector<BSPBounds> nodeBounds(header.nodeCount);
+    std::vector<CachedLeaf> cachedLeaves(header.leafCount);
+    std::vector<XYVectorf> vertices(header.vertexCount);
+    std::vector<BSPGraphEdge> edges(header.graphEdgeCount);
+    std::vector<uint32_t> pvsRowOffsets(pvsOffsetCount);
+    std::vector<uint8_t> pvsRows(header.pvsByteCount);
+    if (!reader.readArray(cachedSegments.data(), header.segmentCount) || !reader.readArray(nodes.data(), header.nodeCount) ||
+        !reader.readArray(nodeBounds.data(), header.nodeCount) || !reader.readArray(cachedLeaves.data(), header.leafCount) ||
+        !reader.readArray(vertices.data(), header.vertexCount) ||
+        !reader.readArray(edges.data(), header.graphEdgeCount) || !reader.readArray(pvsRowOffsets.data(), pvsOffsetCount) ||
+        !reader.readArray(pvsRows.data(), header.pvsByteCount)) {
+        return false;
+    }
+    for (size_t i{}; i < pvsRowOffsets.size(); ++i) {
+        if (pvsRowOffsets[i] > pvsRows.size() || (i > 0 && pvsRowOffsets[i] < pvsRowOffsets[i - 1])) return false;
+    }
+
+    // Everything below indexes into the arrays just read, so reject the file rather than trust an out-of-range index
+    std::vector<Segment> segments;
+    segments.reserve(cachedSegments.size());
+    for (const auto &cached : cachedSegments) {
+        const Wall *wall = nullptr;
+        const FloorSection *floorSection = nullptr;
+        if (cached.wallIndex >= 0) {
+            if (static_cast<size_t>(cached.wallIndex) >= bspManager.m_walls.size()) return false;
+            wall = &bspManager.m_walls[cached.wallIndex];
+        } else {
+            auto floorIt = bspManager.m_floorSections.find(cached.floorSectionId);
+            if (floorIt == bspManager.m_floorSections.end()) return false;
+            floorSection = &floorIt->second;
+        }
+        segments.push_back({cached.v1, cached.v2, wall, floorSection, cached.wallRatioStart, cached.wallRatioEnd});
+    }
+
+    for (const auto &node : nodes) {
+        if (node.isLeaf()) {
+            if (static_cast<uint64_t>(node.leafIndex) >= header.leafCount) return false;
+        } else if (node.front >= header.nodeCount || node.back >= header.nodeCount || node.segmentID < 0 ||
+                   static_cast<uint64_t>(node.segmentID) >= header.segmentCount) {
+            return false;
+        }
+    }
+    if (nodes.empty()) return false;
+
+    std::vector<BSPLeaf> leaves(cachedLeaves.size());
+    std::vector<BSPGraphNode> graphNodes(cachedLeaves.size());
+    for (size_t i{}; i < cachedLeaves.size(); ++i) {
+        const CachedLeaf &cached = cachedLeaves[i];
+        if (cached.vertexBegin > vertices.size() || cached.vertexCount > vertices.size() - cached.vertexBegin ||
+            cached.graphEdgeBegin > edges.size() || cached.graphEdgeCount > edges.size() - cached.graphEdgeBegin) {
+            return false;
+        }
+
+        if (cached.pvsCluster < -1 || cached.pvsCluster >= static_cast<int64_t>(header.pvsClusterCount)) return false;
+
+        BSPLeaf &leaf = leaves[i];
+        leaf.pvsCluster = cached.pvsCluster;
+        leaf.bounds.assign(vertices.begin() + cached.vertexBegin, vertices.begin() + cached.vertexBegin + cached.vertexCount);
+        if (cached.hasFloorSection) {
+            leaf.floorSection = std::make_unique<FloorSection>(FloorSection{
+                leaf.bounds, cached.floorTextureStart, cached.floorSectionId, cached.floorTextureId, cached.floorHeight, cached.floorIsCCW != 0});
+        }
+
+        BSPGraphNode &graphNode = graphNodes[i];
+        graphNode.centroid = cached.graphCentroid;
+        graphNode.floorHeight = cached.graphFloorHeight;
+        graphNode.edges.assign(edges.begin() + cached.graphEdgeBegin, edges.begin() + cached.graphEdgeBegin + cached.graphEdgeCount);
+        for (const auto &edge : graphNode.edges) {
+            if (edge.targetNodeIndex < 0 || static_cast<size_t>(edge.targetNodeIndex) >= cachedLeaves.size()) return false;
+        }
+    }
+
+    bspManager.m_nodes = std::move(nodes);
+    bspManager.m_leaves = std::move(leaves);
+    bspManager.m_segments = std::move(segments);
+    bspManager.m_segmentID = bspManager.m_segments.size();
+    bspManager._clearBillboards();
+    bspManager.m_overlayLeafMap.clear();
+    bspManager._resetDynamicState();
+    bspManager.m_nodeBounds = std::move(nodeBounds);
+    bspManager._invalidateNodeCaches();
+    bspManager.m_pvs.clear();
+    bspManager.m_pvs.m_clusterCount = static_cast<int>(header.pvsClusterCount);
+    bspManager.m_pvs.m_rowOffsets = std::move(pvsRowOffsets);
+    bspManager.m_pvs.m_rows = std::move(pvsRows);
+    bspManager.m_graph.m_nodes = std::move(graphNodes);
+    for (size_t i{}; i < bspManager.m_leaves.size(); ++i) {
+        bspManager.m_graph.m_nodes[i].leaf = &bspManager.m_leaves[i];
+    }
+
+    std::cout << "Loaded BSP from cache " << cachePath << " (" << bspManager.m_nodes.size() << " nodes, " << bspManager.m_leaves.size() << " leaves)"
+              << std::endl;
+    return true;
+}
+
+bool TwoHalfD::BSPCache::save(const std::string &cachePath, uint64_t key, const BSPManager &bspManager) {
+    const auto &graphNodes = bspManager.m_graph.m_nodes;
+    const BSPPVS &pvs = bspManager.m_pvs;
+    if (graphNodes.size() != bspManager.m_leaves.size() || bspManager.m_nodeBounds.size() != bspManager.m_nodes.size()) return false;
+
+    std::vector<CachedSegment> cachedSegments;
+    cachedSegments.reserve(bspManager.m_segments.size());
+    for (const auto &segment : bspManager.m_segments) {
+        const int32_t wallIndex = segment.isWall() ? static_cast<int32_t>(segment.wall - bspManager.m_walls.data()) : -1;
+        const int32_t floorSectionId = segment.isFloorBoundary() ? segment.floorSection->id : -1;
+        cachedSegments.push_back({segment.v1, segment.v2, wallIndex, floorSectionId, segment.wallRatioStart, segment.wallRatioEnd});
+    }
+
+    std::vector<CachedLeaf> cachedLeaves;
+    std::vector<XYVectorf> vertices;
+    std::vector<BSPGraphEdge> edges;
+    cachedLeaves.reserve(bspManager.m_leaves.size());
+    for (size_t i{}; i < bspManager.m_leaves.size(); ++i) {
+        const BSPLeaf &leaf = bspManager.m_leaves[i];
+        const BSPGraphNode &graphNode = graphNodes[i];
+
+        CachedLeaf cached{};
+        cached.vertexBegin = static_cast<uint32_t>(vertices.size());
+        cached.vertexCount = static_cast<uint32_t>(leaf.bounds.size());
+        vertices.insert(vertices.end(), leaf.bounds.begin(), leaf.bounds.end());
+        if (leaf.floorSection != nullptr) {
+            cached.hasFloorSection = 1;
+            cached.floorSectionId = leaf.floorSection->id;
+            cached.floorTextureId = leaf.floorSection->textureId;
+            cached.floorIsCCW = leaf.floorSection->isCCW ? 1 : 0;
+            cached.floorTextureStart = leaf.floorSection->floorTextureStart;
+            cached.floorHeight = leaf.floorSection->height;
+        }
+        cached.graphFloorHeight = graphNode.floorHeight;
+        cached.graphCentroid = graphNode.centroid;
+        cached.graphEdgeBegin = static_cast<uint32_t>(edges.size());
+        cached.graphEdgeCount = static_cast<uint32_t>(graphNode.edges.size());
+        cached.pvsCluster = leaf.pvsCluster;
+        edges.insert(edges.end(), graphNode.edges.begin(), graphNode.edges.end());
+        cachedLeaves.push_back(cached);
+    }
+
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = BSP_CACHE_VERSION;
+    header.recordSizes = recordSizes();
+    header.key = key;
+    header.wallCount = bspManager.m_walls.size();
+    header.segmentCount = cachedSegments.size();
+    header.nodeCount = bspManager.m_nodes.size();
+    header.leafCount = cachedLeaves.size();
+    header.vertexCount = vertices.size();
+    header.graphEdgeCount = edges.size();
+    header.pvsClusterCount = static_cast<uint64_t>(pvs.m_clusterCount);
+    header.pvsByteCount = pvs.m_rows.size();
+
+    // Write to a temporary file and rename it into place so a crash mid-write never leaves a truncated cache behind
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Could not write BSP cache " << cachePath << std::endl;
+            return false;
+        }
+        writeArray(out, &header, 1);
+        writeArray(out, cachedSegments.data(), cachedSegments.size());
+        writeArray(out, bspManager.m_nodes.data(), bspManager.m_nodes.size());
+        writeArray(out, bspManager.m_nodeBounds.data(), bspManager.m_nodeBounds.size());
+        writeArray(out, cachedLeaves.data(), cachedLeaves.size());
+        writeArray(out, vertices.data(), vertices.size());
+        writeArray(out, edges.data(), edges.size());
+        writeArray(out, pvs.m_rowOffsets.data(), pvs.m_rowOffsets.size());
+        writeArray(out, pvs.m_rows.data(), pvs.m_rows.size());
+        out.close(); // flushes, so a failed final write shows up below too
+        if (!out.good()) {
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
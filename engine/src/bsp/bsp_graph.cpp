@@ -1,4 +1,5 @@
 #include "TwoHalfD/bsp/bsp_graph.h"
+#include "TwoHalfD/bsp/bsp_lines.h"
 #include "TwoHalfD/utils/math_util.h"
 
 #include <algorithm>
@@ -10,11 +11,147 @@ namespace {
 constexpr float BSP_EPSILON = 0.01f;
 } // namespace
 
-void TwoHalfD::BSPGraph::build(BSPNode *root, const std::vector<Segment> &segments, float defaultFloorHeight) {
+void TwoHalfD::BSPGraph::build(const std::vector<BSPNode> &bspNodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                               const std::vector<BSPBounds> &nodeBounds, float defaultFloorHeight) {
     m_nodes.clear();
-    m_nodeIndexMap.clear();
-    _collectLeaves(root, defaultFloorHeight);
-    _processInternalNode(root, segments);
+    _collectLeaves(leaves, defaultFloorHeight);
+    if (bspNodes.empty()) return;
+
+    // Leaves are paired across each splitter by collectSplitterLine and any wall on the line closes the stretch it covers. The walk goes
+    // down from the root, front first, since the node array may hold nodes freed by dynamic walls.
+    SplitterLine splitterLine;
+    std::vector<LineSegment> walls;
+    std::vector<std::pair<float, float>> openings;
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        const BSPNode &node = bspNodes[nodeIndex];
+        if (node.isLeaf()) continue;
+        if (node.back != BSP_NULL_INDEX) stack.push_back(node.back);
+        if (node.front != BSP_NULL_INDEX) stack.push_back(node.front);
+        if (!collectSplitterLine(bspNodes, leaves, segments, nodeBounds, nodeIndex, splitterLine)) continue;
+
+        walls.clear();
+        for (const LineSegment &lineSegment : splitterLine.segments) {
+            if (segments[lineSegment.segmentID].isWall()) walls.push_back(lineSegment);
+        }
+        for (const LineOverlap &overlap : splitterLine.overlaps) {
+            openStretches(walls, overlap.tMin, overlap.tMax, openings);
+            _addEdges(overlap.frontLeaf, overlap.backLeaf, splitterLine.line.p0, splitterLine.line.dir, openings);
+        }
+    }
+}
+
+void TwoHalfD::BSPGraph::relinkLeaves(const std::vector<BSPNode> &bspNodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                                      const std::vector<BSPBounds> &nodeBounds, const std::vector<int> &changedLeaves, float defaultFloorHeight) {
+    // Nodes are added for leaves appended to the BSP's leaf vector. The older nodes' leaf pointers only go stale if it reallocated.
+    const size_t oldNodeCount = m_nodes.size();
+    const bool leavesMoved = oldNodeCount > 0 && m_nodes[0].leaf != &leaves[0];
+    m_nodes.resize(leaves.size());
+    for (size_t i = leavesMoved ? 0 : oldNodeCount; i < leaves.size(); ++i) {
+        m_nodes[i].leaf = &leaves[i];
+    }
+
+    std::vector<int> changed = changedLeaves;
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    auto isChanged = [&](int leafIndex) { return std::binary_search(changed.begin(), changed.end(), leafIndex); };
+
+    // Edges into the changed leaves are dropped from the leaves on their far side; doors on them are remembered
+    struct DoorPortal {
+        int neighbour;
+        XYVectorf edgeStart;
+        XYVectorf edgeEnd;
+        int doorId;
+    };
+    std::vector<int> oldNeighbours;
+    std::vector<DoorPortal> doors;
+    for (int leafIndex : changed) {
+        for (const auto &edge : m_nodes[leafIndex].edges) {
+            if (isChanged(edge.targetNodeIndex)) continue;
+            oldNeighbours.push_back(edge.targetNodeIndex);
+            if (edge.doorId != -1) doors.push_back({edge.targetNodeIndex, edge.edgeStart, edge.edgeEnd, edge.doorId});
+        }
+        m_nodes[leafIndex].edges.clear();
+    }
+    std::sort(oldNeighbours.begin(), oldNeighbours.end());
+    oldNeighbours.erase(std::unique(oldNeighbours.begin(), oldNeighbours.end()), oldNeighbours.end());
+    for (int neighbour : oldNeighbours) {
+        std::erase_if(m_nodes[neighbour].edges, [&](const BSPGraphEdge &edge) { return isChanged(edge.targetNodeIndex); });
+    }
+
+    for (int leafIndex : changed) {
+        _computeNodeShape(m_nodes[leafIndex], defaultFloorHeight);
+    }
+
+    // New neighbours are found from the leaves' shapes, not only from the old edges: a wall taken off a portal's line opens the leaf up
+    // to leaves it had no edge to while the wall stood. Candidates are the old neighbours plus the leaves the node boxes put next to the
+    // changed area.
+    auto boxOf = [](const Polygon &bounds) {
+        BSPBounds box;
+        for (const auto &vertex : bounds) {
+            box.expand(vertex);
+        }
+        return box;
+    };
+    auto touches = [](const BSPBounds &a, const BSPBounds &b) {
+        return a.min.x <= b.max.x + BSP_EPSILON && b.min.x <= a.max.x + BSP_EPSILON && a.min.y <= b.max.y + BSP_EPSILON &&
+               b.min.y <= a.max.y + BSP_EPSILON;
+    };
+    std::vector<BSPBounds> changedBoxes;
+    BSPBounds changedArea;
+    for (int leafIndex : changed) {
+        changedBoxes.push_back(boxOf(leaves[leafIndex].bounds));
+        if (hasArea(leaves[leafIndex].bounds)) changedArea.expand(changedBoxes.back());
+    }
+    std::vector<int> candidates = oldNeighbours;
+    std::vector<uint32_t> stack;
+    if (!bspNodes.empty()) stack.push_back(0);
+    while (!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        if (!touches(nodeBounds[nodeIndex], changedArea)) continue;
+        const BSPNode &node = bspNodes[nodeIndex];
+        if (node.isLeaf()) {
+            if (!isChanged(node.leafIndex)) candidates.push_back(node.leafIndex);
+            continue;
+        }
+        if (node.front != BSP_NULL_INDEX) stack.push_back(node.front);
+        if (node.back != BSP_NULL_INDEX) stack.push_back(node.back);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for (int other : candidates) {
+        if (!hasArea(leaves[other].bounds)) continue;
+        const BSPBounds otherBox = boxOf(leaves[other].bounds);
+        for (size_t i{}; i < changed.size(); ++i) {
+            if (touches(otherBox, changedBoxes[i])) _linkAdjacentLeaves(changed[i], other, bspNodes, leaves, segments, nodeBounds);
+        }
+    }
+    for (size_t i{}; i < changed.size(); ++i) {
+        for (size_t j = i + 1; j < changed.size(); ++j) {
+            _linkAdjacentLeaves(changed[i], changed[j], bspNodes, leaves, segments, nodeBounds);
+        }
+    }
+
+    // A door survives if the portal it sat on still exists, even if the leaf on the changed side was split
+    for (const auto &door : doors) {
+        const XYVectorf doorDir = door.edgeEnd - door.edgeStart;
+        const float doorLength = doorDir.length();
+        if (doorLength < BSP_EPSILON) continue;
+        for (int leafIndex : changed) {
+            for (const auto &edge : m_nodes[leafIndex].edges) {
+                if (edge.targetNodeIndex != door.neighbour) continue;
+                const XYVectorf toMid = edge.portalMidpoint - door.edgeStart;
+                const float t = dotProduct(toMid, doorDir) / (doorLength * doorLength);
+                if (std::abs(crossProduct2d(doorDir, toMid)) / doorLength < BSP_EPSILON && t >= 0.f && t <= 1.f) {
+                    setDoor(leafIndex, door.neighbour, door.doorId);
+                }
+            }
+        }
+    }
 }
 
 void TwoHalfD::BSPGraph::setDoor(int nodeA, int nodeB, int doorId) {
@@ -26,39 +163,70 @@ void TwoHalfD::BSPGraph::setDoor(int nodeA, int nodeB, int doorId) {
     }
 }
 
+bool TwoHalfD::BSPGraph::hasSameEdges(const BSPGraph &other, float tolerance) const {
+    if (m_nodes.size() != other.m_nodes.size()) return false;
+
+    // Per node: every neighbour with the total width of the portals to it, in neighbour order
+    auto widthsByNeighbour = [](const BSPGraphNode &node) {
+        std::vector<std::pair<int, float>> widths;
+        for (const auto &edge : node.edges) {
+            widths.push_back({edge.targetNodeIndex, edge.portalWidth});
+        }
+        std::sort(widths.begin(), widths.end());
+        std::vector<std::pair<int, float>> merged;
+        for (const auto &[neighbour, width] : widths) {
+            if (!merged.empty() && merged.back().first == neighbour) {
+                merged.back().second += width;
+            } else {
+                merged.push_back({neighbour, width});
+            }
+        }
+        return merged;
+    };
+    for (size_t i{}; i < m_nodes.size(); ++i) {
+        const auto ours = widthsByNeighbour(m_nodes[i]);
+        const auto theirs = widthsByNeighbour(other.m_nodes[i]);
+        if (ours.size() != theirs.size()) return false;
+        for (size_t j{}; j < ours.size(); ++j) {
+            if (ours[j].first != theirs[j].first || std::abs(ours[j].second - theirs[j].second) > tolerance) return false;
+        }
+    }
+    return true;
+}
+
 int TwoHalfD::BSPGraph::findNodeForPoint(const XYVectorf &point) const {
     for (int i{}; i < static_cast<int>(m_nodes.size()); ++i) {
-        const Polygon &bounds = m_nodes[i].bspNode->bounds;
+        const Polygon &bounds = m_nodes[i].leaf->bounds;
         int n = static_cast<int>(bounds.size());
         if (n < 3) continue;
 
+        // A collapsed leaf has a zero cross product on every edge and would otherwise claim every point
         float firstSign = 0.f;
         bool inside = true;
         for (int j{}; j < n; ++j) {
             XYVectorf edge = bounds[(j + 1) % n] - bounds[j];
             XYVectorf toPoint = point - bounds[j];
             float cross = crossProduct2d(edge, toPoint);
-            if (j == 0) {
-                firstSign = (cross >= 0.f) ? 1.f : -1.f;
-            } else if (cross != 0.f && ((cross > 0.f) ? 1.f : -1.f) != firstSign) {
+            if (cross == 0.f) continue;
+            if (firstSign == 0.f) {
+                firstSign = (cross > 0.f) ? 1.f : -1.f;
+            } else if (((cross > 0.f) ? 1.f : -1.f) != firstSign) {
                 inside = false;
                 break;
             }
         }
-        if (inside) return i;
+        if (inside && firstSign != 0.f) return i;
     }
     return -1;
 }
 
-int TwoHalfD::BSPGraph::getNodeIndex(const BSPNode *node) const {
-    auto it = m_nodeIndexMap.find(node);
-    return (it != m_nodeIndexMap.end()) ? it->second : -1;
-}
-
 std::vector<TwoHalfD::XYVectorf> TwoHalfD::BSPGraph::findPath(const XYVectorf &start, const XYVectorf &end, float entityWidth, float maxHeightDiff,
                                                               float maxStepDown, float maxDistance) const {
-    int startNode = findNodeForPoint(start);
-    int endNode = findNodeForPoint(end);
+    return findPath(findNodeForPoint(start), findNodeForPoint(end), start, end, entityWidth, maxHeightDiff, maxStepDown, maxDistance);
+}
+
+std::vector<TwoHalfD::XYVectorf> TwoHalfD::BSPGraph::findPath(int startNode, int endNode, const XYVectorf &start, const XYVectorf &end,
+                                                              float entityWidth, float maxHeightDiff, float maxStepDown, float maxDistance) const {
     if (startNode == -1 || endNode == -1) return {};
     if (startNode == endNode) return {start, end};
 
@@ -117,148 +285,81 @@ std::vector<TwoHalfD::XYVectorf> TwoHalfD::BSPGraph::findPath(const XYVectorf &s
     return {};
 }
 
-void TwoHalfD::BSPGraph::_collectLeaves(BSPNode *node, float defaultFloorHeight) {
-    if (node == nullptr) return;
-
-    if (node->front == nullptr && node->back == nullptr) {
+void TwoHalfD::BSPGraph::_collectLeaves(const std::vector<BSPLeaf> &leaves, float defaultFloorHeight) {
+    m_nodes.reserve(leaves.size());
+    for (const auto &leaf : leaves) {
         BSPGraphNode graphNode;
-        graphNode.bspNode = node;
-
-        XYVectorf centroid{0.f, 0.f};
-        for (const auto &v : node->bounds) {
-            centroid.x += v.x;
-            centroid.y += v.y;
-        }
-        if (!node->bounds.empty()) {
-            float inv = 1.f / static_cast<float>(node->bounds.size());
-            centroid.x *= inv;
-            centroid.y *= inv;
-        }
-        graphNode.centroid = centroid;
-        graphNode.floorHeight = (node->floorSection != nullptr) ? node->floorSection->height : defaultFloorHeight;
-
-        int index = static_cast<int>(m_nodes.size());
-        m_nodeIndexMap[node] = index;
+        graphNode.leaf = &leaf;
+        _computeNodeShape(graphNode, defaultFloorHeight);
         m_nodes.push_back(std::move(graphNode));
-        return;
     }
-
-    _collectLeaves(node->front.get(), defaultFloorHeight);
-    _collectLeaves(node->back.get(), defaultFloorHeight);
 }
 
-void TwoHalfD::BSPGraph::_collectLeavesTouchingSplitter(BSPNode *node, const XYVectorf &splitterP0, const XYVectorf &splitterDir,
-                                                        std::vector<std::pair<int, std::pair<float, float>>> &result) {
-    if (node == nullptr) return;
-
-    if (node->front == nullptr && node->back == nullptr) {
-        const Polygon &bounds = node->bounds;
-        int n = static_cast<int>(bounds.size());
-        for (int i{}; i < n; ++i) {
-            const XYVectorf &v1 = bounds[i];
-            const XYVectorf &v2 = bounds[(i + 1) % n];
-
-            float d1 = std::abs(crossProduct2d(v1 - splitterP0, splitterDir));
-            float d2 = std::abs(crossProduct2d(v2 - splitterP0, splitterDir));
-
-            if (d1 < BSP_EPSILON && d2 < BSP_EPSILON) {
-                float t1 = dotProduct(v1 - splitterP0, splitterDir);
-                float t2 = dotProduct(v2 - splitterP0, splitterDir);
-                float tMin = std::min(t1, t2);
-                float tMax = std::max(t1, t2);
-
-                if (tMax - tMin > BSP_EPSILON) {
-                    auto it = m_nodeIndexMap.find(node);
-                    if (it != m_nodeIndexMap.end()) {
-                        result.push_back({it->second, {tMin, tMax}});
-                    }
-                }
-                break;
-            }
-        }
-        return;
-    }
-
-    _collectLeavesTouchingSplitter(node->front.get(), splitterP0, splitterDir, result);
-    _collectLeavesTouchingSplitter(node->back.get(), splitterP0, splitterDir, result);
-}
-
-std::vector<std::pair<float, float>> TwoHalfD::BSPGraph::_getUnblockedIntervals(float tA, float tB, const XYVectorf &splitterP0,
-                                                                                const XYVectorf &splitterDir, const std::vector<Segment> &segments) {
-    if (tA > tB) std::swap(tA, tB);
-
-    std::vector<std::pair<float, float>> wallIntervals;
-
-    for (const auto &seg : segments) {
-        if (!seg.isWall()) continue;
-
-        float d1 = std::abs(crossProduct2d(seg.v1 - splitterP0, splitterDir));
-        float d2 = std::abs(crossProduct2d(seg.v2 - splitterP0, splitterDir));
-        if (d1 > BSP_EPSILON || d2 > BSP_EPSILON) continue;
-
-        float tw1 = dotProduct(seg.v1 - splitterP0, splitterDir);
-        float tw2 = dotProduct(seg.v2 - splitterP0, splitterDir);
-        if (tw1 > tw2) std::swap(tw1, tw2);
-
-        if (tw2 <= tA + BSP_EPSILON || tw1 >= tB - BSP_EPSILON) continue;
-
-        wallIntervals.push_back({std::max(tw1, tA), std::min(tw2, tB)});
+void TwoHalfD::BSPGraph::_computeNodeShape(BSPGraphNode &graphNode, float defaultFloorHeight) {
+    const BSPLeaf &leaf = *graphNode.leaf;
+    XYVectorf centroid{0.f, 0.f};
+    for (const auto &v : leaf.bounds) {
+        centroid.x += v.x;
+        centroid.y += v.y;
     }
-
-    std::sort(wallIntervals.begin(), wallIntervals.end());
-
-    std::vector<std::pair<float, float>> unblocked;
-    float cursor = tA;
-    for (const auto &[wStart, wEnd] : wallIntervals) {
-        if (wStart > cursor + BSP_EPSILON) unblocked.push_back({cursor, wStart});
-        cursor = std::max(cursor, wEnd);
-        if (cursor >= tB - BSP_EPSILON) break;
+    if (!leaf.bounds.empty()) {
+        float inv = 1.f / static_cast<float>(leaf.bounds.size());
+        centroid.x *= inv;
+        centroid.y *= inv;
     }
-    if (cursor < tB - BSP_EPSILON) unblocked.push_back({cursor, tB});
-
-    return unblocked;
+    graphNode.centroid = centroid;
+    graphNode.floorHeight = (leaf.floorSection != nullptr) ? leaf.floorSection->height : defaultFloorHeight;
 }
 
-void TwoHalfD::BSPGraph::_processInternalNode(BSPNode *node, const std::vector<Segment> &segments) {
-    if (node == nullptr) return;
-    if (node->front == nullptr && node->back == nullptr) return;
-
-    XYVectorf splitterDir = node->splitterVec.normalized();
-    if (splitterDir.length() < 1e-6f) {
-        _processInternalNode(node->front.get(), segments);
-        _processInternalNode(node->back.get(), segments);
+// Two convex leaves are adjacent when they have boundary edges on a common line whose extents overlap. The shared stretch is then
+// opened up exactly like a splitter's in build, minus any walls lying on it.
+void TwoHalfD::BSPGraph::_linkAdjacentLeaves(int nodeA, int nodeB, const std::vector<BSPNode> &bspNodes, const std::vector<BSPLeaf> &leaves,
+                                             const std::vector<Segment> &segments, const std::vector<BSPBounds> &nodeBounds) {
+    const Polygon &boundsA = m_nodes[nodeA].leaf->bounds;
+    const Polygon &boundsB = m_nodes[nodeB].leaf->bounds;
+    if (!hasArea(boundsA) || !hasArea(boundsB)) return;
+
+    // The line is taken from either leaf's edges: a short edge left by a split points a little off, enough for the far end of a long edge
+    // on the same line to miss it, so the other leaf's edges get their turn too
+    const int nA = static_cast<int>(boundsA.size());
+    const int n = nA + static_cast<int>(boundsB.size());
+    for (int i{}; i < n; ++i) {
+        const Polygon &edgeBounds = i < nA ? boundsA : boundsB;
+        const int j = i < nA ? i : i - nA;
+        const BSPLine line{edgeBounds[j], (edgeBounds[(j + 1) % edgeBounds.size()] - edgeBounds[j]).normalized()};
+        if (line.dir.length() < 1e-6f) continue;
+
+        float tMinA, tMaxA, tMinB, tMaxB;
+        if (!extentOnLine(boundsB, line, tMinB, tMaxB)) continue;
+        if (!extentOnLine(boundsA, line, tMinA, tMaxA)) continue;
+
+        const float overlapStart = std::max(tMinA, tMinB);
+        const float overlapEnd = std::min(tMaxA, tMaxB);
+        if (overlapEnd - overlapStart <= BSP_EPSILON) continue;
+
+        // Walls on the line are splitters somewhere in the tree; only subtrees whose box reaches the shared stretch are searched
+        std::vector<LineSegment> walls;
+        collectOnLine(bspNodes, leaves, segments, nodeBounds, 0, {line.p0, line.dir, overlapStart, overlapEnd}, nullptr, &walls);
+        std::erase_if(walls, [&](const LineSegment &lineSegment) { return !segments[lineSegment.segmentID].isWall(); });
+        std::sort(walls.begin(), walls.end(), [](const LineSegment &a, const LineSegment &b) { return a.tMin < b.tMin; });
+        std::vector<std::pair<float, float>> openings;
+        openStretches(walls, overlapStart, overlapEnd, openings);
+        _addEdges(nodeA, nodeB, line.p0, line.dir, openings);
+        // Two convex polygons with disjoint interiors share at most one boundary line
         return;
     }
+}
 
-    std::vector<std::pair<int, std::pair<float, float>>> frontLeaves, backLeaves;
-    _collectLeavesTouchingSplitter(node->front.get(), node->splitterP0, splitterDir, frontLeaves);
-    _collectLeavesTouchingSplitter(node->back.get(), node->splitterP0, splitterDir, backLeaves);
-
-    for (const auto &[frontIdx, frontInterval] : frontLeaves) {
-        for (const auto &[backIdx, backInterval] : backLeaves) {
-            float overlapStart = std::max(frontInterval.first, backInterval.first);
-            float overlapEnd = std::min(frontInterval.second, backInterval.second);
-
-            if (overlapEnd - overlapStart <= BSP_EPSILON) continue;
-
-            auto openings = _getUnblockedIntervals(overlapStart, overlapEnd, node->splitterP0, splitterDir, segments);
-
-            float heightA = m_nodes[frontIdx].floorHeight;
-            float heightB = m_nodes[backIdx].floorHeight;
-            float heightDiff = heightA - heightB;
-
-            for (const auto &[a, b] : openings) {
-                XYVectorf edgeStart = node->splitterP0 + splitterDir * a;
-                XYVectorf edgeEnd = node->splitterP0 + splitterDir * b;
-                XYVectorf mid = {(edgeStart.x + edgeEnd.x) * 0.5f, (edgeStart.y + edgeEnd.y) * 0.5f};
-
-                float portalWidth = b - a;
-                m_nodes[frontIdx].edges.push_back({backIdx, edgeStart, edgeEnd, portalWidth, heightDiff, mid});
-                m_nodes[backIdx].edges.push_back({frontIdx, edgeStart, edgeEnd, portalWidth, -heightDiff, mid});
-            }
-        }
+void TwoHalfD::BSPGraph::_addEdges(int nodeA, int nodeB, const XYVectorf &lineP0, const XYVectorf &lineDir,
+                                   const std::vector<std::pair<float, float>> &openings) {
+    const float heightDiff = m_nodes[nodeA].floorHeight - m_nodes[nodeB].floorHeight;
+    for (const auto &[a, b] : openings) {
+        XYVectorf edgeStart = lineP0 + lineDir * a;
+        XYVectorf edgeEnd = lineP0 + lineDir * b;
+        XYVectorf mid = {(edgeStart.x + edgeEnd.x) * 0.5f, (edgeStart.y + edgeEnd.y) * 0.5f};
+
+        float portalWidth = b - a;
+        m_nodes[nodeA].edges.push_back({nodeB, edgeStart, edgeEnd, portalWidth, heightDiff, mid});
+        m_nodes[nodeB].edges.push_back({nodeA, edgeStart, edgeEnd, portalWidth, -heightDiff, mid});
     }
-
-    _processInternalNode(node->front.get(), segments);
-    _processInternalNode(node->back.get(), segments);
 }
@@ -0,0 +1,126 @@
+#include "TwoHalfD/bsp/bsp_lines.h"
+#include "TwoHalfD/utils/math_util.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr float LINE_EPSILON = 0.01f;
+
+bool onLine(const TwoHalfD::XYVectorf &point, const TwoHalfD::BSPLine &line) {
+    return std::abs(crossProduct2d(point - line.p0, line.dir)) < LINE_EPSILON;
+}
+
+// Whether the box straddles the line somewhere within its looked-at stretch
+bool boxMeetsLine(const TwoHalfD::BSPBounds &bounds, const TwoHalfD::BSPLine &line) {
+    const TwoHalfD::XYVectorf corners[4] = {bounds.min, {bounds.max.x, bounds.min.y}, bounds.max, {bounds.min.x, bounds.max.y}};
+    bool anyAbove = false;
+    bool anyBelow = false;
+    float tMin = std::numeric_limits<float>::max();
+    float tMax = std::numeric_limits<float>::lowest();
+    for (const TwoHalfD::XYVectorf &corner : corners) {
+        const float distance = crossProduct2d(corner - line.p0, line.dir);
+        anyAbove = anyAbove || distance > -LINE_EPSILON;
+        anyBelow = anyBelow || distance < LINE_EPSILON;
+        const float t = dotProduct(corner - line.p0, line.dir);
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    return anyAbove && anyBelow && tMax >= line.tMin - LINE_EPSILON && tMin <= line.tMax + LINE_EPSILON;
+}
+} // namespace
+
+bool TwoHalfD::hasArea(const Polygon &bounds) {
+    float doubleArea = 0.f;
+    for (size_t i{}, j = bounds.size() - 1; i < bounds.size(); j = i++) {
+        doubleArea += crossProduct2d(bounds[j], bounds[i]);
+    }
+    return bounds.size() >= 3 && std::abs(doubleArea) > LINE_EPSILON;
+}
+
+bool TwoHalfD::extentOnLine(const Polygon &bounds, const BSPLine &line, float &tMin, float &tMax) {
+    const int n = static_cast<int>(bounds.size());
+    tMin = std::numeric_limits<float>::max();
+    tMax = std::numeric_limits<float>::lowest();
+    for (int i{}; i < n; ++i) {
+        const XYVectorf &v1 = bounds[i];
+        const XYVectorf &v2 = bounds[(i + 1) % n];
+        if (!onLine(v1, line) || !onLine(v2, line)) continue;
+        const float t1 = dotProduct(v1 - line.p0, line.dir);
+        const float t2 = dotProduct(v2 - line.p0, line.dir);
+        tMin = std::min({tMin, t1, t2});
+        tMax = std::max({tMax, t1, t2});
+    }
+    return tMax - tMin > LINE_EPSILON;
+}
+
+void TwoHalfD::collectOnLine(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                             const std::vector<BSPBounds> &nodeBounds, uint32_t nodeIndex, const BSPLine &line, std::vector<LineTouch> *touches,
+                             std::vector<LineSegment> *lineSegments) {
+    if (nodeIndex == BSP_NULL_INDEX || !boxMeetsLine(nodeBounds[nodeIndex], line)) return;
+
+    const BSPNode &node = nodes[nodeIndex];
+    if (node.isLeaf()) {
+        const Polygon &bounds = leaves[node.leafIndex].bounds;
+        float tMin, tMax;
+        if (touches != nullptr && hasArea(bounds) && extentOnLine(bounds, line, tMin, tMax)) touches->push_back({node.leafIndex, tMin, tMax});
+        return;
+    }
+
+    const Segment &splitter = segments[node.segmentID];
+    if (lineSegments != nullptr && onLine(splitter.v1, line) && onLine(splitter.v2, line)) {
+        const float t1 = dotProduct(splitter.v1 - line.p0, line.dir);
+        const float t2 = dotProduct(splitter.v2 - line.p0, line.dir);
+        lineSegments->push_back({node.segmentID, std::min(t1, t2), std::max(t1, t2)});
+    }
+    collectOnLine(nodes, leaves, segments, nodeBounds, node.front, line, touches, lineSegments);
+    collectOnLine(nodes, leaves, segments, nodeBounds, node.back, line, touches, lineSegments);
+}
+
+bool TwoHalfD::collectSplitterLine(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                                   const std::vector<BSPBounds> &nodeBounds, uint32_t nodeIndex, SplitterLine &out, const BSPBounds *within) {
+    const BSPNode &node = nodes[nodeIndex];
+    const Segment &splitter = segments[node.segmentID];
+    out.line = {splitter.v1, (splitter.v2 - splitter.v1).normalized()};
+    if (out.line.dir.length() < 1e-6f) return false;
+    if (within != nullptr) {
+        out.line.tMin = std::numeric_limits<float>::max();
+        out.line.tMax = std::numeric_limits<float>::lowest();
+        for (const XYVectorf &corner : {within->min, XYVectorf{within->max.x, within->min.y}, within->max, XYVectorf{within->min.x, within->max.y}}) {
+            const float t = dotProduct(corner - out.line.p0, out.line.dir);
+            out.line.tMin = std::min(out.line.tMin, t);
+            out.line.tMax = std::max(out.line.tMax, t);
+        }
+    }
+
+    out.frontTouches.clear();
+    out.backTouches.clear();
+    out.overlaps.clear();
+    out.segments.clear();
+    out.segments.push_back({node.segmentID, 0.f, dotProduct(splitter.v2 - splitter.v1, out.line.dir)});
+    collectOnLine(nodes, leaves, segments, nodeBounds, node.front, out.line, &out.frontTouches, &out.segments);
+    collectOnLine(nodes, leaves, segments, nodeBounds, node.back, out.line, &out.backTouches, &out.segments);
+    std::sort(out.segments.begin(), out.segments.end(), [](const LineSegment &a, const LineSegment &b) { return a.tMin < b.tMin; });
+
+    for (const LineTouch &front : out.frontTouches) {
+        for (const LineTouch &back : out.backTouches) {
+            const float overlapStart = std::max(front.tMin, back.tMin);
+            const float overlapEnd = std::min(front.tMax, back.tMax);
+            if (overlapEnd - overlapStart > LINE_EPSILON) out.overlaps.push_back({front.leaf, back.leaf, overlapStart, overlapEnd});
+        }
+    }
+    return true;
+}
+
+void TwoHalfD::openStretches(const std::vector<LineSegment> &blockers, float tMin, float tMax, std::vector<std::pair<float, float>> &out) {
+    out.clear();
+    float cursor = tMin;
+    for (const LineSegment &blocker : blockers) {
+        if (blocker.tMax <= cursor + LINE_EPSILON) continue;
+        if (blocker.tMin >= tMax - LINE_EPSILON) break;
+        if (blocker.tMin > cursor + LINE_EPSILON) out.push_back({cursor, blocker.tMin});
+        cursor = std::max(cursor, blocker.tMax);
+        if (cursor >= tMax - LINE_EPSILON) break;
+    }
+    if (cursor < tMax - LINE_EPSILON) out.push_back({cursor, tMax});
+}
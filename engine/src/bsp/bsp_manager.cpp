@@ -3,16 +3,141 @@
 #include "TwoHalfD/utils/math_util.h"
 #include <SFML/Window/Cursor.hpp>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <memory>
-#include <queue>
+#include <numbers>
+#include <numeric>
 #include <random>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+// SSE2 is part of every x86-64 target, so no compiler flags are needed for it
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TWOHALFD_SSE2
+#endif
+
+namespace {
+// Lock-free [begin, end) range of seed offsets packed into one 64-bit word. The owning worker pops from the front while idle
+// workers steal the back half, so no worker sits idle while another still has a long tail of seeds queued.
+class SeedRange {
+  public:
+    void reset(uint32_t begin, uint32_t end) {
+        m_range.store(_pack(begin, end), std::memory_order_release);
+    }
+
+    bool pop(uint32_t &seedOffset) {
+        uint64_t current = m_range.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t begin = _begin(current), end = _end(current);
+            if (begin >= end) return false;
+            if (m_range.compare_exchange_weak(current, _pack(begin + 1, end), std::memory_order_acq_rel)) {
+                seedOffset = begin;
+                return true;
+            }
+        }
+    }
+
+    bool steal(uint32_t &stolenBegin, uint32_t &stolenEnd) {
+        uint64_t current = m_range.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t begin = _begin(current), end = _end(current);
+            if (begin >= end) return false;
+            uint32_t mid = begin + (end - begin) / 2;
+            if (m_range.compare_exchange_weak(current, _pack(begin, mid), std::memory_order_acq_rel)) {
+                stolenBegin = mid;
+                stolenEnd = end;
+                return true;
+            }
+        }
+    }
+
+  private:
+    std::atomic<uint64_t> m_range{0};
+
+    static uint64_t _pack(uint32_t begin, uint32_t end) {
+        return (static_cast<uint64_t>(begin) << 32) | end;
+    }
+    static uint32_t _begin(uint64_t range) {
+        return static_cast<uint32_t>(range >> 32);
+    }
+    static uint32_t _end(uint64_t range) {
+        return static_cast<uint32_t>(range);
+    }
+};
+
+enum class SegmentSide {
+    Front,
+    Back,
+    Spanning,
+};
+
+// Shared by _splitSpace and the heuristic splitter scoring so both agree on where a segment ends up. Colinear segments go to the
+// front, matching the original split rules.
+SegmentSide classifySegment(const TwoHalfD::Segment &segment, const TwoHalfD::XYVectorf &splitterP0, const TwoHalfD::XYVectorf &splitterVec,
+                            float &numerator, float &intersection) {
+    TwoHalfD::XYVectorf segmentVector = vectorBetweenPoints(segment.v1, segment.v2);
+    numerator = crossProduct2d(segment.v1 - splitterP0, splitterVec);
+    float denominator = crossProduct2d(splitterVec, segmentVector);
+
+    bool denominatorIsZero = std::abs(denominator) < TwoHalfD::BSP_EPSILON;
+    bool numeratorIsZero = std::abs(numerator) < TwoHalfD::BSP_EPSILON;
+
+    if (denominatorIsZero && numeratorIsZero) {
+        return SegmentSide::Front;
+    }
+
+    if (!denominatorIsZero) {
+        intersection = numerator / denominator;
+        if (intersection > 0.0f && intersection < 1.0f && (segment.isWall() || segment.isFloorBoundary())) {
+            return SegmentSide::Spanning;
+        }
+    }
+
+    if (numerator < 0 || (numeratorIsZero && denominator > 0)) {
+        return SegmentSide::Front;
+    }
+    return SegmentSide::Back;
+}
+
+// Cuts a segment classified as Spanning at its intersection with the splitter and returns {front piece, back piece}. Wall pieces keep
+// their ratios along the original wall so textures line up across the cut.
+std::pair<TwoHalfD::Segment, TwoHalfD::Segment> splitSpanningSegment(const TwoHalfD::Segment &segment, float numerator, float intersection) {
+    TwoHalfD::XYVectorf segmentVector = vectorBetweenPoints(segment.v1, segment.v2);
+    TwoHalfD::XYVectorf intersectionPoint{segment.v1 + intersection * segmentVector};
+
+    TwoHalfD::Segment rSegment{{segment.v1}, {intersectionPoint}, nullptr, segment.floorSection, 0.f, 1.f};
+    TwoHalfD::Segment lSegment{{intersectionPoint}, {segment.v2}, nullptr, segment.floorSection, 0.f, 1.f};
+    if (segment.isWall()) {
+        const float midPointWallRatio =
+            distanceBetweenPoints(intersectionPoint, segment.wall->start) / distanceBetweenPoints(segment.wall->start, segment.wall->end);
+        rSegment = {{segment.v1}, {intersectionPoint}, segment.wall, nullptr, segment.wallRatioStart, midPointWallRatio};
+        lSegment = {{intersectionPoint}, {segment.v2}, segment.wall, nullptr, midPointWallRatio, segment.wallRatioEnd};
+    }
+
+    if (numerator > 0) {
+        std::swap(rSegment, lSegment);
+    }
+    return {rSegment, lSegment};
+}
+
+// The child on the given side, or the other one where that side is empty (a dynamic wall laid along its leaf's edge, see _splitLeaf).
+// An empty side has no area, so whatever falls there belongs to the leaf on the wall's line.
+uint32_t childOnSide(const TwoHalfD::BSPNode &node, bool front) {
+    const uint32_t child = front ? node.front : node.back;
+    return child != TwoHalfD::BSP_NULL_INDEX ? child : (front ? node.back : node.front);
+}
+} // namespace
+
 void TwoHalfD::BSPManager::init(std::vector<Wall> walls, std::unordered_map<int, FloorSection> floorSections, float defaultFloorHeight,
                                 int defaultFloorTextureId, int seed) {
     m_walls = std::move(walls);
@@ -22,75 +147,125 @@ void TwoHalfD::BSPManager::init(std::vector<Wall> walls, std::unordered_map<int,
     m_seed = seed;
 }
 
+void TwoHalfD::BSPManager::setBuildMode(BSPBuildMode buildMode) {
+    m_buildMode = buildMode;
+}
+
 void TwoHalfD::BSPManager::buildBSPTree() {
-    int seed = 1; // m_seed;
-    std::cout << "Seed for BSP: " << seed << std::endl;
-    if (seed == -1) {
-        seed = findBestPartitioning();
+    int seed = m_seed;
+    if (m_buildMode == BSPBuildMode::Heuristic) {
+        std::cout << "Building BSP with heuristic splitter selection" << std::endl;
+    } else {
+        std::cout << "Seed for BSP: " << seed << std::endl;
+        if (seed == -1) {
+            seed = findBestPartitioning();
+        }
     }
 
-    m_root = std::make_unique<TwoHalfD::BSPNode>();
-    std::vector<TwoHalfD::Segment> segments;
+    m_nodes.clear();
+    m_leaves.clear();
+    _clearBillboards();
+    m_overlayLeafMap.clear();
+    _resetDynamicState();
+    m_pvs.clear();
     if (m_walls.size() == 0) {
+        m_nodes.push_back(TwoHalfD::BSPNode{});
+        m_nodes.back().leafIndex = 0;
+        m_leaves.emplace_back();
+        _computeNodeBounds();
         return;
     }
-    segments.reserve(m_walls.size());
-    for (const auto &wall : m_walls) {
-        segments.push_back({{wall.start.x, wall.start.y}, {wall.end.x, wall.end.y}, &wall, nullptr});
-    }
+    std::vector<TwoHalfD::Segment> segments = _makeInputSegments();
 
-    for (const auto &floorSectionIt : m_floorSections) {
-        const auto &floorSection = floorSectionIt.second;
-        size_t n = floorSection.vertices.size();
-        for (size_t i{}; i < n; ++i) {
-            const auto &currVert = floorSection.vertices[i];
-            const auto &nextVert = floorSection.vertices[(i + 1) % n];
+    TwoHalfD::Polygon initialBounds = _getInitialBounds(segments);
 
-            segments.push_back({currVert, nextVert, nullptr, &floorSection});
-        }
+    if (m_buildMode == BSPBuildMode::SeedSearch) {
+        std::mt19937 rng(seed);
+        std::shuffle(segments.begin(), segments.end(), rng);
+    }
+    // Each level of parallel recursion at most doubles the number of subtree builds in flight, so stop spawning once there is one per core.
+    int parallelDepth = 0;
+    const unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    while ((1u << parallelDepth) < threadCount) {
+        ++parallelDepth;
     }
 
-    TwoHalfD::Polygon initialBounds = _getInitialBounds(segments);
+    BSPScratch scratch;
+    scratch.pool = std::move(segments);
+    scratch.indices.resize(scratch.pool.size());
+    std::iota(scratch.indices.begin(), scratch.indices.end(), 0u);
 
-    std::mt19937 rng(seed);
-    std::shuffle(segments.begin(), segments.end(), rng);
     OptimalCostPartitioning cost{0, 0, 0};
-    _buildBSPTree(m_root.get(), segments, initialBounds, -1, cost);
+    BSPBuildSink sink;
+    _buildBSPTree(scratch, {0, scratch.indices.size()}, initialBounds, -1, cost, sink, parallelDepth);
+    _commitSink(std::move(sink));
+    _computeNodeBounds();
+    std::cout << "BSP Tree built with cost " << std::abs(cost.numBack - cost.numFront) + (cost.splitCount * m_splitWeight) << std::endl;
 
     return;
 }
 
 std::unordered_map<int, float> TwoHalfD::BSPManager::insertSprites(const std::unordered_map<int, SpriteEntity> &entities) {
-    std::unordered_map<int, float> heightStarts;
+    std::vector<int> entityIds;
+    std::vector<TwoHalfD::XYVectorf> positions;
+    entityIds.reserve(entities.size());
+    positions.reserve(entities.size());
     for (const auto &[entityId, entity] : entities) {
-        m_spritePositions[entityId] = entity.pos.pos;
-        float h = _insertSprite(m_root.get(), entityId, entity.pos.pos);
-        heightStarts[entityId] = h;
+        entityIds.push_back(entityId);
+        positions.push_back(entity.pos.pos);
+    }
+    std::vector<int> leafIndices(positions.size());
+    std::vector<float> floorHeights(positions.size());
+    findLeaves(positions, leafIndices, floorHeights);
+
+    std::unordered_map<int, float> heightStarts;
+    for (size_t i = 0; i < entityIds.size(); ++i) {
+        _placeBillboard(_billboardHandle(m_spriteHandles, entityIds[i]), entityIds[i], false, positions[i], leafIndices[i]);
+        heightStarts[entityIds[i]] = floorHeights[i];
     }
     return heightStarts;
 }
 
 float TwoHalfD::BSPManager::moveSprite(int entityId, TwoHalfD::XYVectorf newPos) {
-    auto nodeIt = m_spriteNodeMap.find(entityId);
-    if (nodeIt != m_spriteNodeMap.end()) {
-        nodeIt->second->spriteIds.erase(entityId);
+    return _insertSprite(entityId, newPos);
+}
+
+// Sprites still in or next to their leaf are placed straight away; the ones that went further are located together afterwards
+void TwoHalfD::BSPManager::moveSprites(std::span<const std::pair<int, TwoHalfD::XYVectorf>> moves) {
+    m_relocateHandles.clear();
+    m_relocateIds.clear();
+    m_relocatePoints.clear();
+    for (const auto &[entityId, newPos] : moves) {
+        const uint32_t handle = _billboardHandle(m_spriteHandles, entityId);
+        const int leafIndex = _findLeafNear(newPos, m_billboardSlots[handle].leafIndex);
+        if (leafIndex != -1) {
+            _placeBillboard(handle, entityId, false, newPos, leafIndex);
+        } else {
+            m_relocateHandles.push_back(handle);
+            m_relocateIds.push_back(entityId);
+            m_relocatePoints.push_back(newPos);
+        }
+    }
+    if (m_relocatePoints.empty()) return;
+
+    m_relocateLeaves.resize(m_relocatePoints.size());
+    m_relocateHeights.resize(m_relocatePoints.size());
+    findLeaves(m_relocatePoints, m_relocateLeaves, m_relocateHeights);
+    for (size_t i = 0; i < m_relocatePoints.size(); ++i) {
+        _placeBillboard(m_relocateHandles[i], m_relocateIds[i], false, m_relocatePoints[i], m_relocateLeaves[i]);
     }
-    m_spritePositions[entityId] = newPos;
-    return _insertSprite(m_root.get(), entityId, newPos);
 }
 
 float TwoHalfD::BSPManager::insertEffect(int effectId, TwoHalfD::XYVectorf pos) {
-    m_effectPositions[effectId] = pos;
-    return _insertEffect(m_root.get(), effectId, pos);
+    return _insertEffect(effectId, pos);
 }
 
 void TwoHalfD::BSPManager::removeEffect(int effectId) {
-    auto nodeIt = m_effectNodeMap.find(effectId);
-    if (nodeIt != m_effectNodeMap.end()) {
-        nodeIt->second->effectIds.erase(effectId);
-        m_effectNodeMap.erase(nodeIt);
-    }
-    m_effectPositions.erase(effectId);
+    auto handleIt = m_effectHandles.find(effectId);
+    if (handleIt == m_effectHandles.end()) return;
+    _unlinkBillboard(handleIt->second);
+    m_freeBillboardHandles.push_back(handleIt->second);
+    m_effectHandles.erase(handleIt);
 }
 
 TwoHalfD::Segment &TwoHalfD::BSPManager::getSegment(int id) {
@@ -105,148 +280,440 @@ const std::unordered_map<int, TwoHalfD::FloorSection> &TwoHalfD::BSPManager::get
     return m_floorSections;
 }
 
-std::pair<std::vector<TwoHalfD::DrawCommand>, std::unordered_set<int>> TwoHalfD::BSPManager::update(TwoHalfD::Position &cameraPos) {
-    TwoHalfD::XYVectorf cameraDir{std::cos(cameraPos.direction), std::sin(cameraPos.direction)};
-    std::vector<TwoHalfD::DrawCommand> commands;
-    std::unordered_set<int> floorSectionIds;
-    if (m_root == nullptr || m_segments.size() == 0) {
-        return {commands, floorSectionIds};
+void TwoHalfD::BSPManager::update(const TwoHalfD::CameraObject &camera, const TwoHalfD::EngineSettings &settings, DrawList &drawList) {
+    drawList.clear();
+    if (m_nodes.empty() || m_segments.size() == 0) return;
+
+    const TwoHalfD::Position &cameraPos = camera.cameraPos;
+    ViewWedge view;
+    view.origin = cameraPos.pos;
+    const float halfFov = settings.fov * 0.5f;
+    if (halfFov < std::numbers::pi_v<float> / 2.f) {
+        const float rightAngle = cameraPos.direction - halfFov;
+        const float leftAngle = cameraPos.direction + halfFov;
+        view.rightNormal = {-std::sin(rightAngle), std::cos(rightAngle)};
+        view.leftNormal = {std::sin(leftAngle), -std::cos(leftAngle)};
+        view.enabled = true;
     }
-    traverse(m_root.get(), commands, floorSectionIds, cameraPos, cameraDir);
+    // A portal flood that cannot start or runs over its budget falls back to the tree
+    if (settings.bspTraversal == BSPTraversal::Portal && _traversePortals(camera, settings, drawList)) return;
+    _updatePVSVisibility(cameraPos.pos);
 
-    return {commands, floorSectionIds};
-}
+    _updateTraversalOrder(cameraPos.pos);
 
-void TwoHalfD::BSPManager::traverse(TwoHalfD::BSPNode *node, std::vector<TwoHalfD::DrawCommand> &commands, std::unordered_set<int> &floorSectionIds,
-                                    const TwoHalfD::Position &cameraPos) {
-    if (node == nullptr) return;
+    if (settings.bspTraversal != BSPTraversal::BackToFront) {
+        m_occlusion.reset(camera, settings, m_defaultFloorHeight);
+        _traverseFrontToBack(drawList, cameraPos, view);
+        std::reverse(drawList.commands.begin(), drawList.commands.end());
+    } else {
+        traverse(drawList, cameraPos, view);
+    }
+}
 
-    bool isInfrontOfCamera = isInfront(cameraPos.pos - node->splitterP0, node->splitterVec);
+// Walks the cached order forwards. A subtree culled at its Enter step is skipped in one jump past its Exit step.
+void TwoHalfD::BSPManager::traverse(DrawList &drawList, const TwoHalfD::Position &cameraPos, const ViewWedge &view) {
+    auto &commands = drawList.commands;
+    const size_t stepCount = m_traversalOrder.size();
+    for (size_t i = 0; i < stepCount;) {
+        const TraversalStep &step = m_traversalOrder[i];
+        const uint32_t nodeIndex = step.nodeIndex;
+        switch (step.kind) {
+        case TraversalStep::Enter:
+            if (!_isVisible(nodeIndex, view) || (m_pvsActive && m_nodeVisibility[nodeIndex] == 0)) {
+                i = static_cast<size_t>(step.jump);
+                continue;
+            }
+            break;
+        case TraversalStep::Segment:
+            commands.push_back(DrawCommand::makeSegment(m_nodes[nodeIndex].segmentID));
+            break;
+        case TraversalStep::Leaf: {
+            if (!_isVisible(nodeIndex, view) || (m_pvsActive && m_nodeVisibility[nodeIndex] == 0)) break;
+            TwoHalfD::BSPLeaf &leaf = m_leaves[m_nodes[nodeIndex].leafIndex];
+            if (!m_pvsActive || (m_nodeVisibility[nodeIndex] & PVS_REGION) != 0) {
+                if (leaf.floorSection != nullptr) {
+                    commands.push_back(DrawCommand::makeFloorSection(leaf.floorSection.get()));
+                }
 
-    if (node->front == nullptr && node->back == nullptr) {
+                for (auto &overlay : leaf.colourOverlays) {
+                    commands.push_back(DrawCommand::makeColourOverlay(&overlay));
+                }
+            }
 
-        for (auto &overlay : node->colourOverlays) {
-            commands.push_back(DrawCommand::makeColourOverlay(&overlay));
+            _sortLeafBillboards(leaf, cameraPos.pos);
+            for (const auto &billboard : leaf.billboards) {
+                commands.push_back(billboard.isEffect ? DrawCommand::makeEffect(billboard.id) : DrawCommand::makeSprite(billboard.id));
+            }
+            break;
         }
-
-        struct DistEntry {
-            float dist;
-            int id;
-            bool isEffect;
-        };
-        auto cmp = [](const DistEntry &a, const DistEntry &b) { return a.dist < b.dist; };
-        std::priority_queue<DistEntry, std::vector<DistEntry>, decltype(cmp)> orderedDistance(cmp);
-
-        for (const auto &entityId : node->spriteIds) {
-            auto posIt = m_spritePositions.find(entityId);
-            if (posIt == m_spritePositions.end()) continue;
-            float distance = (posIt->second - cameraPos.pos).length();
-            orderedDistance.push({distance, entityId, false});
+        case TraversalStep::Exit:
+            break;
         }
-        for (const auto &effectId : node->effectIds) {
-            auto posIt = m_effectPositions.find(effectId);
-            if (posIt == m_effectPositions.end()) continue;
-            float distance = (posIt->second - cameraPos.pos).length();
-            orderedDistance.push({distance, effectId, true});
+        ++i;
+    }
+}
+
+// Mirror image of traverse(): the cached order walked backwards, near to far, with every command emitted in reverse, so reversing the
+// list afterwards gives the same order traverse() would have produced, minus whatever the nearer walls hid
+void TwoHalfD::BSPManager::_traverseFrontToBack(DrawList &drawList, const TwoHalfD::Position &cameraPos, const ViewWedge &view) {
+    auto &commands = drawList.commands;
+    for (int64_t i = static_cast<int64_t>(m_traversalOrder.size()) - 1; i >= 0 && !m_occlusion.isFull();) {
+        const TraversalStep &step = m_traversalOrder[i];
+        const uint32_t nodeIndex = step.nodeIndex;
+        switch (step.kind) {
+        case TraversalStep::Exit:
+            if (!_isVisible(nodeIndex, view) || (m_pvsActive && m_nodeVisibility[nodeIndex] == 0) ||
+                !m_occlusion.isRegionVisible(m_nodeBounds[nodeIndex], m_cullMargin)) {
+                i = step.jump;
+                continue;
+            }
+            break;
+        case TraversalStep::Segment: {
+            // Floor boundaries are drawn as a step from the ground up to the section's height
+            const int segmentID = m_nodes[nodeIndex].segmentID;
+            const TwoHalfD::Segment &segment = m_segments[segmentID];
+            const float bottom = segment.isWall() ? segment.wall->wallHeightStart : 0.f;
+            const float top = segment.isWall() ? bottom + segment.wall->height : segment.floorSection->height;
+            if (m_occlusion.addWall(segment.v1, segment.v2, bottom, top)) {
+                commands.push_back(DrawCommand::makeSegment(segmentID));
+            }
+            break;
         }
+        case TraversalStep::Leaf: {
+            if (!_isVisible(nodeIndex, view) || (m_pvsActive && m_nodeVisibility[nodeIndex] == 0) ||
+                !m_occlusion.isRegionVisible(m_nodeBounds[nodeIndex], m_cullMargin)) {
+                break;
+            }
+            TwoHalfD::BSPLeaf &leaf = m_leaves[m_nodes[nodeIndex].leafIndex];
 
-        if (!isInfrontOfCamera) {
-            while (!orderedDistance.empty()) {
-                const auto &top = orderedDistance.top();
-                commands.push_back(top.isEffect ? DrawCommand::makeEffect(top.id) : DrawCommand::makeSprite(top.id));
-                orderedDistance.pop();
+            _sortLeafBillboards(leaf, cameraPos.pos);
+            for (auto it = leaf.billboards.rbegin(); it != leaf.billboards.rend(); ++it) {
+                if (!m_occlusion.isBillboardVisible(it->pos, m_cullMargin)) continue;
+                commands.push_back(it->isEffect ? DrawCommand::makeEffect(it->id) : DrawCommand::makeSprite(it->id));
             }
-            commands.push_back(DrawCommand::makeSegment(static_cast<int>(node->segmentID)));
-        } else {
-            commands.push_back(DrawCommand::makeSegment(static_cast<int>(node->segmentID)));
-            while (!orderedDistance.empty()) {
-                const auto &top = orderedDistance.top();
-                commands.push_back(top.isEffect ? DrawCommand::makeEffect(top.id) : DrawCommand::makeSprite(top.id));
-                orderedDistance.pop();
+
+            if (leaf.floorSection == nullptr && leaf.colourOverlays.empty()) break;
+            if (m_pvsActive && (m_nodeVisibility[nodeIndex] & PVS_REGION) == 0) break;
+            if (!m_occlusion.isRegionVisible(m_nodeBounds[nodeIndex], 0.f)) break;
+            for (auto it = leaf.colourOverlays.rbegin(); it != leaf.colourOverlays.rend(); ++it) {
+                commands.push_back(DrawCommand::makeColourOverlay(&*it));
             }
+            if (leaf.floorSection != nullptr) {
+                commands.push_back(DrawCommand::makeFloorSection(leaf.floorSection.get()));
+            }
+            break;
+        }
+        case TraversalStep::Enter:
+            break;
         }
+        --i;
+    }
+}
+
+// Brings the cached order up to date with the camera. Only subtrees whose splitter the camera has crossed since are rewritten; a
+// subtree keeps its length, so rewriting one in place leaves every other step where it was.
+//
+// The camera cannot cross a splitter before it has travelled at least its distance from the line, so splitters wait in a min-heap on
+// the travel total at which they need another look, and a frame only tests the ones that have come due.
+void TwoHalfD::BSPManager::_updateTraversalOrder(const TwoHalfD::XYVectorf &cameraPos) {
+    if (!m_traversalOrderValid) {
+        m_traversalOrder.clear();
+        m_orderPositions.assign(m_nodes.size(), BSP_NULL_INDEX);
+        m_orderSides.assign(m_nodes.size(), 0);
+        m_orderDueAt.assign(m_nodes.size(), 0.0);
+        m_orderDueHeap.clear();
+        m_orderTravel = 0.0;
+        _writeTraversalOrder(0, 0, cameraPos);
+        m_orderCameraPos = cameraPos;
+        m_traversalOrderValid = true;
         return;
     }
+    if (cameraPos.x == m_orderCameraPos.x && cameraPos.y == m_orderCameraPos.y) return;
+    m_orderTravel += (cameraPos - m_orderCameraPos).length();
+    m_orderCameraPos = cameraPos;
+
+    // Everything due is taken off before anything is rescheduled, as a splitter the camera stands on comes due again straight away
+    m_dueNodes.clear();
+    while (!m_orderDueHeap.empty() && m_orderDueHeap.front().first <= m_orderTravel) {
+        std::pop_heap(m_orderDueHeap.begin(), m_orderDueHeap.end(), std::greater<>{});
+        const auto [dueAt, nodeIndex] = m_orderDueHeap.back();
+        m_orderDueHeap.pop_back();
+        if (dueAt == m_orderDueAt[nodeIndex]) m_dueNodes.push_back(nodeIndex); // otherwise superseded when its subtree was rewritten
+    }
 
-    if (isInfrontOfCamera) {
-        traverse(node->back.get(), commands, floorSectionIds, cameraPos);
+    m_flippedNodes.clear();
+    for (uint32_t nodeIndex : m_dueNodes) {
+        if (m_nodes[nodeIndex].isInfront(cameraPos) != (m_orderSides[nodeIndex] != 0)) {
+            m_flippedNodes.push_back(nodeIndex);
+        } else {
+            _scheduleSideCheck(nodeIndex, cameraPos);
+        }
+    }
+    if (m_flippedNodes.empty()) return;
+
+    // An Enter step comes before everything below it, so ancestors are rewritten first and cover their flipped descendants
+    std::sort(m_flippedNodes.begin(), m_flippedNodes.end(),
+              [&](uint32_t a, uint32_t b) { return m_orderPositions[a] < m_orderPositions[b]; });
+    for (uint32_t nodeIndex : m_flippedNodes) {
+        if (m_nodes[nodeIndex].isInfront(cameraPos) == (m_orderSides[nodeIndex] != 0)) continue;
+        _writeTraversalOrder(nodeIndex, m_orderPositions[nodeIndex], cameraPos);
+    }
 
-        commands.push_back(DrawCommand::makeSegment(node->segmentID));
-        traverse(node->front.get(), commands, floorSectionIds, cameraPos);
+    // Rewrites leave superseded entries behind; rebuild the heap from the live ones before they pile up
+    if (m_orderDueHeap.size() > 4 * m_nodes.size()) {
+        m_orderDueHeap.clear();
+        for (uint32_t nodeIndex{}; nodeIndex < m_nodes.size(); ++nodeIndex) {
+            if (m_nodes[nodeIndex].isLeaf() || m_orderPositions[nodeIndex] == BSP_NULL_INDEX) continue;
+            m_orderDueHeap.emplace_back(m_orderDueAt[nodeIndex], nodeIndex);
+        }
+        std::make_heap(m_orderDueHeap.begin(), m_orderDueHeap.end(), std::greater<>{});
+    }
+}
 
-    } else {
-        traverse(node->front.get(), commands, floorSectionIds, cameraPos);
+void TwoHalfD::BSPManager::_scheduleSideCheck(uint32_t nodeIndex, const TwoHalfD::XYVectorf &cameraPos) {
+    // Slightly early, so rounding in the travel total can never let a crossing slip past
+    constexpr double SIDE_CHECK_MARGIN = 1e-3;
+    const double dueAt = m_orderTravel + std::abs(m_nodes[nodeIndex].signedDistance(cameraPos)) - SIDE_CHECK_MARGIN;
+    m_orderDueAt[nodeIndex] = dueAt;
+    m_orderDueHeap.emplace_back(dueAt, nodeIndex);
+    std::push_heap(m_orderDueHeap.begin(), m_orderDueHeap.end(), std::greater<>{});
+}
 
-        commands.push_back(DrawCommand::makeSegment(node->segmentID));
+// Writes the subtree's steps from position on: Enter, far subtree, Segment, near subtree, Exit. Returns the position after them.
+uint32_t TwoHalfD::BSPManager::_writeTraversalOrder(uint32_t nodeIndex, uint32_t position, const TwoHalfD::XYVectorf &cameraPos) {
+    if (nodeIndex == BSP_NULL_INDEX) return position;
+    auto writeStep = [&](uint32_t at, TraversalStep step) {
+        if (at == m_traversalOrder.size()) {
+            m_traversalOrder.push_back(step);
+        } else {
+            m_traversalOrder[at] = step;
+        }
+    };
 
-        traverse(node->back.get(), commands, floorSectionIds, cameraPos);
+    m_orderPositions[nodeIndex] = position;
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+    if (node.isLeaf()) {
+        writeStep(position, {nodeIndex, 0, TraversalStep::Leaf});
+        return position + 1;
     }
-}
 
-void TwoHalfD::BSPManager::traverse(TwoHalfD::BSPNode *node, std::vector<TwoHalfD::DrawCommand> &commands, std::unordered_set<int> &floorSectionIds,
-                                    const TwoHalfD::Position &cameraPos, const TwoHalfD::XYVectorf &cameraDir) {
-    if (node == nullptr) return;
+    const bool isInfrontOfCamera = node.isInfront(cameraPos);
+    m_orderSides[nodeIndex] = isInfrontOfCamera;
+    _scheduleSideCheck(nodeIndex, cameraPos);
+    const uint32_t enter = position;
+    writeStep(position++, {nodeIndex, 0, TraversalStep::Enter});
+    position = _writeTraversalOrder(isInfrontOfCamera ? node.back : node.front, position, cameraPos);
+    writeStep(position++, {nodeIndex, 0, TraversalStep::Segment});
+    position = _writeTraversalOrder(isInfrontOfCamera ? node.front : node.back, position, cameraPos);
+    writeStep(position, {nodeIndex, static_cast<int32_t>(enter) - 1, TraversalStep::Exit});
+    m_traversalOrder[enter].jump = static_cast<int32_t>(position) + 1;
+    return position + 1;
+}
 
-    bool isInfrontOfCamera = isInfront(cameraPos.pos - node->splitterP0, node->splitterVec);
+// Floods from the camera's leaf, then walks only the paths down to the leaves it reached, in the same order as traverse()
+bool TwoHalfD::BSPManager::_traversePortals(const TwoHalfD::CameraObject &camera, const TwoHalfD::EngineSettings &settings, DrawList &drawList) {
+    if (!m_portals.isBuilt()) _buildPortals();
+    const TwoHalfD::XYVectorf &cameraPos = camera.cameraPos.pos;
+    if (!_isInsideLevel(cameraPos)) return false;
+
+    const float halfWindow = std::min(settings.fov * 0.5f, std::numbers::pi_v<float>);
+    m_cameraLeaf = _findLeaf(cameraPos, m_cameraLeaf);
+    if (!m_portals.flood(m_cameraLeaf, cameraPos, camera.cameraPos.direction, camera.cameraHeight + camera.cameraHeightStart,
+                         -halfWindow, halfWindow, m_segments)) {
+        return false;
+    }
 
-    if (node->front == nullptr && node->back == nullptr) {
-        // std::cout << "At leaf node: " << node->floorSectionId << '\n';
-        if (node->floorSection != nullptr) {
-            commands.push_back(DrawCommand::makeFloorSection(node->floorSection.get()));
-        }
+    for (int leafIndex : m_portals.getVisibleLeaves()) {
+        _markPortalPath(m_portals.getLeafNode(leafIndex), PVS_REGION | PVS_BILLBOARDS);
+    }
+    for (int segmentID : m_portals.getVisibleSegments()) {
+        _markPortalPath(m_portals.getSegmentNode(segmentID), PVS_SEGMENT);
+    }
+    for (int leafIndex : m_portals.getNeighbourLeaves()) {
+        const TwoHalfD::BSPLeaf &leaf = m_leaves[leafIndex];
+        if (m_portals.isLeafVisible(leafIndex) || leaf.billboards.empty()) continue;
+        _markPortalPath(m_portals.getLeafNode(leafIndex), PVS_BILLBOARDS);
+    }
+    _traversePortalOrder(0, drawList, camera.cameraPos);
 
-        for (auto &overlay : node->colourOverlays) {
-            commands.push_back(DrawCommand::makeColourOverlay(&overlay));
-        }
+    for (uint32_t nodeIndex : m_portalMarkedNodes) {
+        m_portalNodeFlags[nodeIndex] = 0;
+    }
+    m_portalMarkedNodes.clear();
+    return true;
+}
 
-        struct DistEntry {
-            float dist;
-            int id;
-            bool isEffect;
-        };
-        auto cmp = [](const DistEntry &a, const DistEntry &b) { return a.dist < b.dist; };
-        std::priority_queue<DistEntry, std::vector<DistEntry>, decltype(cmp)> orderedDistance(cmp);
+// Sets flags on the node and its ancestors, stopping at the first one that already has them
+void TwoHalfD::BSPManager::_markPortalPath(uint32_t nodeIndex, uint8_t flags) {
+    while (nodeIndex != BSP_NULL_INDEX && (m_portalNodeFlags[nodeIndex] & flags) != flags) {
+        if (m_portalNodeFlags[nodeIndex] == 0) m_portalMarkedNodes.push_back(nodeIndex);
+        m_portalNodeFlags[nodeIndex] |= flags;
+        nodeIndex = m_portals.getParent(nodeIndex);
+    }
+}
 
-        for (const auto &entityId : node->spriteIds) {
-            auto posIt = m_spritePositions.find(entityId);
-            if (posIt == m_spritePositions.end()) continue;
-            float distance = (posIt->second - cameraPos.pos).length();
-            orderedDistance.push({distance, entityId, false});
-        }
-        for (const auto &effectId : node->effectIds) {
-            auto posIt = m_effectPositions.find(effectId);
-            if (posIt == m_effectPositions.end()) continue;
-            float distance = (posIt->second - cameraPos.pos).length();
-            orderedDistance.push({distance, effectId, true});
+// traverse() restricted to the marked paths
+void TwoHalfD::BSPManager::_traversePortalOrder(uint32_t nodeIndex, DrawList &drawList, const TwoHalfD::Position &cameraPos) {
+    if (nodeIndex == BSP_NULL_INDEX || m_portalNodeFlags[nodeIndex] == 0) return;
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+    auto &commands = drawList.commands;
+
+    if (node.isLeaf()) {
+        TwoHalfD::BSPLeaf &leaf = m_leaves[node.leafIndex];
+        if ((m_portalNodeFlags[nodeIndex] & PVS_REGION) != 0) {
+            if (leaf.floorSection != nullptr) {
+                commands.push_back(DrawCommand::makeFloorSection(leaf.floorSection.get()));
+            }
+            for (auto &overlay : leaf.colourOverlays) {
+                commands.push_back(DrawCommand::makeColourOverlay(&overlay));
+            }
         }
 
-        while (!orderedDistance.empty()) {
-            const auto &top = orderedDistance.top();
-            commands.push_back(top.isEffect ? DrawCommand::makeEffect(top.id) : DrawCommand::makeSprite(top.id));
-            orderedDistance.pop();
+        _sortLeafBillboards(leaf, cameraPos.pos);
+        for (const auto &billboard : leaf.billboards) {
+            commands.push_back(billboard.isEffect ? DrawCommand::makeEffect(billboard.id) : DrawCommand::makeSprite(billboard.id));
         }
         return;
     }
 
-    if (isInfrontOfCamera) {
-        traverse(node->back.get(), commands, floorSectionIds, cameraPos, cameraDir);
+    const bool isInfrontOfCamera = node.isInfront(cameraPos.pos);
+    _traversePortalOrder(isInfrontOfCamera ? node.back : node.front, drawList, cameraPos);
+    if (m_portals.isSegmentVisible(node.segmentID)) {
+        commands.push_back(DrawCommand::makeSegment(node.segmentID));
+    }
+    _traversePortalOrder(isInfrontOfCamera ? node.front : node.back, drawList, cameraPos);
+}
 
-        commands.push_back(DrawCommand::makeSegment(node->segmentID));
+void TwoHalfD::BSPManager::_buildPortals() {
+    // Dynamic walls are in m_segments but not m_walls, so take the tallest wall from the segments
+    float sightBottom = m_defaultFloorHeight;
+    float sightTop = m_defaultFloorHeight;
+    for (const auto &[id, floorSection] : m_floorSections) {
+        sightBottom = std::min(sightBottom, floorSection.height);
+        sightTop = std::max(sightTop, floorSection.height);
+    }
+    for (const auto &segment : m_segments) {
+        if (segment.isWall()) sightTop = std::max(sightTop, segment.wall->wallHeightStart + segment.wall->height);
+    }
+    m_portals.build(m_nodes, m_leaves, m_segments, m_nodeBounds, sightBottom, sightTop);
+    m_portalNodeFlags.assign(m_nodes.size(), 0);
+    m_portalMarkedNodes.clear();
+}
 
-        traverse(node->front.get(), commands, floorSectionIds, cameraPos, cameraDir);
+// Restricts this frame's traversal to the camera cluster's PVS, unless the camera is outside the level or in a leaf without a cluster
+void TwoHalfD::BSPManager::_updatePVSVisibility(const TwoHalfD::XYVectorf &cameraPos) {
+    m_pvsActive = false;
+    if (m_pvs.empty() || m_nodeBounds.empty() || !_isInsideLevel(cameraPos)) return;
+    m_cameraLeaf = _findLeaf(cameraPos, m_cameraLeaf);
+    const int cluster = m_leaves[m_cameraLeaf].pvsCluster;
+    if (cluster < 0) return;
+
+    if (cluster != m_pvsCluster) {
+        m_pvs.decompressRow(cluster, m_pvsRow);
+        m_nodeVisibility.assign(m_nodes.size(), 0);
+        m_pvsOpenLines.clear();
+        _markVisibleNodes(0);
+        m_pvsCluster = cluster;
+    }
+    m_pvsActive = true;
+}
 
+// A billboard is drawn around its position, so one whose leaf is hidden can still reach into a visible neighbour. Colinear segments are
+// sent to the front when splitting, so a splitter on an ancestor's line only has leaves on one side of it below its node; the leaves
+// facing it from the other side are under that ancestor's back child.
+uint8_t TwoHalfD::BSPManager::_markVisibleNodes(uint32_t nodeIndex) {
+    if (nodeIndex == BSP_NULL_INDEX) return 0;
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+    uint8_t flags = 0;
+    if (!node.isLeaf()) {
+        const uint8_t backFlags = _markVisibleNodes(node.back);
+        const TwoHalfD::Segment &splitter = m_segments[node.segmentID];
+        const TwoHalfD::XYVectorf splitterVec = vectorBetweenPoints(splitter.v1, splitter.v2);
+        const bool openBack = (backFlags & PVS_REGION) != 0;
+        if (openBack) m_pvsOpenLines.push_back({splitter.v1, splitterVec});
+        flags = _markVisibleNodes(node.front) | backFlags;
+        if (openBack) m_pvsOpenLines.pop_back();
+        if ((flags & PVS_REGION) == 0 && _liesOnOpenLine(splitter)) flags |= PVS_SEGMENT;
     } else {
-        traverse(node->front.get(), commands, floorSectionIds, cameraPos, cameraDir);
+        flags = _leafVisibility(node.leafIndex);
+    }
+    m_nodeVisibility[nodeIndex] = flags;
+    return flags;
+}
 
-        commands.push_back(DrawCommand::makeSegment(node->segmentID));
+uint8_t TwoHalfD::BSPManager::_leafVisibility(int leafIndex) const {
+    if (_isClusterVisible(m_leaves[leafIndex].pvsCluster)) return PVS_REGION | PVS_BILLBOARDS;
+    if (m_graph.getNodeCount() != static_cast<int>(m_leaves.size())) return PVS_BILLBOARDS;
+    for (const auto &edge : m_graph.getNode(leafIndex).edges) {
+        if (_isClusterVisible(m_leaves[edge.targetNodeIndex].pvsCluster)) return PVS_BILLBOARDS;
+    }
+    return 0;
+}
 
-        traverse(node->back.get(), commands, floorSectionIds, cameraPos, cameraDir);
+bool TwoHalfD::BSPManager::_liesOnOpenLine(const TwoHalfD::Segment &splitter) const {
+    const TwoHalfD::XYVectorf splitterVec = vectorBetweenPoints(splitter.v1, splitter.v2);
+    for (const auto &[lineP0, lineVec] : m_pvsOpenLines) {
+        if (std::abs(crossProduct2d(splitter.v1 - lineP0, lineVec)) < TwoHalfD::BSP_EPSILON &&
+            std::abs(crossProduct2d(lineVec, splitterVec)) < TwoHalfD::BSP_EPSILON) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TwoHalfD::BSPManager::_isClusterVisible(int cluster) const {
+    return cluster < 0 || (m_pvsRow[cluster >> 3] >> (cluster & 7) & 1) != 0;
+}
+
+// Re-sorts the leaf's sprites and effects far to near. The camera and the billboards move little between frames, so last frame's order
+// is nearly right and an insertion sort finishes in about one pass; after a jump it gives up and sorts outright.
+void TwoHalfD::BSPManager::_sortLeafBillboards(TwoHalfD::BSPLeaf &leaf, const TwoHalfD::XYVectorf &cameraPos) {
+    auto &billboards = leaf.billboards;
+    for (auto &billboard : billboards) {
+        const XYVectorf toCamera = billboard.pos - cameraPos;
+        billboard.distSquared = TwoHalfD::dot(toCamera, toCamera);
+    }
+
+    const size_t maxMoves = 4 * billboards.size() + 16;
+    size_t moves = 0;
+    for (size_t i = 1; i < billboards.size(); ++i) {
+        if (billboards[i - 1].distSquared >= billboards[i].distSquared) continue;
+        const TwoHalfD::BSPLeafBillboard moving = billboards[i];
+        size_t j = i;
+        do {
+            billboards[j] = billboards[j - 1];
+            m_billboardSlots[billboards[j].handle].index = static_cast<uint32_t>(j);
+            --j;
+        } while (j > 0 && billboards[j - 1].distSquared < moving.distSquared && ++moves < maxMoves);
+        billboards[j] = moving;
+        m_billboardSlots[moving.handle].index = static_cast<uint32_t>(j);
+
+        if (moves >= maxMoves) {
+            std::sort(billboards.begin(), billboards.end(),
+                      [](const TwoHalfD::BSPLeafBillboard &a, const TwoHalfD::BSPLeafBillboard &b) { return a.distSquared > b.distSquared; });
+            for (size_t k = 0; k < billboards.size(); ++k) {
+                m_billboardSlots[billboards[k].handle].index = static_cast<uint32_t>(k);
+            }
+            return;
+        }
     }
 }
 
 TwoHalfD::Path TwoHalfD::BSPManager::findPath(const TwoHalfD::XYVectorf &start, const TwoHalfD::XYVectorf &end, float entityWidth,
                                               float maxHeightDiff, float maxStepDown, float maxDistance) {
-    auto path = m_graph.findPath(start, end, entityWidth, maxHeightDiff, maxStepDown, maxDistance);
+    // Graph node i is leaf i while the graph is current, so the tree can place the endpoints instead of the graph's scan over every leaf
+    if (m_graph.getNodeCount() != static_cast<int>(m_leaves.size()) || m_nodeBounds.empty()) {
+        auto path = m_graph.findPath(start, end, entityWidth, maxHeightDiff, maxStepDown, maxDistance);
+        if (path.size() <= 2) return path;
+        return _smoothPath(path, entityWidth, maxHeightDiff);
+    }
+    if (!_isInsideLevel(start) || !_isInsideLevel(end)) return {};
+
+    const std::array<TwoHalfD::XYVectorf, 2> endpoints{start, end};
+    std::array<int, 2> endpointLeaves;
+    std::array<float, 2> endpointFloors;
+    findLeaves(endpoints, endpointLeaves, endpointFloors);
+    auto path = m_graph.findPath(endpointLeaves[0], endpointLeaves[1], start, end, entityWidth, maxHeightDiff, maxStepDown, maxDistance);
     if (path.size() <= 2) return path;
     return _smoothPath(path, entityWidth, maxHeightDiff);
 }
@@ -308,7 +775,32 @@ bool TwoHalfD::BSPManager::_hasLineOfSight(const TwoHalfD::XYVectorf &a, const T
 
 // Getters
 void TwoHalfD::BSPManager::buildGraph() {
-    m_graph.build(m_root.get(), m_segments, m_defaultFloorHeight);
+    m_graph.build(m_nodes, m_leaves, m_segments, m_nodeBounds, m_defaultFloorHeight);
+}
+
+void TwoHalfD::BSPManager::buildPVS(float eyeHeight) {
+    if (!m_dynamicWalls.empty()) {
+        std::cerr << "buildPVS called with dynamic walls in the tree, skipping" << std::endl;
+        m_pvs.clear();
+    } else {
+        // A wall blocks sight only if no eye can look over it and nothing behind it pokes out above or below it
+        float sightBottom = m_defaultFloorHeight;
+        float highestFloor = m_defaultFloorHeight;
+        for (const auto &[id, floorSection] : m_floorSections) {
+            sightBottom = std::min(sightBottom, floorSection.height);
+            highestFloor = std::max(highestFloor, floorSection.height);
+        }
+        float sightTop = highestFloor + eyeHeight;
+        for (const auto &wall : m_walls) {
+            sightTop = std::max(sightTop, wall.wallHeightStart + wall.height);
+        }
+        m_pvs.build(m_nodes, m_leaves, m_segments, m_nodeBounds, sightBottom, sightTop);
+    }
+
+    for (size_t i{}; i < m_leaves.size(); ++i) {
+        m_leaves[i].pvsCluster = m_pvs.empty() ? -1 : static_cast<int>(i);
+    }
+    m_pvsCluster = -1;
 }
 
 TwoHalfD::BSPGraph &TwoHalfD::BSPManager::getGraph() {
@@ -316,48 +808,67 @@ TwoHalfD::BSPGraph &TwoHalfD::BSPManager::getGraph() {
 }
 
 int TwoHalfD::BSPManager::findBestPartitioning() {
-    std::vector<TwoHalfD::Segment> segments;
-    segments.reserve(m_walls.size());
-    for (const auto &wall : m_walls) {
-        segments.push_back({{wall.start.x, wall.start.y}, {wall.end.x, wall.end.y}, &wall, nullptr});
-    }
+    const std::vector<TwoHalfD::Segment> segments = _makeInputSegments();
 
-    for (const auto &floorSectionIt : m_floorSections) {
-        const auto &floorSection = floorSectionIt.second;
-        size_t n = floorSection.vertices.size();
-        for (size_t i{}; i < n; ++i) {
-            const auto &currVert = floorSection.vertices[i];
-            const auto &nextVert = floorSection.vertices[(i + 1) % n];
+    const int totalSeeds = std::max(m_endSeed - m_startSeed, 0);
+    const unsigned int numThreads = std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<unsigned int>(std::max(totalSeeds, 1)));
+    const uint32_t seedsPerThread = static_cast<uint32_t>(totalSeeds) / numThreads;
 
-            segments.push_back({currVert, nextVert, nullptr, &floorSection});
-        }
+    // Each worker owns a contiguous slice of seeds and steals half of another worker's slice once its own runs dry
+    std::vector<SeedRange> seedRanges(numThreads);
+    for (unsigned int t = 0; t < numThreads; ++t) {
+        uint32_t begin = t * seedsPerThread;
+        uint32_t end = (t == numThreads - 1) ? static_cast<uint32_t>(totalSeeds) : begin + seedsPerThread;
+        seedRanges[t].reset(begin, end);
     }
 
-    const unsigned int maxThreads = std::thread::hardware_concurrency();
-    const unsigned int numThreads = std::min(maxThreads, 4u);
-    const int totalSeeds = m_endSeed - m_startSeed;
-    const int seedsPerThread = totalSeeds / numThreads;
+    // Shared upper bound for pruning. It only ever tightens towards the true minimum, and a seed is only abandoned when its split
+    // cost strictly exceeds it, so the winning seed is the same for any thread count or scheduling.
+    std::atomic<float> sharedBestScore{std::numeric_limits<float>::max()};
 
     std::vector<std::thread> threads;
-    std::vector<std::pair<int, float>> threadResults(numThreads, {-1, std::numeric_limits<float>::max()});
+    std::vector<PartitioningStats> threadResults(numThreads);
 
     for (unsigned int t = 0; t < numThreads; ++t) {
-        int startSeed = m_startSeed + t * seedsPerThread;
-        int endSeed = (t == numThreads - 1) ? m_endSeed : startSeed + seedsPerThread;
-
-        threads.emplace_back([this, &segments, &threadResults, t, startSeed, endSeed]() {
-            int bestSeed = -1;
-            float lowestScore = std::numeric_limits<float>::max();
-
-            for (int seed = startSeed; seed < endSeed; ++seed) {
-                float score = _findIndividualPartitioning(seed, segments);
-                if (score < lowestScore) {
-                    lowestScore = score;
-                    bestSeed = seed;
+        threads.emplace_back([this, &segments, &seedRanges, &sharedBestScore, &threadResults, t, numThreads]() {
+            // Tallied locally and stored once at the end: neighbouring threadResults entries share cache lines
+            PartitioningStats result;
+            BSPScratch scratch;
+            scratch.pool = segments;
+
+            while (true) {
+                uint32_t seedOffset;
+                if (!seedRanges[t].pop(seedOffset)) {
+                    bool stolen = false;
+                    for (unsigned int k = 1; k < numThreads && !stolen; ++k) {
+                        uint32_t begin, end;
+                        if (seedRanges[(t + k) % numThreads].steal(begin, end)) {
+                            seedRanges[t].reset(begin, end);
+                            stolen = true;
+                        }
+                    }
+                    if (!stolen) break;
+                    continue;
                 }
-            }
 
-            threadResults[t] = {bestSeed, lowestScore};
+                int seed = m_startSeed + static_cast<int>(seedOffset);
+                auto score = _findIndividualPartitioning(seed, scratch, segments.size(), sharedBestScore.load(std::memory_order_relaxed));
+                if (!score) {
+                    ++result.seedsPruned;
+                    continue;
+                }
+                ++result.seedsEvaluated;
+
+                if (*score < result.bestScore || (*score == result.bestScore && seed < result.bestSeed)) {
+                    result.bestScore = *score;
+                    result.bestSeed = seed;
+                }
+
+                float currentBest = sharedBestScore.load(std::memory_order_relaxed);
+                while (*score < currentBest && !sharedBestScore.compare_exchange_weak(currentBest, *score, std::memory_order_relaxed)) {
+                }
+            }
+            threadResults[t] = result;
         });
     }
 
@@ -365,35 +876,71 @@ int TwoHalfD::BSPManager::findBestPartitioning() {
         thread.join();
     }
 
-    int bestSeed = -1;
-    float lowestScore = std::numeric_limits<float>::max();
-    for (const auto &[seed, score] : threadResults) {
-        if (score < lowestScore) {
-            lowestScore = score;
-            bestSeed = seed;
+    // Lowest score wins, ties go to the lowest seed - matching a serial scan over the seed range
+    PartitioningStats stats;
+    stats.threadCount = numThreads;
+    for (const auto &result : threadResults) {
+        stats.seedsEvaluated += result.seedsEvaluated;
+        stats.seedsPruned += result.seedsPruned;
+        if (result.bestScore < stats.bestScore || (result.bestScore == stats.bestScore && result.bestSeed < stats.bestSeed)) {
+            stats.bestScore = result.bestScore;
+            stats.bestSeed = result.bestSeed;
         }
     }
-    std::cout << "BSP Tree built with cost " << lowestScore << std::endl;
-    return bestSeed;
+    m_partitioningStats = stats;
+
+    std::cout << "BSP Tree built with cost " << stats.bestScore << " (seed " << stats.bestSeed << ", " << stats.seedsEvaluated << " evaluated, "
+              << stats.seedsPruned << " pruned, " << stats.threadCount << " threads)" << std::endl;
+    return stats.bestSeed;
 }
 
-float TwoHalfD::BSPManager::_findIndividualPartitioning(int seed, std::vector<TwoHalfD::Segment> segments) {
+const TwoHalfD::PartitioningStats &TwoHalfD::BSPManager::getPartitioningStats() const {
+    return m_partitioningStats;
+}
+
+// scratch.pool starts with the level's segmentCount input segments; anything past them is a previous seed's split pieces. Shuffling
+// the indices permutes exactly like shuffling the segments themselves did, so every seed still produces the same tree.
+std::optional<float> TwoHalfD::BSPManager::_findIndividualPartitioning(int seed, BSPScratch &scratch, size_t segmentCount, float costBound) {
+    scratch.pool.resize(segmentCount);
+    scratch.indices.resize(segmentCount);
+    std::iota(scratch.indices.begin(), scratch.indices.end(), 0u);
     std::mt19937 rng(seed);
-    std::shuffle(segments.begin(), segments.end(), rng);
+    std::shuffle(scratch.indices.begin(), scratch.indices.end(), rng);
 
     TwoHalfD::OptimalCostPartitioning cost{0, 0, 0};
-    TwoHalfD::BSPNode rootNode;
-    TwoHalfD::Polygon initialBounds = _getInitialBounds(segments);
-    _buildBSPTree(&rootNode, segments, initialBounds, -1, cost, false);
+    if (!_evaluatePartitioning(scratch, {0, segmentCount}, cost, costBound)) {
+        return std::nullopt;
+    }
 
     float score = std::abs(cost.numBack - cost.numFront) + (cost.splitCount * m_splitWeight);
     return score;
 }
 
+std::vector<TwoHalfD::Segment> TwoHalfD::BSPManager::_makeInputSegments() const {
+    std::vector<TwoHalfD::Segment> segments;
+    segments.reserve(m_walls.size());
+    for (const auto &wall : m_walls) {
+        segments.push_back({{wall.start.x, wall.start.y}, {wall.end.x, wall.end.y}, &wall, nullptr});
+    }
+
+    for (const auto &floorSectionIt : m_floorSections) {
+        const auto &floorSection = floorSectionIt.second;
+        size_t n = floorSection.vertices.size();
+        for (size_t i{}; i < n; ++i) {
+            const auto &currVert = floorSection.vertices[i];
+            const auto &nextVert = floorSection.vertices[(i + 1) % n];
+
+            segments.push_back({currVert, nextVert, nullptr, &floorSection});
+        }
+    }
+    return segments;
+}
+
 std::vector<TwoHalfD::Segment> TwoHalfD::BSPManager::findSegmentIntersection(const TwoHalfD::XYVectorf &p1, const float radius) {
     std::vector<TwoHalfD::Segment> intersectedSegments;
 
-    _findSegmentIntersections(p1, radius, m_root.get(), intersectedSegments);
+    if (m_nodes.empty()) return intersectedSegments;
+    _findSegmentIntersections(p1, radius, 0, intersectedSegments);
 
     return intersectedSegments;
 }
@@ -415,20 +962,49 @@ std::vector<std::pair<TwoHalfD::XYVectorf, TwoHalfD::XYVectorf>> TwoHalfD::BSPMa
     return result;
 }
 
-TwoHalfD::BSPNode *TwoHalfD::BSPManager::findConvexSection(const TwoHalfD::XYVectorf &point) {
-    return _findConvexSection(point, m_root.get());
+TwoHalfD::BSPLeaf *TwoHalfD::BSPManager::findConvexSection(const TwoHalfD::XYVectorf &point) {
+    int leafIndex = _findLeaf(point);
+    return leafIndex == -1 ? nullptr : &m_leaves[leafIndex];
+}
+
+void TwoHalfD::BSPManager::findLeaves(std::span<const TwoHalfD::XYVectorf> points, std::span<int> leafIndices, std::span<float> floorHeights) {
+    if (m_nodes.empty()) {
+        std::fill(leafIndices.begin(), leafIndices.end(), -1);
+        std::fill(floorHeights.begin(), floorHeights.end(), 0.f);
+        return;
+    }
+
+    // Flat x and y arrays rather than XYVectorf, so each splitter's test runs over contiguous floats
+    const size_t count = points.size();
+    m_locateX.resize(count);
+    m_locateY.resize(count);
+    m_locateIds.resize(count);
+    m_locateSides.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_locateX[i] = points[i].x;
+        m_locateY[i] = points[i].y;
+        m_locateIds[i] = static_cast<uint32_t>(i);
+    }
+    _findLeaves(0, 0, count, leafIndices, floorHeights);
+}
+
+TwoHalfD::BSPLeaf *TwoHalfD::BSPManager::findConvexSection(const TwoHalfD::XYVectorf &point, int &leafHint) {
+    leafHint = _findLeaf(point, leafHint);
+    return leafHint == -1 ? nullptr : &m_leaves[leafHint];
 }
 
 /* =============================================================================================================================
  * Private functions
  * =============================================================================================================================
  */
-void TwoHalfD::BSPManager::_buildBSPTree(TwoHalfD::BSPNode *node, const std::vector<TwoHalfD::Segment> &inputSegments, Polygon bounds,
-                                         int floorSectionId, struct OptimalCostPartitioning &cost, bool saveSegments) {
-    if (inputSegments.size() == 0) {
-        return;
+uint32_t TwoHalfD::BSPManager::_buildBSPTree(BSPScratch &scratch, IndexRange range, Polygon bounds, int floorSectionId,
+                                             struct OptimalCostPartitioning &cost, BSPBuildSink &sink, int parallelDepth) {
+    if (range.empty()) {
+        return _addLeaf(sink, std::move(bounds), -1, floorSectionId);
     }
-    const auto &splitterSeg = inputSegments[0];
+    const size_t splitterOffset = m_buildMode == BSPBuildMode::Heuristic ? _selectSplitter(scratch, range) : 0;
+    // Copied: splitting below appends to the pool
+    const TwoHalfD::Segment splitterSeg = scratch.pool[scratch.indices[range.begin + splitterOffset]];
     auto [frontBounds, backBounds] = _splitConvexShape(bounds, splitterSeg);
     int frontSectionFloorId = floorSectionId;
     int backSectionFloorId = floorSectionId;
@@ -468,201 +1044,375 @@ void TwoHalfD::BSPManager::_buildBSPTree(TwoHalfD::BSPNode *node, const std::vec
             }
         }
     }
-    auto [frontSegs, backSegs] = _splitSpace(node, inputSegments, cost, saveSegments);
 
-    if (backSegs.size() > 0) {
-        node->back = std::make_unique<TwoHalfD::BSPNode>();
-        cost.numBack += 1;
-        _buildBSPTree(node->back.get(), backSegs, backBounds, backSectionFloorId, cost, saveSegments);
-    } else if (saveSegments) {
-        node->back = std::make_unique<TwoHalfD::BSPNode>();
-        node->back->bounds = backBounds;
-        auto floorSectionIt = m_floorSections.find(backSectionFloorId);
-        if (floorSectionIt != m_floorSections.end() && backSectionFloorId != -1) {
-            auto floorSection = TwoHalfD::FloorSection{backBounds,
-                                                       floorSectionIt->second.floorTextureStart,
-                                                       floorSectionId,
-                                                       floorSectionIt->second.textureId,
-                                                       floorSectionIt->second.height,
-                                                       floorSectionIt->second.isCCW};
-            node->back->floorSection = std::make_unique<TwoHalfD::FloorSection>(floorSection);
-        }
-    }
-
-    if (frontSegs.size() > 0) {
-        node->front = std::make_unique<TwoHalfD::BSPNode>();
+    // Nodes are appended in pre-order (node, back subtree, front subtree), the same order _addSegment sees the splitters in
+    const uint32_t nodeIndex = static_cast<uint32_t>(sink.nodes.size());
+    sink.nodes.emplace_back();
+    const size_t poolMark = scratch.pool.size();
+    auto [frontRange, backRange] = _splitSpace(&sink.nodes[nodeIndex], scratch, range, cost, &sink, splitterOffset);
+
+    // Below this node the two halves share nothing but read-only level data, so a large front half is built on its own thread into a
+    // private sink and scratch (seeded with copies of its segments) while this thread carries on with the back half.
+    BSPScratch frontScratch;
+    std::future<void> frontBuild;
+    BSPBuildSink frontSink;
+    OptimalCostPartitioning frontCost{0, 0, 0};
+    if (parallelDepth > 0 && frontRange.size() >= m_parallelBuildThreshold && !backRange.empty()) {
         cost.numFront += 1;
-        _buildBSPTree(node->front.get(), frontSegs, frontBounds, frontSectionFloorId, cost, saveSegments);
-    } else if (saveSegments) {
-        node->front = std::make_unique<TwoHalfD::BSPNode>();
-        node->front->bounds = frontBounds;
-
-        auto floorSectionIt = m_floorSections.find(frontSectionFloorId);
-        if (floorSectionIt != m_floorSections.end() && frontSectionFloorId != -1) {
-            auto floorSection = TwoHalfD::FloorSection{frontBounds,
-                                                       floorSectionIt->second.floorTextureStart,
-                                                       floorSectionId,
-                                                       floorSectionIt->second.textureId,
-                                                       floorSectionIt->second.height,
-                                                       floorSectionIt->second.isCCW};
-            node->front->floorSection = std::make_unique<TwoHalfD::FloorSection>(floorSection);
+        frontScratch.pool.reserve(frontRange.size());
+        for (size_t i = frontRange.begin; i < frontRange.end; ++i) {
+            frontScratch.pool.push_back(scratch.pool[scratch.indices[i]]);
         }
+        frontScratch.indices.resize(frontRange.size());
+        std::iota(frontScratch.indices.begin(), frontScratch.indices.end(), 0u);
+        frontBuild = std::async(std::launch::async, [&]() {
+            _buildBSPTree(frontScratch, {0, frontScratch.indices.size()}, frontBounds, frontSectionFloorId, frontCost, frontSink, parallelDepth - 1);
+        });
     }
-}
 
-std::pair<std::vector<TwoHalfD::Segment>, std::vector<TwoHalfD::Segment>>
-TwoHalfD::BSPManager::_splitSpace(TwoHalfD::BSPNode *node, const std::vector<TwoHalfD::Segment> &inputSegments, struct OptimalCostPartitioning &cost,
-                                  bool saveSegments) {
-    auto splitterSeg = inputSegments[0];
-    TwoHalfD::XYVectorf v1 = splitterSeg.v1;
-    TwoHalfD::XYVectorf v2 = splitterSeg.v2;
-    TwoHalfD::XYVectorf splitterVec = TwoHalfD::XYVectorf{vectorBetweenPoints(v1, v2)};
+    uint32_t backIndex;
+    if (!backRange.empty()) {
+        cost.numBack += 1;
+        backIndex = _buildBSPTree(scratch, backRange, backBounds, backSectionFloorId, cost, sink, parallelDepth - 1);
+    } else {
+        backIndex = _addLeaf(sink, backBounds, backSectionFloorId, floorSectionId);
+    }
 
-    node->splitterVec = splitterVec;
-    node->splitterP0 = v1;
-    node->splitterP1 = v2;
+    uint32_t frontIndex;
+    if (frontBuild.valid()) {
+        // The serial recursion would have added the front subtree right after the back one, so appending here keeps node, leaf and
+        // segment order identical.
+        frontBuild.get();
+        frontIndex = _appendSink(sink, std::move(frontSink));
+        cost.splitCount += frontCost.splitCount;
+        cost.numFront += frontCost.numFront;
+        cost.numBack += frontCost.numBack;
+    } else if (!frontRange.empty()) {
+        cost.numFront += 1;
+        frontIndex = _buildBSPTree(scratch, frontRange, frontBounds, frontSectionFloorId, cost, sink, parallelDepth - 1);
+    } else {
+        frontIndex = _addLeaf(sink, frontBounds, frontSectionFloorId, floorSectionId);
+    }
+    scratch.indices.resize(frontRange.begin);
+    scratch.pool.resize(poolMark);
 
-    std::vector<TwoHalfD::Segment> frontSegs;
-    std::vector<TwoHalfD::Segment> backSegs;
+    sink.nodes[nodeIndex].back = backIndex;
+    sink.nodes[nodeIndex].front = frontIndex;
+    return nodeIndex;
+}
 
-    for (size_t i{1}; i < inputSegments.size(); ++i) {
-        XYVectorf segmentVector = vectorBetweenPoints(inputSegments[i].v1, inputSegments[i].v2);
-        float numerator = crossProduct2d(inputSegments[i].v1 - v1, splitterVec);
-        float denominator = crossProduct2d(splitterVec, segmentVector);
+// Leaf floors copy the level floor section's texture and height but take the leaf's own bounds as their polygon
+uint32_t TwoHalfD::BSPManager::_addLeaf(BSPBuildSink &sink, Polygon bounds, int leafFloorSectionId, int floorSectionId) {
+    const uint32_t nodeIndex = static_cast<uint32_t>(sink.nodes.size());
+    sink.nodes.emplace_back();
+    sink.nodes.back().leafIndex = static_cast<int>(sink.leaves.size());
+
+    TwoHalfD::BSPLeaf &leaf = sink.leaves.emplace_back();
+    auto floorSectionIt = m_floorSections.find(leafFloorSectionId);
+    if (floorSectionIt != m_floorSections.end() && leafFloorSectionId != -1) {
+        auto floorSection = TwoHalfD::FloorSection{bounds,
+                                                   floorSectionIt->second.floorTextureStart,
+                                                   floorSectionId,
+                                                   floorSectionIt->second.textureId,
+                                                   floorSectionIt->second.height,
+                                                   floorSectionIt->second.isCCW};
+        leaf.floorSection = std::make_unique<TwoHalfD::FloorSection>(floorSection);
+    }
+    leaf.bounds = std::move(bounds);
+    return nodeIndex;
+}
 
-        bool denominatorIsZero = std::abs(denominator) < BSP_EPSILON;
-        bool numeratorIsZero = std::abs(numerator) < BSP_EPSILON;
+// Moves a subtree's sink onto the end of another, rebasing its local indices. Returns the subtree root's new index.
+uint32_t TwoHalfD::BSPManager::_appendSink(BSPBuildSink &sink, BSPBuildSink &&subtree) {
+    const uint32_t nodeBase = static_cast<uint32_t>(sink.nodes.size());
+    const int leafBase = static_cast<int>(sink.leaves.size());
+    const int segmentBase = static_cast<int>(sink.segments.size());
 
-        if (denominatorIsZero && numeratorIsZero) {
-            frontSegs.push_back(inputSegments[i]);
-            continue;
+    sink.nodes.reserve(sink.nodes.size() + subtree.nodes.size());
+    for (TwoHalfD::BSPNode node : subtree.nodes) {
+        if (node.isLeaf()) {
+            node.leafIndex += leafBase;
+        } else {
+            node.front += nodeBase;
+            node.back += nodeBase;
+            node.segmentID += segmentBase;
         }
+        sink.nodes.push_back(node);
+    }
+    sink.leaves.insert(sink.leaves.end(), std::make_move_iterator(subtree.leaves.begin()), std::make_move_iterator(subtree.leaves.end()));
+    sink.segments.insert(sink.segments.end(), std::make_move_iterator(subtree.segments.begin()),
+                         std::make_move_iterator(subtree.segments.end()));
+    return nodeBase;
+}
 
-        if (!denominatorIsZero) {
-            float intersection = numerator / denominator;
-
-            if (intersection > 0.0f && intersection < 1.0f) {
-                TwoHalfD::XYVectorf intersectionPoint{inputSegments[i].v1 + intersection * segmentVector};
+// Cost-only mirror of _buildBSPTree used by the seed search: no nodes, bounds or floor sections are produced. The split count only
+// grows as the tree is built, so once it alone exceeds costBound the final score cannot beat it and the seed is abandoned
+// (leaving its scratch untruncated, which the next seed resets).
+bool TwoHalfD::BSPManager::_evaluatePartitioning(BSPScratch &scratch, IndexRange range, struct OptimalCostPartitioning &cost, float costBound) {
+    if (range.empty()) {
+        return true;
+    }
+    const size_t poolMark = scratch.pool.size();
+    auto [frontRange, backRange] = _splitSpace(nullptr, scratch, range, cost);
+    if (cost.splitCount * m_splitWeight > costBound) {
+        return false;
+    }
 
-                if (inputSegments[i].isWall()) {
-                    const float midPointWallRatio = distanceBetweenPoints(intersectionPoint, inputSegments[i].wall->start) /
-                                                    distanceBetweenPoints(inputSegments[i].wall->start, inputSegments[i].wall->end);
-                    TwoHalfD::Segment rSegment{{inputSegments[i].v1},           {intersectionPoint}, inputSegments[i].wall, nullptr,
-                                               inputSegments[i].wallRatioStart, midPointWallRatio};
-                    TwoHalfD::Segment lSegment{{intersectionPoint}, {inputSegments[i].v2},        inputSegments[i].wall, nullptr,
-                                               midPointWallRatio,   inputSegments[i].wallRatioEnd};
+    if (!backRange.empty()) {
+        cost.numBack += 1;
+        if (!_evaluatePartitioning(scratch, backRange, cost, costBound)) return false;
+    }
+    if (!frontRange.empty()) {
+        cost.numFront += 1;
+        if (!_evaluatePartitioning(scratch, frontRange, cost, costBound)) return false;
+    }
+    scratch.indices.resize(frontRange.begin);
+    scratch.pool.resize(poolMark);
+    return true;
+}
 
-                    if (numerator > 0) {
-                        std::swap(rSegment, lSegment);
-                    }
-                    cost.splitCount += 1;
-                    frontSegs.push_back(rSegment);
-                    backSegs.push_back(lSegment);
-                    continue;
-                } else if (inputSegments[i].isFloorBoundary()) {
-                    TwoHalfD::Segment rSegment{{inputSegments[i].v1}, {intersectionPoint}, nullptr, inputSegments[i].floorSection, 0.f, 1.f};
-                    TwoHalfD::Segment lSegment{{intersectionPoint}, {inputSegments[i].v2}, nullptr, inputSegments[i].floorSection, 0.f, 1.f};
-                    if (numerator > 0) {
-                        std::swap(rSegment, lSegment);
-                    }
-                    frontSegs.push_back(rSegment);
-                    backSegs.push_back(lSegment);
-                    continue;
+// Scores an evenly spaced sample of up to m_heuristicCandidates splitters against every segment at this node and returns the index of
+// the cheapest. Lower is better, scored on the seed search's terms: each wall it would cut costs m_splitWeight and a side left empty
+// costs one. Segment imbalance adds under one and diagonal or floor-boundary splitters pay a small penalty, so those only break ties.
+// The seed search sums front/back imbalance over the whole tree, which one node cannot see, so on a few small levels this trails the
+// best seed by a point or two (see notes/level_design.md).
+size_t TwoHalfD::BSPManager::_selectSplitter(const BSPScratch &scratch, IndexRange range) const {
+    auto segmentAt = [&](size_t offset) -> const TwoHalfD::Segment & { return scratch.pool[scratch.indices[range.begin + offset]]; };
+    const size_t n = range.size();
+    if (n <= 2) return 0;
+
+    const size_t candidateCount = std::min(n, m_heuristicCandidates);
+    size_t bestIndex = 0;
+    float bestScore = std::numeric_limits<float>::max();
+
+    for (size_t c{}; c < candidateCount; ++c) {
+        const size_t candidateIndex = c * n / candidateCount;
+        const auto &candidate = segmentAt(candidateIndex);
+        const TwoHalfD::XYVectorf splitterVec = vectorBetweenPoints(candidate.v1, candidate.v2);
+
+        float score = 0.f;
+        if (std::abs(splitterVec.x) > BSP_EPSILON && std::abs(splitterVec.y) > BSP_EPSILON) score += m_nonAxisAlignedPenalty;
+        if (candidate.isFloorBoundary()) score += m_floorBoundaryPenalty;
+
+        int numFront = 0;
+        int numBack = 0;
+        int splitCount = 0;
+        for (size_t i{}; i < n && score < bestScore; ++i) {
+            if (i == candidateIndex) continue;
+
+            float numerator = 0.f;
+            float intersection = 0.f;
+            switch (classifySegment(segmentAt(i), candidate.v1, splitterVec, numerator, intersection)) {
+            case SegmentSide::Spanning:
+                ++numFront;
+                ++numBack;
+                if (segmentAt(i).isWall()) {
+                    ++splitCount;
+                    score += m_splitWeight;
                 }
+                break;
+            case SegmentSide::Front:
+                ++numFront;
+                break;
+            case SegmentSide::Back:
+                ++numBack;
+                break;
             }
         }
+        // A child left with nothing to split unbalances the tree by one node; segment balance only keeps the tree shallow
+        if (numFront == 0 || numBack == 0) score += 1.f;
+        score += static_cast<float>(std::abs(numFront - numBack)) / static_cast<float>(n);
 
-        if (numerator < 0 || (numeratorIsZero && denominator > 0)) {
-            frontSegs.push_back(inputSegments[i]);
-        } else if (numerator > 0 || (numeratorIsZero && denominator < 0)) {
-            backSegs.push_back(inputSegments[i]);
+        if (score < bestScore) {
+            bestScore = score;
+            bestIndex = candidateIndex;
         }
     }
+    return bestIndex;
+}
 
-    if (saveSegments) {
-        _addSegment(std::move(splitterSeg), node);
+// Partitions the range around its splitter. The front half's indices are appended to scratch.indices, followed by the back half's,
+// each in input order (seed mode relies on that order); pieces of spanning segments are appended to scratch.pool.
+std::pair<TwoHalfD::IndexRange, TwoHalfD::IndexRange> TwoHalfD::BSPManager::_splitSpace(TwoHalfD::BSPNode *node, BSPScratch &scratch,
+                                                                                        IndexRange range, struct OptimalCostPartitioning &cost,
+                                                                                        BSPBuildSink *sink, size_t splitterOffset) {
+    const size_t splitterIndex = range.begin + splitterOffset;
+    TwoHalfD::Segment splitterSeg = scratch.pool[scratch.indices[splitterIndex]];
+    TwoHalfD::XYVectorf v1 = splitterSeg.v1;
+    TwoHalfD::XYVectorf v2 = splitterSeg.v2;
+    TwoHalfD::XYVectorf splitterVec = TwoHalfD::XYVectorf{vectorBetweenPoints(v1, v2)};
+
+    if (node != nullptr) {
+        node->normal = TwoHalfD::XYVectorf{-splitterVec.y, splitterVec.x}.normalized();
+        node->offset = dotProduct(node->normal, v1);
     }
-    return {frontSegs, backSegs};
-}
 
-float TwoHalfD::BSPManager::_insertSprite(TwoHalfD::BSPNode *node, int entityId, TwoHalfD::XYVectorf pos) {
-    if (node == nullptr) return 0.f;
+    const size_t frontBegin = scratch.indices.size();
+    scratch.backIndices.clear();
 
-    // If this is a leaf node, add the sprite here
-    if (node->front == nullptr && node->back == nullptr) {
-        float spriteHeight = 0.f;
-        if (node->floorSection != nullptr) {
-            spriteHeight = node->floorSection->height;
-        } else if (m_defaultFloorTextureId != -1) {
-            spriteHeight = m_defaultFloorHeight;
+    for (size_t i = range.begin; i < range.end; ++i) {
+        if (i == splitterIndex) continue;
+
+        const uint32_t segmentIndex = scratch.indices[i];
+        float numerator = 0.f;
+        float intersection = 0.f;
+        SegmentSide side = classifySegment(scratch.pool[segmentIndex], v1, splitterVec, numerator, intersection);
+
+        if (side == SegmentSide::Spanning) {
+            auto [frontPiece, backPiece] = splitSpanningSegment(scratch.pool[segmentIndex], numerator, intersection);
+            if (frontPiece.isWall()) {
+                cost.splitCount += 1;
+            }
+            scratch.pool.push_back(frontPiece);
+            scratch.indices.push_back(static_cast<uint32_t>(scratch.pool.size() - 1));
+            scratch.pool.push_back(backPiece);
+            scratch.backIndices.push_back(static_cast<uint32_t>(scratch.pool.size() - 1));
+        } else if (side == SegmentSide::Front) {
+            scratch.indices.push_back(segmentIndex);
+        } else {
+            scratch.backIndices.push_back(segmentIndex);
         }
-        node->spriteIds.insert(entityId);
-        m_spriteNodeMap[entityId] = node;
-        return spriteHeight;
     }
 
-    float isInfrontOfSplit = isInfront(pos - node->splitterP0, node->splitterVec);
+    const size_t backBegin = scratch.indices.size();
+    scratch.indices.insert(scratch.indices.end(), scratch.backIndices.begin(), scratch.backIndices.end());
 
-    if (isInfrontOfSplit > std::numeric_limits<float>::epsilon()) {
-        return _insertSprite(node->front.get(), entityId, pos);
-    } else {
-        return _insertSprite(node->back.get(), entityId, pos);
+    if (sink != nullptr) {
+        _addSegment(std::move(splitterSeg), node, *sink);
     }
+    return {{frontBegin, backBegin}, {backBegin, scratch.indices.size()}};
+}
+
+// Inserts or moves the sprite. The leaf it was in is the starting point for finding the one it is in now, so most moves cost a
+// containment test or two.
+float TwoHalfD::BSPManager::_insertSprite(int entityId, TwoHalfD::XYVectorf pos) {
+    const uint32_t handle = _billboardHandle(m_spriteHandles, entityId);
+    return _placeBillboard(handle, entityId, false, pos, _findLeaf(pos, m_billboardSlots[handle].leafIndex));
 }
 
-float TwoHalfD::BSPManager::_insertEffect(TwoHalfD::BSPNode *node, int effectId, TwoHalfD::XYVectorf pos) {
-    if (node == nullptr) return 0.f;
+// Inserts or moves the effect
+float TwoHalfD::BSPManager::_insertEffect(int effectId, TwoHalfD::XYVectorf pos) {
+    const uint32_t handle = _billboardHandle(m_effectHandles, effectId);
+    return _placeBillboard(handle, effectId, true, pos, _findLeaf(pos, m_billboardSlots[handle].leafIndex));
+}
 
-    if (node->front == nullptr && node->back == nullptr) {
-        float height = 0.f;
-        if (node->floorSection != nullptr) {
-            height = node->floorSection->height;
-        } else if (m_defaultFloorTextureId != -1) {
-            height = m_defaultFloorHeight;
-        }
-        node->effectIds.insert(effectId);
-        m_effectNodeMap[effectId] = node;
-        return height;
+// Puts the billboard in leafIndex, its leaf at pos. A move that stays inside the leaf only updates the stored position.
+float TwoHalfD::BSPManager::_placeBillboard(uint32_t handle, int id, bool isEffect, TwoHalfD::XYVectorf pos, int leafIndex) {
+    const BillboardSlot slot = m_billboardSlots[handle];
+    if (leafIndex != -1 && leafIndex == slot.leafIndex) {
+        m_leaves[leafIndex].billboards[slot.index].pos = pos;
+        return _leafFloorHeight(m_leaves[leafIndex]);
     }
 
-    float isInfrontOfSplit = isInfront(pos - node->splitterP0, node->splitterVec);
+    _unlinkBillboard(handle);
+    return _linkBillboard({pos, 0.f, id, handle, isEffect}, leafIndex);
+}
 
-    if (isInfrontOfSplit > std::numeric_limits<float>::epsilon()) {
-        return _insertEffect(node->front.get(), effectId, pos);
+uint32_t TwoHalfD::BSPManager::_billboardHandle(std::unordered_map<int, uint32_t> &handles, int id) {
+    auto [handleIt, inserted] = handles.try_emplace(id, 0);
+    if (!inserted) return handleIt->second;
+
+    if (m_freeBillboardHandles.empty()) {
+        handleIt->second = static_cast<uint32_t>(m_billboardSlots.size());
+        m_billboardSlots.emplace_back();
     } else {
-        return _insertEffect(node->back.get(), effectId, pos);
+        handleIt->second = m_freeBillboardHandles.back();
+        m_freeBillboardHandles.pop_back();
+        m_billboardSlots[handleIt->second] = BillboardSlot{};
     }
+    return handleIt->second;
 }
 
+// Appends the billboard to the leaf it stands in. The next sort of that leaf moves it into place.
+float TwoHalfD::BSPManager::_linkBillboard(const TwoHalfD::BSPLeafBillboard &billboard, int leafIndex) {
+    if (leafIndex == -1) return 0.f;
+
+    auto &billboards = m_leaves[leafIndex].billboards;
+    m_billboardSlots[billboard.handle] = {leafIndex, static_cast<uint32_t>(billboards.size())};
+    billboards.push_back(billboard);
+    return _leafFloorHeight(m_leaves[leafIndex]);
+}
+
+// Takes the billboard out of its leaf by moving the leaf's last one into its place
+void TwoHalfD::BSPManager::_unlinkBillboard(uint32_t handle) {
+    BillboardSlot &slot = m_billboardSlots[handle];
+    if (slot.leafIndex == -1) return;
+
+    auto &billboards = m_leaves[slot.leafIndex].billboards;
+    if (slot.index + 1 != billboards.size()) {
+        billboards[slot.index] = billboards.back();
+        m_billboardSlots[billboards[slot.index].handle].index = slot.index;
+    }
+    billboards.pop_back();
+    slot = BillboardSlot{};
+}
+
+void TwoHalfD::BSPManager::_clearBillboards() {
+    m_billboardSlots.clear();
+    m_freeBillboardHandles.clear();
+    m_spriteHandles.clear();
+    m_effectHandles.clear();
+}
+
+float TwoHalfD::BSPManager::_leafFloorHeight(const TwoHalfD::BSPLeaf &leaf) const {
+    if (leaf.floorSection != nullptr) {
+        return leaf.floorSection->height;
+    } else if (m_defaultFloorTextureId != -1) {
+        return m_defaultFloorHeight;
+    }
+    return 0.f;
+}
+
+// Vertices within BSP_EPSILON of the splitter's line go to both halves. Sorting them by the sign alone puts the two ends of an edge
+// lying on the line on opposite sides by rounding, and the intersection of two near-parallel lines then lands far outside the shape.
 std::pair<TwoHalfD::Polygon, TwoHalfD::Polygon> TwoHalfD::BSPManager::_splitConvexShape(const std::vector<TwoHalfD::XYVectorf> &vertices,
                                                                                         const TwoHalfD::Segment &splitter) {
+    const TwoHalfD::XYVectorf splitterVec = vectorBetweenPoints(splitter.v1, splitter.v2);
+    const TwoHalfD::XYVectorf normal = TwoHalfD::XYVectorf{-splitterVec.y, splitterVec.x}.normalized();
+    const float offset = dotProduct(normal, splitter.v1);
+    auto sideOf = [&](const TwoHalfD::XYVectorf &vertex) {
+        const float distance = dotProduct(normal, vertex) - offset;
+        return distance > BSP_EPSILON ? 1 : (distance < -BSP_EPSILON ? -1 : 0);
+    };
+
     TwoHalfD::Polygon frontVertices;
     TwoHalfD::Polygon backVertices;
+    bool anyFront = false, anyBack = false;
 
     for (size_t i{}; i < vertices.size(); ++i) {
         const auto &currVert = vertices[i];
         const auto &nextVert = vertices[(i + 1) % vertices.size()];
-        bool sideCurr = isInfront(currVert - splitter.v1, splitter.v2 - splitter.v1);
-        bool sideNext = isInfront(nextVert - splitter.v1, splitter.v2 - splitter.v1);
+        const int sideCurr = sideOf(currVert);
+        const int sideNext = sideOf(nextVert);
+        anyFront |= sideCurr > 0;
+        anyBack |= sideCurr < 0;
 
-        if (sideCurr) frontVertices.push_back(currVert);
-        if (!sideCurr) backVertices.push_back(currVert);
+        if (sideCurr >= 0) frontVertices.push_back(currVert);
+        if (sideCurr <= 0) backVertices.push_back(currVert);
 
-        if ((sideCurr && !sideNext) || (!sideCurr && sideNext)) {
+        if (sideCurr * sideNext < 0) {
             XYVectorf ip = computeLineIntersection(currVert, nextVert, splitter.v1, splitter.v2);
             frontVertices.push_back(ip);
             backVertices.push_back(ip);
         }
     }
+    // A side holding only vertices on the line has no area
+    if (!anyFront) frontVertices.clear();
+    if (!anyBack) backVertices.clear();
 
     return {{frontVertices}, {backVertices}};
 }
 
-void TwoHalfD::BSPManager::_addSegment(TwoHalfD::Segment &&segment, TwoHalfD::BSPNode *node) {
-    m_segments.push_back(std::move(segment));
-    node->segmentID = m_segmentID;
+void TwoHalfD::BSPManager::_addSegment(TwoHalfD::Segment &&segment, TwoHalfD::BSPNode *node, BSPBuildSink &sink) {
+    node->segmentID = static_cast<int>(sink.segments.size());
+    sink.segments.push_back(std::move(segment));
+}
 
-    ++m_segmentID;
+void TwoHalfD::BSPManager::_commitSink(BSPBuildSink &&sink) {
+    m_nodes = std::move(sink.nodes);
+    m_leaves = std::move(sink.leaves);
+    m_segments = std::move(sink.segments);
+    m_segmentID = m_segments.size();
 }
 
 TwoHalfD::Polygon TwoHalfD::BSPManager::_getInitialBounds(const std::vector<TwoHalfD::Segment> &segments) {
@@ -693,45 +1443,184 @@ TwoHalfD::Polygon TwoHalfD::BSPManager::_getInitialBounds(const std::vector<TwoH
     return initialBounds;
 }
 
-void TwoHalfD::BSPManager::_findSegmentIntersections(const TwoHalfD::XYVectorf &p1, const float radius, BSPNode *node,
+void TwoHalfD::BSPManager::_findSegmentIntersections(const TwoHalfD::XYVectorf &p1, const float radius, uint32_t nodeIndex,
                                                      std::vector<Segment> &intersectedSegments) {
-    if (node == nullptr) return;
+    if (nodeIndex == BSP_NULL_INDEX) return;
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+    if (node.isLeaf()) return;
+
+    const auto &segment = m_segments[node.segmentID];
+    auto intersections = circleLineIntersect(p1, radius, segment.v1, segment.v2);
+    if (!intersections.empty()) {
+        intersectedSegments.push_back(segment);
+    }
+
+    float signedDist = node.signedDistance(p1);
+
+    if (signedDist < radius) {
+        _findSegmentIntersections(p1, radius, node.back, intersectedSegments);
+    }
+    if (signedDist > -radius) {
+        _findSegmentIntersections(p1, radius, node.front, intersectedSegments);
+    }
+}
+
+int TwoHalfD::BSPManager::_findLeaf(const TwoHalfD::XYVectorf &point) const {
+    if (m_nodes.empty()) return -1;
+
+    uint32_t nodeIndex = 0;
+    while (!m_nodes[nodeIndex].isLeaf()) {
+        const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+        nodeIndex = childOnSide(node, node.isInfront(point));
+    }
+    return m_nodes[nodeIndex].leafIndex;
+}
 
-    if (node->segmentID != -1) {
-        const auto &segment = m_segments[node->segmentID];
-        auto intersections = circleLineIntersect(p1, radius, segment.v1, segment.v2);
-        if (!intersections.empty()) {
-            intersectedSegments.push_back(segment);
+// Same answer as _findLeaf(point), tried first against hintLeaf (where the point was last time) and the leaves the graph links it to.
+// Any leaf index is accepted as a hint, stale or -1 included; only a point that has jumped further, sits on a leaf's boundary or has
+// gone through a wall costs the descent from the root.
+int TwoHalfD::BSPManager::_findLeaf(const TwoHalfD::XYVectorf &point, int hintLeaf) const {
+    const int leafIndex = _findLeafNear(point, hintLeaf);
+    return leafIndex != -1 ? leafIndex : _findLeaf(point);
+}
+
+// The hint leaf or one linked to it if either holds the point, otherwise -1
+int TwoHalfD::BSPManager::_findLeafNear(const TwoHalfD::XYVectorf &point, int hintLeaf) const {
+    if (_isInsideLeaf(hintLeaf, point)) return hintLeaf;
+    if (hintLeaf >= 0 && hintLeaf < m_graph.getNodeCount() && m_graph.getNodeCount() == static_cast<int>(m_leaves.size())) {
+        for (const auto &edge : m_graph.getNode(hintLeaf).edges) {
+            if (_isInsideLeaf(edge.targetNodeIndex, point)) return edge.targetNodeIndex;
         }
     }
+    return -1;
+}
 
-    float signedDist = crossProduct2d(p1 - node->splitterP0, node->splitterVec.normalized());
+// Takes the points in [begin, end) of the m_locate arrays down from nodeIndex. Each splitter classifies its whole run four points at a
+// time, then partitions the run into its front and back points for the children.
+void TwoHalfD::BSPManager::_findLeaves(uint32_t nodeIndex, size_t begin, size_t end, std::span<int> leafIndices, std::span<float> floorHeights) {
+    if (begin == end) return;
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+    if (node.isLeaf()) {
+        const float floorHeight = _leafFloorHeight(m_leaves[node.leafIndex]);
+        for (size_t i = begin; i < end; ++i) {
+            leafIndices[m_locateIds[i]] = node.leafIndex;
+            floorHeights[m_locateIds[i]] = floorHeight;
+        }
+        return;
+    }
 
-    if (signedDist > -radius) {
-        _findSegmentIntersections(p1, radius, node->back.get(), intersectedSegments);
+    float *x = m_locateX.data();
+    float *y = m_locateY.data();
+    uint32_t *ids = m_locateIds.data();
+    uint32_t *isFront = m_locateSides.data();
+    const float normalX = node.normal.x, normalY = node.normal.y, offset = node.offset;
+    size_t i = begin;
+#ifdef TWOHALFD_SSE2
+    // Same operations in the same order as the scalar test, so both give bit-identical answers
+    const __m128 normalX4 = _mm_set1_ps(normalX), normalY4 = _mm_set1_ps(normalY), offset4 = _mm_set1_ps(offset);
+    for (; i + 4 <= end; i += 4) {
+        const __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(normalX4, _mm_loadu_ps(x + i)), _mm_mul_ps(normalY4, _mm_loadu_ps(y + i))), offset4);
+        const __m128i inFront = _mm_srli_epi32(_mm_castps_si128(_mm_cmpgt_ps(distance, _mm_setzero_ps())), 31);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(isFront + i), inFront);
     }
-    if (signedDist < radius) {
-        _findSegmentIntersections(p1, radius, node->front.get(), intersectedSegments);
+#endif
+    for (; i < end; ++i) {
+        isFront[i] = normalX * x[i] + normalY * y[i] - offset > 0.f; // BSPNode::isInfront, term for term
+    }
+
+    size_t front = begin, back = end;
+    while (true) {
+        while (front < back && isFront[front]) ++front;
+        while (front < back && !isFront[back - 1]) --back;
+        if (front >= back) break;
+        --back;
+        std::swap(x[front], x[back]);
+        std::swap(y[front], y[back]);
+        std::swap(ids[front], ids[back]);
+        ++front;
     }
+    _findLeaves(childOnSide(node, true), begin, front, leafIndices, floorHeights);
+    _findLeaves(childOnSide(node, false), front, end, leafIndices, floorHeights);
 }
 
-TwoHalfD::BSPNode *TwoHalfD::BSPManager::_findConvexSection(const TwoHalfD::XYVectorf &point, BSPNode *node) {
-    if (node == nullptr) return nullptr;
+// Whether the point is within the box around every leaf. Outside it, the leaf the tree puts a point in is only the nearest one.
+bool TwoHalfD::BSPManager::_isInsideLevel(const TwoHalfD::XYVectorf &point) const {
+    const TwoHalfD::BSPBounds &levelBounds = m_nodeBounds[0];
+    return point.x >= levelBounds.min.x && point.x <= levelBounds.max.x && point.y >= levelBounds.min.y && point.y <= levelBounds.max.y;
+}
 
-    if (node->front == nullptr && node->back == nullptr) {
-        return node;
+// Whether the point lies inside the leaf's polygon and not within rounding distance of its edges, where the splitters decide instead
+bool TwoHalfD::BSPManager::_isInsideLeaf(int leafIndex, const TwoHalfD::XYVectorf &point) const {
+    constexpr float EDGE_MARGIN = 0.05f;
+    if (leafIndex < 0 || leafIndex >= static_cast<int>(m_leaves.size())) return false;
+    const TwoHalfD::Polygon &bounds = m_leaves[leafIndex].bounds;
+    if (bounds.size() < 3) return false;
+
+    // Either winding: the point has to be on the same side of every edge
+    int side = 0;
+    for (size_t i = 0, j = bounds.size() - 1; i < bounds.size(); j = i++) {
+        const TwoHalfD::XYVectorf edge = bounds[i] - bounds[j];
+        const float cross = crossProduct2d(edge, point - bounds[j]);
+        const float margin = EDGE_MARGIN * edge.length();
+        if (cross > margin) {
+            if (side < 0) return false;
+            side = 1;
+        } else if (cross < -margin) {
+            if (side > 0) return false;
+            side = -1;
+        } else {
+            return false;
+        }
     }
+    return true;
+}
+
+// --- Colour overlay ---
+
+// The PVS node flags, portal tables and traversal order are indexed like the node boxes, so any change to the nodes makes them stale
+void TwoHalfD::BSPManager::_invalidateNodeCaches() {
+    m_pvsCluster = -1;
+    m_portals.clear();
+    m_traversalOrderValid = false;
+}
 
-    bool isInfrontOfSplit = isInfront(point - node->splitterP0, node->splitterVec);
+void TwoHalfD::BSPManager::_computeNodeBounds() {
+    _invalidateNodeCaches();
+    m_nodeBounds.assign(m_nodes.size(), TwoHalfD::BSPBounds{});
+    if (!m_nodes.empty()) _computeNodeBounds(0);
+}
 
-    if (isInfrontOfSplit) {
-        return _findConvexSection(point, node->front.get());
+// A node's box is its leaves' bounds plus its splitters. Splitters normally lie inside the region already, but a dynamic wall may
+// reach past the level's initial bounds.
+const TwoHalfD::BSPBounds &TwoHalfD::BSPManager::_computeNodeBounds(uint32_t nodeIndex) {
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
+    TwoHalfD::BSPBounds &bounds = m_nodeBounds[nodeIndex];
+    bounds = TwoHalfD::BSPBounds{};
+    if (node.isLeaf()) {
+        for (const auto &vertex : m_leaves[node.leafIndex].bounds) {
+            bounds.expand(vertex);
+        }
     } else {
-        return _findConvexSection(point, node->back.get());
+        if (node.back != BSP_NULL_INDEX) bounds.expand(_computeNodeBounds(node.back));
+        if (node.front != BSP_NULL_INDEX) bounds.expand(_computeNodeBounds(node.front));
+        bounds.expand(m_segments[node.segmentID].v1);
+        bounds.expand(m_segments[node.segmentID].v2);
     }
+    return bounds;
 }
 
-// --- Colour overlay ---
+// Conservative: a region is only rejected when its box lies more than m_cullMargin behind one of the wedge's side planes
+bool TwoHalfD::BSPManager::_isVisible(uint32_t nodeIndex, const ViewWedge &view) const {
+    if (!view.enabled) return true;
+    const TwoHalfD::BSPBounds &bounds = m_nodeBounds[nodeIndex];
+    for (const TwoHalfD::XYVectorf &normal : {view.leftNormal, view.rightNormal}) {
+        // Box corner furthest along the normal
+        const float x = normal.x >= 0.f ? bounds.max.x : bounds.min.x;
+        const float y = normal.y >= 0.f ? bounds.max.y : bounds.min.y;
+        if (normal.x * (x - view.origin.x) + normal.y * (y - view.origin.y) < -m_cullMargin) return false;
+    }
+    return true;
+}
 
 std::vector<TwoHalfD::Polygon> TwoHalfD::BSPManager::_triangulate(const Polygon &polygon) {
     // Ear-clipping triangulation for a simple polygon (convex or concave, no holes).
@@ -805,56 +1694,58 @@ std::vector<TwoHalfD::Polygon> TwoHalfD::BSPManager::_triangulate(const Polygon
     return triangles;
 }
 
-void TwoHalfD::BSPManager::_insertColourOverlayTriangle(BSPNode *node, const Polygon &triangle, int id, float height, uint8_t r, uint8_t g, uint8_t b,
-                                                        uint8_t a) {
-    if (node == nullptr || triangle.size() < 3) return;
+void TwoHalfD::BSPManager::_insertColourOverlayTriangle(uint32_t nodeIndex, const Polygon &triangle, int id, float height, uint8_t r, uint8_t g,
+                                                        uint8_t b, uint8_t a) {
+    if (nodeIndex == BSP_NULL_INDEX || triangle.size() < 3) return;
+    const TwoHalfD::BSPNode &node = m_nodes[nodeIndex];
 
-    if (node->front == nullptr && node->back == nullptr) {
+    if (node.isLeaf()) {
+        TwoHalfD::BSPLeaf &leaf = m_leaves[node.leafIndex];
         float effectiveHeight = height;
-        if (node->floorSection != nullptr)
-            effectiveHeight = std::max(height, node->floorSection->height);
-        node->colourOverlays.push_back({triangle, id, effectiveHeight, r, g, b, a});
-        m_overlayNodeMap[id].push_back(node);
+        if (leaf.floorSection != nullptr)
+            effectiveHeight = std::max(height, leaf.floorSection->height);
+        leaf.colourOverlays.push_back({triangle, id, effectiveHeight, r, g, b, a});
+        m_overlayLeafMap[id].push_back(node.leafIndex);
         return;
     }
 
     // Classify vertices against the splitter
     bool anyFront = false, anyBack = false;
     for (const auto &v : triangle) {
-        if (isInfront(v - node->splitterP0, node->splitterVec)) anyFront = true;
+        if (node.isInfront(v)) anyFront = true;
         else anyBack = true;
     }
 
     Segment splitter;
-    splitter.v1 = node->splitterP0;
-    splitter.v2 = node->splitterP1;
+    splitter.v1 = m_segments[node.segmentID].v1;
+    splitter.v2 = m_segments[node.segmentID].v2;
     splitter.wall = nullptr;
     splitter.floorSection = nullptr;
 
     if (anyFront && anyBack) {
         auto [frontPoly, backPoly] = _splitConvexShape(triangle, splitter);
-        if (frontPoly.size() >= 3) _insertColourOverlayTriangle(node->front.get(), frontPoly, id, height, r, g, b, a);
-        if (backPoly.size() >= 3) _insertColourOverlayTriangle(node->back.get(), backPoly, id, height, r, g, b, a);
+        if (frontPoly.size() >= 3) _insertColourOverlayTriangle(node.front, frontPoly, id, height, r, g, b, a);
+        if (backPoly.size() >= 3) _insertColourOverlayTriangle(node.back, backPoly, id, height, r, g, b, a);
     } else if (anyFront) {
-        _insertColourOverlayTriangle(node->front.get(), triangle, id, height, r, g, b, a);
+        _insertColourOverlayTriangle(node.front, triangle, id, height, r, g, b, a);
     } else {
-        _insertColourOverlayTriangle(node->back.get(), triangle, id, height, r, g, b, a);
+        _insertColourOverlayTriangle(node.back, triangle, id, height, r, g, b, a);
     }
 }
 
 void TwoHalfD::BSPManager::insertColourOverlay(int id, const Polygon &vertices, float height, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    if (m_root == nullptr) return;
+    if (m_nodes.empty()) return;
     auto triangles = _triangulate(vertices);
     for (const auto &tri : triangles) {
-        _insertColourOverlayTriangle(m_root.get(), tri, id, height, r, g, b, a);
+        _insertColourOverlayTriangle(0, tri, id, height, r, g, b, a);
     }
 }
 
 void TwoHalfD::BSPManager::updateColourOverlay(int id, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    auto it = m_overlayNodeMap.find(id);
-    if (it == m_overlayNodeMap.end()) return;
-    for (BSPNode *node : it->second) {
-        for (auto &overlay : node->colourOverlays) {
+    auto it = m_overlayLeafMap.find(id);
+    if (it == m_overlayLeafMap.end()) return;
+    for (int leafIndex : it->second) {
+        for (auto &overlay : m_leaves[leafIndex].colourOverlays) {
             if (overlay.id == id) {
                 overlay.r = r;
                 overlay.g = g;
@@ -866,11 +1757,484 @@ void TwoHalfD::BSPManager::updateColourOverlay(int id, uint8_t r, uint8_t g, uin
 }
 
 void TwoHalfD::BSPManager::removeColourOverlay(int id) {
-    auto it = m_overlayNodeMap.find(id);
-    if (it == m_overlayNodeMap.end()) return;
-    for (BSPNode *node : it->second) {
-        auto &overlays = node->colourOverlays;
+    auto it = m_overlayLeafMap.find(id);
+    if (it == m_overlayLeafMap.end()) return;
+    for (int leafIndex : it->second) {
+        auto &overlays = m_leaves[leafIndex].colourOverlays;
         overlays.erase(std::remove_if(overlays.begin(), overlays.end(), [id](const FloorColourOverlay &o) { return o.id == id; }), overlays.end());
     }
-    m_overlayNodeMap.erase(it);
+    m_overlayLeafMap.erase(it);
+}
+
+// --- Dynamic walls ---
+
+int TwoHalfD::BSPManager::insertWall(const Wall &wall) {
+    if (m_nodes.empty()) return -1;
+
+    const int dynamicWallId = m_nextDynamicWallId++;
+    DynamicWall &dynamicWall = m_dynamicWalls[dynamicWallId];
+    dynamicWall.wall = std::make_unique<Wall>(wall);
+
+    std::vector<int> changedLeaves;
+    std::vector<uint32_t> path;
+    TwoHalfD::Segment segment{dynamicWall.wall->start, dynamicWall.wall->end, dynamicWall.wall.get(), nullptr, 0.f, 1.f};
+    _insertDynamicSegment(0, segment, BSP_NULL_INDEX, changedLeaves, dynamicWall.regions, path);
+
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> regions;
+    for (uint32_t regionRoot : dynamicWall.regions) {
+        regions.push_back({regionRoot, m_dynamicRegions[regionRoot].ancestors});
+    }
+    _refreshRegions(regions, changedLeaves, wall);
+    return dynamicWallId;
+}
+
+bool TwoHalfD::BSPManager::removeWall(int dynamicWallId) {
+    auto wallIt = m_dynamicWalls.find(dynamicWallId);
+    if (wallIt == m_dynamicWalls.end()) return false;
+
+    // Taken before the rebuild, which drops regions left with no walls
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> regions;
+    for (uint32_t regionRoot : wallIt->second.regions) {
+        regions.push_back({regionRoot, m_dynamicRegions[regionRoot].ancestors});
+    }
+    std::vector<int> changedLeaves;
+    for (const auto &[regionRoot, ancestors] : regions) {
+        _rebuildRegion(regionRoot, wallIt->second.wall.get(), changedLeaves);
+    }
+    const Wall wall = *wallIt->second.wall;
+    m_dynamicWalls.erase(wallIt);
+
+    _refreshRegions(regions, changedLeaves, wall);
+    return true;
+}
+
+bool TwoHalfD::BSPManager::validateGraph() const {
+    TwoHalfD::BSPGraph rebuilt;
+    rebuilt.build(m_nodes, m_leaves, m_segments, m_nodeBounds, m_defaultFloorHeight);
+    return m_graph.hasSameEdges(rebuilt, 0.1f);
+}
+
+// Brings everything kept per node up to date after a wall rewrote the subtrees below the given region roots, in the order they were
+// rewritten. Only those subtrees and the static nodes above them are looked at: the rest of the tree did not change.
+void TwoHalfD::BSPManager::_refreshRegions(const std::vector<std::pair<uint32_t, std::vector<uint32_t>>> &regions,
+                                           const std::vector<int> &changedLeaves, const Wall &wall) {
+    m_nodeBounds.resize(m_nodes.size());
+    for (const auto &[regionRoot, ancestors] : regions) {
+        _refitNodeBounds(regionRoot, ancestors);
+    }
+
+    // Leaves outside the regions whose edges to them change may see a sprite's neighbour come into or drop out of the PVS
+    std::vector<int> neighbours;
+    auto collectNeighbours = [&]() {
+        if (m_graph.getNodeCount() != static_cast<int>(m_leaves.size())) return;
+        for (int leafIndex : changedLeaves) {
+            for (const auto &edge : m_graph.getNode(leafIndex).edges) {
+                neighbours.push_back(edge.targetNodeIndex);
+            }
+        }
+    };
+    collectNeighbours();
+    m_graph.relinkLeaves(m_nodes, m_leaves, m_segments, m_nodeBounds, changedLeaves, m_defaultFloorHeight);
+    collectNeighbours();
+
+    if (m_traversalOrderValid) {
+        for (const auto &[regionRoot, ancestors] : regions) {
+            _spliceTraversalOrder(regionRoot, ancestors);
+        }
+    }
+
+    if (m_pvsCluster >= 0) {
+        m_nodeVisibility.resize(m_nodes.size(), 0);
+        for (const auto &[regionRoot, ancestors] : regions) {
+            _refreshVisibility(regionRoot, ancestors);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        std::vector<uint32_t> ancestors;
+        for (int leafIndex : neighbours) {
+            // Found by walking down to the leaf's centre; a sliver too thin for that to land in it invalidates the flags instead
+            if (m_leaves[leafIndex].bounds.size() < 3) continue;
+            TwoHalfD::XYVectorf centre;
+            for (const auto &vertex : m_leaves[leafIndex].bounds) {
+                centre = centre + vertex;
+            }
+            centre = centre * (1.f / m_leaves[leafIndex].bounds.size());
+            ancestors.clear();
+            uint32_t nodeIndex = 0;
+            while (!m_nodes[nodeIndex].isLeaf()) {
+                ancestors.push_back(nodeIndex);
+                nodeIndex = childOnSide(m_nodes[nodeIndex], m_nodes[nodeIndex].isInfront(centre));
+            }
+            if (m_nodes[nodeIndex].leafIndex != leafIndex) {
+                m_pvsCluster = -1;
+                break;
+            }
+            if (m_nodeVisibility[nodeIndex] != _leafVisibility(leafIndex)) _refreshVisibility(nodeIndex, ancestors);
+        }
+    }
+
+    // The tallest wall sets the top of sight, which decides which walls block it everywhere
+    if (m_portals.isBuilt() && wall.wallHeightStart + wall.height >= m_portals.getSightTop()) {
+        m_portals.clear();
+    } else if (m_portals.isBuilt()) {
+        std::vector<uint32_t> regionRoots;
+        for (const auto &[regionRoot, ancestors] : regions) {
+            regionRoots.push_back(regionRoot);
+        }
+        m_portals.update(m_nodes, m_leaves, m_segments, m_nodeBounds, regionRoots, changedLeaves, {wall.start, wall.end, nullptr, nullptr});
+        m_portalNodeFlags.resize(m_nodes.size(), 0);
+    }
+}
+
+// The region's subtree is boxed from scratch, then each static node above it from its children, bottom up
+void TwoHalfD::BSPManager::_refitNodeBounds(uint32_t regionRoot, const std::vector<uint32_t> &ancestors) {
+    _computeNodeBounds(regionRoot);
+    for (auto it = ancestors.rbegin(); it != ancestors.rend(); ++it) {
+        const TwoHalfD::BSPNode &node = m_nodes[*it];
+        TwoHalfD::BSPBounds &bounds = m_nodeBounds[*it];
+        bounds = TwoHalfD::BSPBounds{};
+        if (node.back != BSP_NULL_INDEX) bounds.expand(m_nodeBounds[node.back]);
+        if (node.front != BSP_NULL_INDEX) bounds.expand(m_nodeBounds[node.front]);
+        bounds.expand(m_segments[node.segmentID].v1);
+        bounds.expand(m_segments[node.segmentID].v2);
+    }
+}
+
+// Replaces the region's steps in the cached order with its new subtree's, written for the camera position the rest was written for.
+// The steps after it move by the difference in length; before it, only the Enter steps of the nodes above it jump further.
+void TwoHalfD::BSPManager::_spliceTraversalOrder(uint32_t regionRoot, const std::vector<uint32_t> &ancestors) {
+    m_orderPositions.resize(m_nodes.size(), BSP_NULL_INDEX);
+    m_orderSides.resize(m_nodes.size(), 0);
+    m_orderDueAt.resize(m_nodes.size(), 0.0);
+
+    // The old steps still name the old subtree's nodes, some of which may have been freed; their side checks go stale with them
+    const uint32_t begin = m_orderPositions[regionRoot];
+    const uint32_t oldEnd = m_traversalOrder[begin].kind == TraversalStep::Leaf ? begin + 1 : m_traversalOrder[begin].jump;
+    for (uint32_t i = begin; i < oldEnd; ++i) {
+        const TraversalStep &step = m_traversalOrder[i];
+        if (step.kind != TraversalStep::Enter && step.kind != TraversalStep::Leaf) continue;
+        m_orderPositions[step.nodeIndex] = BSP_NULL_INDEX;
+        m_orderDueAt[step.nodeIndex] = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    uint32_t newLength = 0;
+    std::vector<uint32_t> stack{regionRoot};
+    while (!stack.empty()) {
+        const TwoHalfD::BSPNode &node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (node.isLeaf()) {
+            newLength += 1;
+            continue;
+        }
+        newLength += 3;
+        if (node.front != BSP_NULL_INDEX) stack.push_back(node.front);
+        if (node.back != BSP_NULL_INDEX) stack.push_back(node.back);
+    }
+
+    const int32_t delta = static_cast<int32_t>(newLength) - static_cast<int32_t>(oldEnd - begin);
+    if (delta > 0) {
+        m_traversalOrder.insert(m_traversalOrder.begin() + oldEnd, delta, TraversalStep{});
+    } else if (delta < 0) {
+        m_traversalOrder.erase(m_traversalOrder.begin() + (oldEnd + delta), m_traversalOrder.begin() + oldEnd);
+    }
+    if (delta != 0) {
+        for (size_t i = begin + newLength; i < m_traversalOrder.size(); ++i) {
+            TraversalStep &step = m_traversalOrder[i];
+            if (step.kind == TraversalStep::Enter) {
+                step.jump += delta;
+                m_orderPositions[step.nodeIndex] += delta;
+            } else if (step.kind == TraversalStep::Leaf) {
+                m_orderPositions[step.nodeIndex] += delta;
+            } else if (step.kind == TraversalStep::Exit && step.jump + 1 >= static_cast<int32_t>(oldEnd)) {
+                step.jump += delta; // its Enter came after the region too
+            }
+        }
+        for (uint32_t ancestor : ancestors) {
+            m_traversalOrder[m_orderPositions[ancestor]].jump += delta;
+        }
+    }
+    _writeTraversalOrder(regionRoot, begin, m_orderCameraPos);
+}
+
+// Recomputes the PVS flags below the node and then those of its ancestors (root first), as _markVisibleNodes would have from the root
+void TwoHalfD::BSPManager::_refreshVisibility(uint32_t nodeIndex, const std::vector<uint32_t> &ancestors) {
+    // The lines of ancestors with a visible back that the node lies in front of
+    auto opensLine = [&](size_t i) {
+        const TwoHalfD::BSPNode &ancestor = m_nodes[ancestors[i]];
+        const uint32_t child = i + 1 < ancestors.size() ? ancestors[i + 1] : nodeIndex;
+        return child == ancestor.front && ancestor.back != BSP_NULL_INDEX && (m_nodeVisibility[ancestor.back] & PVS_REGION) != 0;
+    };
+    m_pvsOpenLines.clear();
+    for (size_t i{}; i < ancestors.size(); ++i) {
+        const TwoHalfD::Segment &splitter = m_segments[m_nodes[ancestors[i]].segmentID];
+        if (opensLine(i)) m_pvsOpenLines.push_back({splitter.v1, vectorBetweenPoints(splitter.v1, splitter.v2)});
+    }
+    _markVisibleNodes(nodeIndex);
+
+    for (size_t i = ancestors.size(); i-- > 0;) {
+        const TwoHalfD::BSPNode &ancestor = m_nodes[ancestors[i]];
+        if (opensLine(i)) m_pvsOpenLines.pop_back();
+        uint8_t flags = 0;
+        if (ancestor.back != BSP_NULL_INDEX) flags |= m_nodeVisibility[ancestor.back];
+        if (ancestor.front != BSP_NULL_INDEX) flags |= m_nodeVisibility[ancestor.front];
+        if ((flags & PVS_REGION) == 0 && _liesOnOpenLine(m_segments[ancestor.segmentID])) flags |= PVS_SEGMENT;
+        m_nodeVisibility[ancestors[i]] = flags;
+    }
+}
+
+void TwoHalfD::BSPManager::_resetDynamicState() {
+    m_dynamicWalls.clear();
+    m_dynamicRegions.clear();
+    m_freeNodes.clear();
+    m_freeLeaves.clear();
+    m_freeSegments.clear();
+}
+
+// Walks the wall down the tree exactly like _splitSpace would have sent it, cutting it where it spans a splitter, and splits each leaf
+// a piece lands in. The first leaf reached outside any existing region becomes a new region.
+void TwoHalfD::BSPManager::_insertDynamicSegment(uint32_t nodeIndex, const TwoHalfD::Segment &segment, uint32_t regionRoot,
+                                                 std::vector<int> &changedLeaves, std::vector<uint32_t> &regions, std::vector<uint32_t> &path) {
+    if (regionRoot == BSP_NULL_INDEX && m_dynamicRegions.contains(nodeIndex)) {
+        regionRoot = nodeIndex;
+    }
+
+    if (m_nodes[nodeIndex].isLeaf()) {
+        if (regionRoot == BSP_NULL_INDEX) {
+            const TwoHalfD::BSPLeaf &leaf = m_leaves[m_nodes[nodeIndex].leafIndex];
+            m_dynamicRegions[nodeIndex] =
+                DynamicRegion{leaf.bounds, _cloneFloorSection(leaf.floorSection.get(), leaf.bounds), leaf.pvsCluster, path};
+            regionRoot = nodeIndex;
+        }
+        if (std::find(regions.begin(), regions.end(), regionRoot) == regions.end()) {
+            regions.push_back(regionRoot);
+        }
+        _splitLeaf(nodeIndex, segment, changedLeaves);
+        return;
+    }
+
+    const TwoHalfD::BSPNode node = m_nodes[nodeIndex];
+    const TwoHalfD::Segment &splitter = m_segments[node.segmentID];
+    float numerator = 0.f;
+    float intersection = 0.f;
+    path.push_back(nodeIndex);
+    switch (classifySegment(segment, splitter.v1, vectorBetweenPoints(splitter.v1, splitter.v2), numerator, intersection)) {
+    case SegmentSide::Spanning: {
+        auto [frontPiece, backPiece] = splitSpanningSegment(segment, numerator, intersection);
+        _insertDynamicSegment(childOnSide(node, true), frontPiece, regionRoot, changedLeaves, regions, path);
+        _insertDynamicSegment(childOnSide(node, false), backPiece, regionRoot, changedLeaves, regions, path);
+        break;
+    }
+    case SegmentSide::Front:
+        _insertDynamicSegment(childOnSide(node, true), segment, regionRoot, changedLeaves, regions, path);
+        break;
+    case SegmentSide::Back:
+        _insertDynamicSegment(childOnSide(node, false), segment, regionRoot, changedLeaves, regions, path);
+        break;
+    }
+    path.pop_back();
+}
+
+// Turns a leaf into an internal node split by segment with two new leaves below it. The back leaf reuses the old leaf's index; sprites,
+// effects and overlays are handed to whichever side they now fall on.
+//
+// A wall along the leaf's edge, like a door in a doorway on its wall's line, would leave one side with no area. The leaf then goes under
+// the new node unchanged on the side it is on and the other side is left empty (BSP_NULL_INDEX).
+void TwoHalfD::BSPManager::_splitLeaf(uint32_t nodeIndex, const TwoHalfD::Segment &segment, std::vector<int> &changedLeaves) {
+    const TwoHalfD::XYVectorf splitterVec = vectorBetweenPoints(segment.v1, segment.v2);
+    TwoHalfD::BSPNode splitNode;
+    splitNode.normal = TwoHalfD::XYVectorf{-splitterVec.y, splitterVec.x}.normalized();
+    splitNode.offset = dotProduct(splitNode.normal, segment.v1);
+
+    const int backLeafIndex = m_nodes[nodeIndex].leafIndex;
+    bool anyFront = false, anyBack = false;
+    for (const auto &vertex : m_leaves[backLeafIndex].bounds) {
+        const float distance = splitNode.signedDistance(vertex);
+        if (distance > TwoHalfD::BSP_EPSILON) anyFront = true;
+        else if (distance < -TwoHalfD::BSP_EPSILON) anyBack = true;
+    }
+    if (!anyFront || !anyBack) {
+        const uint32_t leafNodeIndex = _allocateNode();
+        m_nodes[leafNodeIndex] = TwoHalfD::BSPNode{};
+        m_nodes[leafNodeIndex].leafIndex = backLeafIndex;
+        splitNode.front = anyFront ? leafNodeIndex : BSP_NULL_INDEX;
+        splitNode.back = anyFront ? BSP_NULL_INDEX : leafNodeIndex;
+        splitNode.segmentID = _allocateSegment(segment);
+        m_nodes[nodeIndex] = splitNode;
+        changedLeaves.push_back(backLeafIndex); // the wall may close portals along its edge
+        return;
+    }
+
+    const int frontLeafIndex = _allocateLeaf();
+    const uint32_t backNodeIndex = _allocateNode();
+    const uint32_t frontNodeIndex = _allocateNode();
+
+    TwoHalfD::BSPLeaf oldLeaf = std::move(m_leaves[backLeafIndex]);
+    auto [frontBounds, backBounds] = _splitConvexShape(oldLeaf.bounds, segment);
+
+    splitNode.front = frontNodeIndex;
+    splitNode.back = backNodeIndex;
+    splitNode.segmentID = _allocateSegment(segment);
+    m_nodes[nodeIndex] = splitNode;
+
+    m_nodes[frontNodeIndex] = TwoHalfD::BSPNode{};
+    m_nodes[frontNodeIndex].leafIndex = frontLeafIndex;
+    m_nodes[backNodeIndex] = TwoHalfD::BSPNode{};
+    m_nodes[backNodeIndex].leafIndex = backLeafIndex;
+
+    TwoHalfD::BSPLeaf &frontLeaf = m_leaves[frontLeafIndex];
+    TwoHalfD::BSPLeaf &backLeaf = m_leaves[backLeafIndex];
+    frontLeaf = TwoHalfD::BSPLeaf{};
+    backLeaf = TwoHalfD::BSPLeaf{};
+    frontLeaf.floorSection = _cloneFloorSection(oldLeaf.floorSection.get(), frontBounds);
+    backLeaf.floorSection = _cloneFloorSection(oldLeaf.floorSection.get(), backBounds);
+    frontLeaf.bounds = std::move(frontBounds);
+    backLeaf.bounds = std::move(backBounds);
+    frontLeaf.pvsCluster = oldLeaf.pvsCluster;
+    backLeaf.pvsCluster = oldLeaf.pvsCluster;
+
+    for (const auto &billboard : oldLeaf.billboards) {
+        const bool inFront = splitNode.isInfront(billboard.pos);
+        auto &billboards = (inFront ? frontLeaf : backLeaf).billboards;
+        m_billboardSlots[billboard.handle] = {inFront ? frontLeafIndex : backLeafIndex, static_cast<uint32_t>(billboards.size())};
+        billboards.push_back(billboard);
+    }
+    for (const auto &overlay : oldLeaf.colourOverlays) {
+        bool overlayFront = false, overlayBack = false;
+        for (const auto &v : overlay.vertices) {
+            if (splitNode.isInfront(v)) overlayFront = true;
+            else overlayBack = true;
+        }
+        if (overlayFront && overlayBack) {
+            auto [frontPoly, backPoly] = _splitConvexShape(overlay.vertices, segment);
+            if (frontPoly.size() >= 3) frontLeaf.colourOverlays.push_back({frontPoly, overlay.id, overlay.height, overlay.r, overlay.g, overlay.b, overlay.a});
+            if (backPoly.size() >= 3) backLeaf.colourOverlays.push_back({backPoly, overlay.id, overlay.height, overlay.r, overlay.g, overlay.b, overlay.a});
+        } else {
+            (overlayFront ? frontLeaf : backLeaf).colourOverlays.push_back(overlay);
+        }
+    }
+    // Only the leaves that ended up with a piece of an overlay are listed for it
+    auto holdsOverlay = [](const TwoHalfD::BSPLeaf &leaf, int id) {
+        return std::any_of(leaf.colourOverlays.begin(), leaf.colourOverlays.end(), [id](const FloorColourOverlay &o) { return o.id == id; });
+    };
+    for (const auto &overlay : oldLeaf.colourOverlays) {
+        auto &overlayLeaves = m_overlayLeafMap[overlay.id];
+        std::erase(overlayLeaves, backLeafIndex);
+        std::erase(overlayLeaves, frontLeafIndex);
+        if (holdsOverlay(backLeaf, overlay.id)) overlayLeaves.push_back(backLeafIndex);
+        if (holdsOverlay(frontLeaf, overlay.id)) overlayLeaves.push_back(frontLeafIndex);
+    }
+
+    changedLeaves.push_back(backLeafIndex);
+    changedLeaves.push_back(frontLeafIndex);
+}
+
+// Throws away everything below a region root and re-inserts the region's remaining dynamic wall pieces into its original leaf, then
+// re-links the sprites, effects and overlays that lived there.
+void TwoHalfD::BSPManager::_rebuildRegion(uint32_t regionRoot, const Wall *removedWall, std::vector<int> &changedLeaves) {
+    auto regionIt = m_dynamicRegions.find(regionRoot);
+    if (regionIt == m_dynamicRegions.end()) return;
+
+    std::vector<TwoHalfD::Segment> keptSegments;
+    std::vector<TwoHalfD::BSPLeafBillboard> billboards;
+    std::vector<TwoHalfD::FloorColourOverlay> overlays;
+    std::vector<int> freedLeaves;
+
+    // Pre-order, so pieces are re-inserted parent first and no piece gets cut by one that used to sit below it
+    std::vector<uint32_t> stack{regionRoot};
+    while (!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        const TwoHalfD::BSPNode node = m_nodes[nodeIndex];
+
+        if (node.isLeaf()) {
+            TwoHalfD::BSPLeaf &leaf = m_leaves[node.leafIndex];
+            billboards.insert(billboards.end(), leaf.billboards.begin(), leaf.billboards.end());
+            overlays.insert(overlays.end(), leaf.colourOverlays.begin(), leaf.colourOverlays.end());
+            leaf = TwoHalfD::BSPLeaf{};
+            m_freeLeaves.push_back(node.leafIndex);
+            freedLeaves.push_back(node.leafIndex);
+            changedLeaves.push_back(node.leafIndex);
+        } else {
+            TwoHalfD::Segment &segment = m_segments[node.segmentID];
+            if (segment.wall != removedWall) keptSegments.push_back(segment);
+            segment = TwoHalfD::Segment{{}, {}, nullptr, nullptr, 0.f, 0.f};
+            m_freeSegments.push_back(node.segmentID);
+            if (node.front != BSP_NULL_INDEX) stack.push_back(node.front);
+            if (node.back != BSP_NULL_INDEX) stack.push_back(node.back);
+        }
+        if (nodeIndex != regionRoot) {
+            m_nodes[nodeIndex] = TwoHalfD::BSPNode{};
+            m_freeNodes.push_back(nodeIndex);
+        }
+    }
+
+    const int rootLeafIndex = _allocateLeaf();
+    m_nodes[regionRoot] = TwoHalfD::BSPNode{};
+    m_nodes[regionRoot].leafIndex = rootLeafIndex;
+    m_leaves[rootLeafIndex] = TwoHalfD::BSPLeaf{};
+    m_leaves[rootLeafIndex].bounds = regionIt->second.bounds;
+    m_leaves[rootLeafIndex].floorSection = _cloneFloorSection(regionIt->second.floorSection.get(), regionIt->second.bounds);
+    m_leaves[rootLeafIndex].pvsCluster = regionIt->second.pvsCluster;
+    changedLeaves.push_back(rootLeafIndex);
+
+    if (keptSegments.empty()) {
+        m_dynamicRegions.erase(regionIt);
+    } else {
+        std::vector<uint32_t> regions;
+        std::vector<uint32_t> path;
+        for (const auto &segment : keptSegments) {
+            _insertDynamicSegment(regionRoot, segment, regionRoot, changedLeaves, regions, path);
+        }
+    }
+
+    for (const auto &billboard : billboards) {
+        m_billboardSlots[billboard.handle] = BillboardSlot{};
+        _linkBillboard(billboard, _findLeaf(billboard.pos));
+    }
+    for (const auto &overlay : overlays) {
+        auto &overlayLeaves = m_overlayLeafMap[overlay.id];
+        std::erase_if(overlayLeaves, [&](int leafIndex) { return std::find(freedLeaves.begin(), freedLeaves.end(), leafIndex) != freedLeaves.end(); });
+    }
+    for (const auto &overlay : overlays) {
+        _insertColourOverlayTriangle(regionRoot, overlay.vertices, overlay.id, overlay.height, overlay.r, overlay.g, overlay.b, overlay.a);
+    }
+}
+
+uint32_t TwoHalfD::BSPManager::_allocateNode() {
+    if (!m_freeNodes.empty()) {
+        uint32_t nodeIndex = m_freeNodes.back();
+        m_freeNodes.pop_back();
+        return nodeIndex;
+    }
+    m_nodes.emplace_back();
+    return static_cast<uint32_t>(m_nodes.size() - 1);
+}
+
+int TwoHalfD::BSPManager::_allocateLeaf() {
+    if (!m_freeLeaves.empty()) {
+        int leafIndex = m_freeLeaves.back();
+        m_freeLeaves.pop_back();
+        return leafIndex;
+    }
+    m_leaves.emplace_back();
+    return static_cast<int>(m_leaves.size() - 1);
+}
+
+int TwoHalfD::BSPManager::_allocateSegment(const TwoHalfD::Segment &segment) {
+    if (!m_freeSegments.empty()) {
+        int segmentID = m_freeSegments.back();
+        m_freeSegments.pop_back();
+        m_segments[segmentID] = segment;
+        return segmentID;
+    }
+    m_segments.push_back(segment);
+    m_segmentID = m_segments.size();
+    return static_cast<int>(m_segments.size() - 1);
+}
+
+std::unique_ptr<TwoHalfD::FloorSection> TwoHalfD::BSPManager::_cloneFloorSection(const FloorSection *floorSection, const Polygon &bounds) {
+    if (floorSection == nullptr) return nullptr;
+    auto clone = std::make_unique<TwoHalfD::FloorSection>(*floorSection);
+    clone->vertices = bounds;
+    return clone;
 }
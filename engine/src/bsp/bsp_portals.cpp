@@ -0,0 +1,356 @@
+#include "TwoHalfD/bsp/bsp_portals.h"
+#include "TwoHalfD/bsp/bsp_lines.h"
+#include "TwoHalfD/utils/math_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <unordered_map>
+
+namespace {
+constexpr float PORTAL_EPSILON = 0.01f;
+// A camera this close to a piece sees through it with its whole window, since the angles it subtends are meaningless
+constexpr float ON_LINE_DISTANCE = 1.f;
+
+TwoHalfD::XYVectorf centroidOf(const TwoHalfD::Polygon &bounds) {
+    TwoHalfD::XYVectorf centroid;
+    for (const auto &vertex : bounds) {
+        centroid = centroid + vertex;
+    }
+    return bounds.empty() ? centroid : centroid * (1.f / bounds.size());
+}
+
+template <typename Piece>
+void addPiece(std::vector<Piece> &pieces, const TwoHalfD::XYVectorf &centroid, TwoHalfD::XYVectorf a, TwoHalfD::XYVectorf b, int targetLeaf,
+              int segmentID) {
+    if (crossProduct2d(b - a, centroid - a) < 0.f) std::swap(a, b);
+    pieces.push_back({a, b, targetLeaf, segmentID});
+}
+
+// Cuts the overlap into pieces at the segments lying on its line and hands each to add, with segment -1 for the open stretches
+template <typename AddBothWays>
+void cutOverlap(const TwoHalfD::SplitterLine &splitterLine, const TwoHalfD::LineOverlap &overlap, AddBothWays &&add) {
+    const TwoHalfD::BSPLine &line = splitterLine.line;
+    auto addStretch = [&](float a, float b, int segmentID) { add(line.p0 + line.dir * a, line.p0 + line.dir * b, segmentID); };
+    float cursor = overlap.tMin;
+    for (const TwoHalfD::LineSegment &lineSegment : splitterLine.segments) {
+        const float start = std::max(overlap.tMin, lineSegment.tMin);
+        const float end = std::min(overlap.tMax, lineSegment.tMax);
+        if (end - start <= PORTAL_EPSILON) continue;
+        addStretch(start, end, lineSegment.segmentID);
+        if (start > cursor + PORTAL_EPSILON) addStretch(cursor, start, -1);
+        cursor = std::max(cursor, end);
+    }
+    if (cursor < overlap.tMax - PORTAL_EPSILON) addStretch(cursor, overlap.tMax, -1);
+}
+} // namespace
+
+void TwoHalfD::BSPPortals::build(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                                 const std::vector<BSPBounds> &nodeBounds, float sightBottom, float sightTop) {
+    clear();
+    m_built = true;
+    m_sightBottom = sightBottom;
+    m_sightTop = sightTop;
+    m_leafNodes.assign(leaves.size(), BSP_NULL_INDEX);
+    m_segmentNodes.assign(segments.size(), BSP_NULL_INDEX);
+    m_nodeParents.assign(nodes.size(), BSP_NULL_INDEX);
+    m_leafStates.assign(leaves.size(), LeafState{});
+    m_segmentStamps.assign(segments.size(), 0);
+    m_pieceRanges.assign(leaves.size(), PieceRange{});
+    if (nodes.empty()) return;
+
+    std::vector<uint32_t> internalNodes;
+    _linkNodes(nodes, 0, &internalNodes);
+
+    std::vector<XYVectorf> centroids(leaves.size());
+    for (size_t i{}; i < leaves.size(); ++i) {
+        centroids[i] = centroidOf(leaves[i].bounds);
+    }
+
+    // Leaves are paired across each splitter by collectSplitterLine, as for BSPGraph edges
+    std::vector<std::vector<Piece>> leafPieces(leaves.size());
+    SplitterLine splitterLine;
+    for (uint32_t nodeIndex : internalNodes) {
+        if (!collectSplitterLine(nodes, leaves, segments, nodeBounds, nodeIndex, splitterLine)) continue;
+        for (const LineOverlap &overlap : splitterLine.overlaps) {
+            cutOverlap(splitterLine, overlap, [&](const XYVectorf &p0, const XYVectorf &p1, int segmentID) {
+                addPiece(leafPieces[overlap.frontLeaf], centroids[overlap.frontLeaf], p0, p1, overlap.backLeaf, segmentID);
+                addPiece(leafPieces[overlap.backLeaf], centroids[overlap.backLeaf], p0, p1, overlap.frontLeaf, segmentID);
+            });
+        }
+    }
+
+    for (size_t i{}; i < leafPieces.size(); ++i) {
+        m_pieceRanges[i] = {static_cast<uint32_t>(m_pieces.size()), static_cast<uint32_t>(leafPieces[i].size())};
+        m_pieces.insert(m_pieces.end(), leafPieces[i].begin(), leafPieces[i].end());
+    }
+}
+
+void TwoHalfD::BSPPortals::update(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                                  const std::vector<BSPBounds> &nodeBounds, const std::vector<uint32_t> &regionRoots,
+                                  const std::vector<int> &changedLeaves, const Segment &wall) {
+    if (!m_built) return;
+    m_leafNodes.resize(leaves.size(), BSP_NULL_INDEX);
+    m_segmentNodes.resize(segments.size(), BSP_NULL_INDEX);
+    m_nodeParents.resize(nodes.size(), BSP_NULL_INDEX);
+    m_leafStates.resize(leaves.size());
+    m_segmentStamps.resize(segments.size(), 0);
+    m_pieceRanges.resize(leaves.size());
+
+    // A changed leaf lies on the lines of splitters below its region and of those above it. Of the latter only the stretch alongside
+    // the regions below them is looked at, and each is looked at once even when several regions lie below it.
+    std::vector<uint32_t> internalNodes;
+    std::vector<std::pair<uint32_t, BSPBounds>> ancestors;
+    for (uint32_t regionRoot : regionRoots) {
+        _linkNodes(nodes, regionRoot, &internalNodes);
+        for (uint32_t parent = m_nodeParents[regionRoot]; parent != BSP_NULL_INDEX; parent = m_nodeParents[parent]) {
+            ancestors.push_back({parent, nodeBounds[regionRoot]});
+        }
+    }
+    std::sort(ancestors.begin(), ancestors.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    std::vector<std::pair<uint32_t, BSPBounds>> mergedAncestors;
+    for (const auto &[nodeIndex, bounds] : ancestors) {
+        if (mergedAncestors.empty() || mergedAncestors.back().first != nodeIndex) {
+            mergedAncestors.push_back({nodeIndex, bounds});
+        } else {
+            mergedAncestors.back().second.expand(bounds);
+        }
+    }
+
+    std::vector<int> changed = changedLeaves;
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    auto isChanged = [&](int leafIndex) { return std::binary_search(changed.begin(), changed.end(), leafIndex); };
+
+    // Leaves whose pieces are cut again start from their old ones minus any across a changed leaf; the changed leaves start empty
+    std::unordered_map<int, std::vector<Piece>> leafPieces;
+    auto piecesOf = [&](int leafIndex) -> std::vector<Piece> & {
+        auto [it, inserted] = leafPieces.try_emplace(leafIndex);
+        if (inserted && !isChanged(leafIndex)) {
+            const PieceRange range = m_pieceRanges[leafIndex];
+            for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+                if (m_pieces[i].targetLeaf < 0 || !isChanged(m_pieces[i].targetLeaf)) it->second.push_back(m_pieces[i]);
+            }
+        }
+        return it->second;
+    };
+    for (int leafIndex : changed) {
+        piecesOf(leafIndex);
+        const PieceRange range = m_pieceRanges[leafIndex];
+        for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+            if (m_pieces[i].targetLeaf >= 0 && !isChanged(m_pieces[i].targetLeaf)) piecesOf(m_pieces[i].targetLeaf);
+        }
+    }
+
+    // The wall lying on an ancestor's line changes the pieces between leaves on either side of it too, changed or not. That line is
+    // looked at whole, and the pieces between such leaves are cut again where they meet the wall.
+    auto wallOnLine = [&](uint32_t nodeIndex) {
+        const Segment &splitter = segments[nodes[nodeIndex].segmentID];
+        const XYVectorf dir = (splitter.v2 - splitter.v1).normalized();
+        return std::abs(crossProduct2d(wall.v1 - splitter.v1, dir)) < PORTAL_EPSILON &&
+               std::abs(crossProduct2d(wall.v2 - splitter.v1, dir)) < PORTAL_EPSILON;
+    };
+
+    SplitterLine splitterLine;
+    auto addOverlaps = [&](uint32_t nodeIndex, const BSPBounds *within, bool alongWall) {
+        if (!collectSplitterLine(nodes, leaves, segments, nodeBounds, nodeIndex, splitterLine, within)) return;
+        const BSPLine &line = splitterLine.line;
+        const float wallT1 = dotProduct(wall.v1 - line.p0, line.dir);
+        const float wallT2 = dotProduct(wall.v2 - line.p0, line.dir);
+        for (const LineOverlap &overlap : splitterLine.overlaps) {
+            std::vector<Piece> *frontPieces = nullptr;
+            std::vector<Piece> *backPieces = nullptr;
+            if (isChanged(overlap.frontLeaf) || isChanged(overlap.backLeaf)) {
+                frontPieces = &piecesOf(overlap.frontLeaf);
+                backPieces = &piecesOf(overlap.backLeaf);
+            } else if (alongWall && overlap.tMax > std::min(wallT1, wallT2) + PORTAL_EPSILON &&
+                       overlap.tMin < std::max(wallT1, wallT2) - PORTAL_EPSILON) {
+                // Two convex leaves meet on one line at most, so every old piece between them is from this one
+                frontPieces = &piecesOf(overlap.frontLeaf);
+                backPieces = &piecesOf(overlap.backLeaf);
+                std::erase_if(*frontPieces, [&](const Piece &piece) { return piece.targetLeaf == overlap.backLeaf; });
+                std::erase_if(*backPieces, [&](const Piece &piece) { return piece.targetLeaf == overlap.frontLeaf; });
+            } else {
+                continue;
+            }
+            const XYVectorf frontCentroid = centroidOf(leaves[overlap.frontLeaf].bounds);
+            const XYVectorf backCentroid = centroidOf(leaves[overlap.backLeaf].bounds);
+            cutOverlap(splitterLine, overlap, [&](const XYVectorf &p0, const XYVectorf &p1, int segmentID) {
+                addPiece(*frontPieces, frontCentroid, p0, p1, overlap.backLeaf, segmentID);
+                addPiece(*backPieces, backCentroid, p0, p1, overlap.frontLeaf, segmentID);
+            });
+        }
+    };
+    for (const auto &[nodeIndex, bounds] : mergedAncestors) {
+        const bool alongWall = wallOnLine(nodeIndex);
+        addOverlaps(nodeIndex, alongWall ? nullptr : &bounds, alongWall);
+    }
+    for (uint32_t nodeIndex : internalNodes) {
+        addOverlaps(nodeIndex, nullptr, false);
+    }
+
+    // Rewritten leaves get their pieces appended; the old ones are left where they were until they make up most of the array
+    for (const auto &[leafIndex, pieces] : leafPieces) {
+        m_deadPieces += m_pieceRanges[leafIndex].count;
+        m_pieceRanges[leafIndex] = {static_cast<uint32_t>(m_pieces.size()), static_cast<uint32_t>(pieces.size())};
+        m_pieces.insert(m_pieces.end(), pieces.begin(), pieces.end());
+    }
+    if (m_deadPieces > m_pieces.size() / 2) {
+        std::vector<Piece> live;
+        live.reserve(m_pieces.size() - m_deadPieces);
+        for (PieceRange &range : m_pieceRanges) {
+            const uint32_t first = static_cast<uint32_t>(live.size());
+            live.insert(live.end(), m_pieces.begin() + range.first, m_pieces.begin() + range.first + range.count);
+            range.first = first;
+        }
+        m_pieces = std::move(live);
+        m_deadPieces = 0;
+    }
+}
+
+// Links the nodes below rootIndex to their parents, leaves and segments, listing the internal ones if asked
+void TwoHalfD::BSPPortals::_linkNodes(const std::vector<BSPNode> &nodes, uint32_t rootIndex, std::vector<uint32_t> *internalNodes) {
+    // Walk down rather than over the node array, which may hold nodes freed by dynamic walls
+    std::vector<uint32_t> stack{rootIndex};
+    while (!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        const BSPNode &node = nodes[nodeIndex];
+        if (node.isLeaf()) {
+            m_leafNodes[node.leafIndex] = nodeIndex;
+            continue;
+        }
+        if (internalNodes != nullptr) internalNodes->push_back(nodeIndex);
+        m_segmentNodes[node.segmentID] = nodeIndex;
+        for (uint32_t child : {node.front, node.back}) {
+            if (child == BSP_NULL_INDEX) continue;
+            m_nodeParents[child] = nodeIndex;
+            stack.push_back(child);
+        }
+    }
+}
+
+void TwoHalfD::BSPPortals::clear() {
+    m_built = false;
+    m_pieceRanges.clear();
+    m_pieces.clear();
+    m_deadPieces = 0;
+    m_leafNodes.clear();
+    m_segmentNodes.clear();
+    m_nodeParents.clear();
+    m_leafStates.clear();
+    m_segmentStamps.clear();
+    m_visibleLeaves.clear();
+    m_neighbourLeaves.clear();
+    m_visibleSegments.clear();
+    m_windows.clear();
+    m_stamp = 0;
+}
+
+bool TwoHalfD::BSPPortals::flood(int startLeaf, const XYVectorf &cameraPos, float cameraDirection, float eyeHeight, float windowMin,
+                                 float windowMax, const std::vector<Segment> &segments) {
+    if (++m_stamp == 0) {
+        m_leafStates.assign(m_leafStates.size(), LeafState{});
+        m_segmentStamps.assign(m_segmentStamps.size(), 0);
+        m_stamp = 1;
+    }
+    m_visibleLeaves.clear();
+    m_neighbourLeaves.clear();
+    m_visibleSegments.clear();
+    m_windows.clear();
+    m_cameraPos = cameraPos;
+    m_direction = {std::cos(cameraDirection), std::sin(cameraDirection)};
+    m_eyeHeight = eyeHeight;
+    m_steps = 0;
+    // Open areas split into many small leaves can reach a leaf through many windows; past this the caller is better off with the tree
+    m_stepBudget = 16 * m_leafStates.size() + 1024;
+    if (startLeaf < 0 || startLeaf >= static_cast<int>(m_leafStates.size())) return false;
+    return _flood(startLeaf, windowMin, windowMax, segments);
+}
+
+// A leaf is flooded again only with a window that is not inside one it has already been flooded with
+bool TwoHalfD::BSPPortals::_flood(int leaf, float windowMin, float windowMax, const std::vector<Segment> &segments) {
+    if (++m_steps > m_stepBudget) return false;
+
+    LeafState &state = m_leafStates[leaf];
+    if (state.visibleStamp != m_stamp) {
+        state.visibleStamp = m_stamp;
+        state.firstWindow = -1;
+        m_visibleLeaves.push_back(leaf);
+    }
+    for (int i = state.firstWindow; i != -1; i = m_windows[i].next) {
+        if (windowMin >= m_windows[i].min && windowMax <= m_windows[i].max) return true;
+    }
+    m_windows.push_back({windowMin, windowMax, state.firstWindow});
+    state.firstWindow = static_cast<int>(m_windows.size()) - 1;
+
+    const PieceRange range = m_pieceRanges[leaf];
+    for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+        const Piece &piece = m_pieces[i];
+        if (piece.targetLeaf >= 0 && m_leafStates[piece.targetLeaf].neighbourStamp != m_stamp) {
+            m_leafStates[piece.targetLeaf].neighbourStamp = m_stamp;
+            m_neighbourLeaves.push_back(piece.targetLeaf);
+        }
+
+        float clippedMin, clippedMax;
+        if (!_clipToWindow(piece, windowMin, windowMax, clippedMin, clippedMax)) continue;
+        if (piece.segmentID >= 0 && m_segmentStamps[piece.segmentID] != m_stamp) {
+            m_segmentStamps[piece.segmentID] = m_stamp;
+            m_visibleSegments.push_back(piece.segmentID);
+        }
+        if (piece.targetLeaf < 0 || (piece.segmentID >= 0 && _blocksSight(segments[piece.segmentID]))) continue;
+        if (!_flood(piece.targetLeaf, clippedMin, clippedMax, segments)) return false;
+    }
+    return true;
+}
+
+// Narrows the window to the angles the piece covers, if the camera is on the leaf's side of it
+bool TwoHalfD::BSPPortals::_clipToWindow(const Piece &piece, float windowMin, float windowMax, float &clippedMin, float &clippedMax) const {
+    const XYVectorf edge = piece.v2 - piece.v1;
+    const float length = edge.length();
+    if (length < PORTAL_EPSILON) return false;
+    const float side = crossProduct2d(edge, m_cameraPos - piece.v1) / length;
+    if (side < -ON_LINE_DISTANCE) return false;
+    if (side < ON_LINE_DISTANCE) {
+        const float t = dotProduct(m_cameraPos - piece.v1, edge) / length;
+        if (t > -ON_LINE_DISTANCE && t < length + ON_LINE_DISTANCE) {
+            clippedMin = windowMin;
+            clippedMax = windowMax;
+            return true;
+        }
+    }
+
+    float angle1 = _angleOf(piece.v1);
+    float angle2 = _angleOf(piece.v2);
+    if (angle1 > angle2) std::swap(angle1, angle2);
+    if (angle2 - angle1 <= std::numbers::pi_v<float>) {
+        clippedMin = std::max(windowMin, angle1);
+        clippedMax = std::min(windowMax, angle2);
+        return clippedMin < clippedMax;
+    }
+
+    // The piece passes behind the camera, covering [angle2, pi] and [-pi, angle1]; keep the hull of what is left of each
+    clippedMin = std::numeric_limits<float>::max();
+    clippedMax = std::numeric_limits<float>::lowest();
+    if (windowMax > angle2) {
+        clippedMin = std::max(windowMin, angle2);
+        clippedMax = windowMax;
+    }
+    if (windowMin < angle1) {
+        clippedMin = windowMin;
+        clippedMax = std::max(clippedMax, std::min(windowMax, angle1));
+    }
+    return clippedMin < clippedMax;
+}
+
+bool TwoHalfD::BSPPortals::_blocksSight(const Segment &segment) const {
+    return segment.isWall() && segment.wall->wallHeightStart <= m_sightBottom &&
+           segment.wall->wallHeightStart + segment.wall->height >= std::max(m_sightTop, m_eyeHeight);
+}
+
+// Angle of the point seen from the camera, relative to the view direction, in [-pi, pi]
+float TwoHalfD::BSPPortals::_angleOf(const XYVectorf &point) const {
+    const XYVectorf toPoint = point - m_cameraPos;
+    return std::atan2(crossProduct2d(m_direction, toPoint), dotProduct(m_direction, toPoint));
+}
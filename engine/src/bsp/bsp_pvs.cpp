@@ -0,0 +1,252 @@
+#include "TwoHalfD/bsp/bsp_pvs.h"
+#include "TwoHalfD/bsp/bsp_lines.h"
+#include "TwoHalfD/utils/math_util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace {
+constexpr float PVS_EPSILON = 0.01f;
+// Flow steps one cluster may take before it gives up and marks everything connected to it instead. Open areas split into many small
+// leaves are where portal flow blows up, and those tend to see most of their surroundings anyway.
+constexpr size_t FLOW_STEP_BUDGET = 1 << 16;
+constexpr size_t FLOW_MAX_DEPTH = 512;
+
+bool blocksSight(const TwoHalfD::Segment &segment, float sightBottom, float sightTop) {
+    return segment.isWall() && segment.wall->wallHeightStart <= sightBottom && segment.wall->wallHeightStart + segment.wall->height >= sightTop;
+}
+
+// Cuts the target segment down to the part that can be seen from some point of source through pass. In 2D that region is bounded by
+// the separating lines from each source endpoint through the opposite pass endpoint. Returns false when nothing is left.
+bool clipToAntipenumbra(const TwoHalfD::XYVectorf &source0, const TwoHalfD::XYVectorf &source1, const TwoHalfD::XYVectorf &pass0,
+                        const TwoHalfD::XYVectorf &pass1, TwoHalfD::XYVectorf &target0, TwoHalfD::XYVectorf &target1) {
+    const bool pointSource = (source1 - source0).length() < PVS_EPSILON;
+    const TwoHalfD::XYVectorf sources[2] = {source0, source1};
+    const TwoHalfD::XYVectorf passes[2] = {pass0, pass1};
+
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            const TwoHalfD::XYVectorf &s = sources[i];
+            const TwoHalfD::XYVectorf &p = passes[j];
+            const TwoHalfD::XYVectorf dir = p - s;
+            const float length = dir.length();
+            if (length < PVS_EPSILON) continue;
+            const TwoHalfD::XYVectorf normal{-dir.y / length, dir.x / length};
+
+            // A separator has the rest of the source and the rest of the pass portal on opposite sides
+            const float passSide = dotProduct(normal, passes[1 - j] - s);
+            if (std::abs(passSide) < PVS_EPSILON) continue;
+            if (!pointSource) {
+                const float sourceSide = dotProduct(normal, sources[1 - i] - s);
+                if (std::abs(sourceSide) < PVS_EPSILON || (sourceSide < 0.f) == (passSide < 0.f)) continue;
+            }
+
+            const float sign = passSide > 0.f ? 1.f : -1.f;
+            const float d0 = sign * dotProduct(normal, target0 - s);
+            const float d1 = sign * dotProduct(normal, target1 - s);
+            if (d0 < -PVS_EPSILON && d1 < -PVS_EPSILON) return false;
+            if (d0 < -PVS_EPSILON) {
+                target0 = target0 + (d0 / (d0 - d1)) * (target1 - target0);
+            } else if (d1 < -PVS_EPSILON) {
+                target1 = target1 + (d1 / (d1 - d0)) * (target0 - target1);
+            }
+        }
+    }
+    return (target1 - target0).length() > PVS_EPSILON;
+}
+
+void setBit(std::vector<uint64_t> &bits, int index) {
+    bits[index >> 6] |= uint64_t{1} << (index & 63);
+}
+} // namespace
+
+void TwoHalfD::BSPPVS::build(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                             const std::vector<BSPBounds> &nodeBounds, float sightBottom, float sightTop) {
+    clear();
+    const bool anyBlocker = std::any_of(segments.begin(), segments.end(), [&](const Segment &s) { return blocksSight(s, sightBottom, sightTop); });
+    if (!anyBlocker || leaves.empty()) {
+        std::cout << "PVS skipped: no wall blocks sight" << std::endl;
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    _collectPortals(nodes, leaves, segments, nodeBounds, sightBottom, sightTop);
+
+    const int clusterCount = static_cast<int>(leaves.size());
+    m_clusterCount = clusterCount;
+    std::vector<std::vector<uint8_t>> rows(clusterCount);
+    std::atomic<int> nextCluster{0};
+    std::atomic<int> overBudget{0};
+    auto worker = [&]() {
+        FlowScratch scratch;
+        for (int cluster = nextCluster++; cluster < clusterCount; cluster = nextCluster++) {
+            _computeRow(cluster, scratch, rows[cluster]);
+            if (scratch.overBudget) ++overBudget;
+        }
+    };
+    const unsigned int threadCount = std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<unsigned int>(clusterCount));
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    m_rowOffsets.reserve(clusterCount + 1);
+    for (const auto &row : rows) {
+        m_rowOffsets.push_back(static_cast<uint32_t>(m_rows.size()));
+        m_rows.insert(m_rows.end(), row.begin(), row.end());
+    }
+    m_rowOffsets.push_back(static_cast<uint32_t>(m_rows.size()));
+    m_portals.clear();
+    m_portals.shrink_to_fit();
+
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "PVS built for " << clusterCount << " clusters in " << ms << " ms (" << m_rows.size() << " bytes, " << overBudget
+              << " clusters over the flow budget)" << std::endl;
+}
+
+void TwoHalfD::BSPPVS::clear() {
+    m_clusterCount = 0;
+    m_rowOffsets.clear();
+    m_rows.clear();
+    m_portals.clear();
+}
+
+void TwoHalfD::BSPPVS::decompressRow(int cluster, std::vector<uint8_t> &out) const {
+    out.assign((m_clusterCount + 7) / 8, 0);
+    size_t outIndex = 0;
+    for (uint32_t i = m_rowOffsets[cluster]; i < m_rowOffsets[cluster + 1] && outIndex < out.size(); ++i) {
+        if (m_rows[i] != 0) {
+            out[outIndex++] = m_rows[i];
+        } else if (++i < m_rowOffsets[cluster + 1]) {
+            outIndex += m_rows[i];
+        }
+    }
+}
+
+// Leaves are paired across each splitter by collectSplitterLine, as for BSPGraph edges, but only walls that block sight close a portal
+void TwoHalfD::BSPPVS::_collectPortals(const std::vector<BSPNode> &nodes, const std::vector<BSPLeaf> &leaves, const std::vector<Segment> &segments,
+                                       const std::vector<BSPBounds> &nodeBounds, float sightBottom, float sightTop) {
+    m_portals.assign(leaves.size(), {});
+    SplitterLine splitterLine;
+    std::vector<LineSegment> blockers;
+    std::vector<std::pair<float, float>> openings;
+
+    for (uint32_t nodeIndex{}; nodeIndex < nodes.size(); ++nodeIndex) {
+        if (nodes[nodeIndex].isLeaf() || nodes[nodeIndex].segmentID < 0) continue;
+        if (!collectSplitterLine(nodes, leaves, segments, nodeBounds, nodeIndex, splitterLine)) continue;
+        const BSPLine &line = splitterLine.line;
+        blockers.clear();
+        for (const LineSegment &lineSegment : splitterLine.segments) {
+            if (blocksSight(segments[lineSegment.segmentID], sightBottom, sightTop)) blockers.push_back(lineSegment);
+        }
+
+        for (const LineOverlap &overlap : splitterLine.overlaps) {
+            openStretches(blockers, overlap.tMin, overlap.tMax, openings);
+            for (const auto &[a, b] : openings) {
+                const XYVectorf p0 = line.p0 + line.dir * a;
+                const XYVectorf p1 = line.p0 + line.dir * b;
+                m_portals[overlap.frontLeaf].push_back({p0, p1, overlap.backLeaf});
+                m_portals[overlap.backLeaf].push_back({p0, p1, overlap.frontLeaf});
+            }
+        }
+    }
+}
+
+// Everything in the cluster itself, its neighbours and their neighbours is visible outright; past that, sight is followed portal by
+// portal with the source and each new portal clipped to what can still be seen through the chain so far.
+void TwoHalfD::BSPPVS::_computeRow(int cluster, FlowScratch &scratch, std::vector<uint8_t> &row) const {
+    scratch.visible.assign((m_clusterCount + 63) / 64, 0);
+    scratch.onPath.assign(m_clusterCount, 0);
+    scratch.steps = 0;
+    scratch.overBudget = false;
+
+    setBit(scratch.visible, cluster);
+    scratch.onPath[cluster] = 1;
+    for (const Portal &first : m_portals[cluster]) {
+        setBit(scratch.visible, first.target);
+        scratch.onPath[first.target] = 1;
+        const XYVectorf firstDir = first.p1 - first.p0;
+        for (const Portal &second : m_portals[first.target]) {
+            if (scratch.onPath[second.target]) continue;
+            setBit(scratch.visible, second.target);
+            // A portal on the same line as the first one can only be grazed
+            if (std::abs(crossProduct2d(second.p0 - first.p0, firstDir)) < PVS_EPSILON * firstDir.length() &&
+                std::abs(crossProduct2d(second.p1 - first.p0, firstDir)) < PVS_EPSILON * firstDir.length()) {
+                continue;
+            }
+            _flow(second.target, first.p0, first.p1, second.p0, second.p1, 2, scratch);
+        }
+        scratch.onPath[first.target] = 0;
+    }
+    if (scratch.overBudget) _floodReachable(cluster, scratch);
+
+    // Run-length encode the zero bytes
+    row.clear();
+    const int byteCount = (m_clusterCount + 7) / 8;
+    for (int i = 0; i < byteCount; ++i) {
+        const uint8_t byte = static_cast<uint8_t>(scratch.visible[i / 8] >> (8 * (i % 8)));
+        if (byte != 0) {
+            row.push_back(byte);
+            continue;
+        }
+        int run = 1;
+        while (i + run < byteCount && run < 255 && static_cast<uint8_t>(scratch.visible[(i + run) / 8] >> (8 * ((i + run) % 8))) == 0) {
+            ++run;
+        }
+        row.push_back(0);
+        row.push_back(static_cast<uint8_t>(run));
+        i += run - 1;
+    }
+}
+
+void TwoHalfD::BSPPVS::_flow(int leaf, XYVectorf source0, XYVectorf source1, const XYVectorf &pass0, const XYVectorf &pass1, size_t depth,
+                             FlowScratch &scratch) const {
+    if (scratch.overBudget) return;
+    if (++scratch.steps > FLOW_STEP_BUDGET || depth > FLOW_MAX_DEPTH) {
+        scratch.overBudget = true;
+        return;
+    }
+
+    scratch.onPath[leaf] = 1;
+    for (const Portal &portal : m_portals[leaf]) {
+        if (scratch.onPath[portal.target]) continue;
+        XYVectorf target0 = portal.p0;
+        XYVectorf target1 = portal.p1;
+        if (!clipToAntipenumbra(source0, source1, pass0, pass1, target0, target1)) continue;
+        XYVectorf clippedSource0 = source0;
+        XYVectorf clippedSource1 = source1;
+        if (!clipToAntipenumbra(target0, target1, pass0, pass1, clippedSource0, clippedSource1)) continue;
+
+        setBit(scratch.visible, portal.target);
+        _flow(portal.target, clippedSource0, clippedSource1, target0, target1, depth + 1, scratch);
+        if (scratch.overBudget) break;
+    }
+    scratch.onPath[leaf] = 0;
+}
+
+// Conservative fallback: every cluster connected to this one through portals
+void TwoHalfD::BSPPVS::_floodReachable(int cluster, FlowScratch &scratch) const {
+    std::vector<uint8_t> &reached = scratch.onPath;
+    std::fill(reached.begin(), reached.end(), 0);
+    scratch.floodStack.assign(1, cluster);
+    reached[cluster] = 1;
+    while (!scratch.floodStack.empty()) {
+        const int leaf = scratch.floodStack.back();
+        scratch.floodStack.pop_back();
+        setBit(scratch.visible, leaf);
+        for (const Portal &portal : m_portals[leaf]) {
+            if (reached[portal.target]) continue;
+            reached[portal.target] = 1;
+            scratch.floodStack.push_back(portal.target);
+        }
+    }
+}
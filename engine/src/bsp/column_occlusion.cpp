@@ -0,0 +1,183 @@
+#include "TwoHalfD/bsp/column_occlusion.h"
+#include "TwoHalfD/utils/math_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+constexpr float WALL_NEAR_CLIP = 50.f;  // same as Renderer::renderSegment
+constexpr float REGION_NEAR_CLIP = 1.f; // regions are clipped here rather than at a renderer plane so billboards close up are kept
+constexpr float COVERAGE_SLACK = 1.f;   // pixels; walls are treated as one pixel smaller when covering and one larger when tested
+
+// Rows whose centres lie in [top, bottom]
+std::pair<int, int> rowsBetween(float top, float bottom, int height) {
+    top = std::clamp(top, -1.f, static_cast<float>(height) + 1.f);
+    bottom = std::clamp(bottom, -1.f, static_cast<float>(height) + 1.f);
+    return {static_cast<int>(std::ceil(top - 0.5f)), static_cast<int>(std::floor(bottom - 0.5f)) + 1};
+}
+} // namespace
+
+void TwoHalfD::ColumnOcclusion::reset(const CameraObject &camera, const EngineSettings &settings, float defaultFloorHeight) {
+    m_cameraPos = camera.cameraPos.pos;
+    m_direction = {std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
+    m_plane = {-m_direction.y, m_direction.x};
+    m_focalLength = (settings.resolution.x / 2.0f) / settings.fovScale;
+    m_eyeHeight = camera.cameraHeight + camera.cameraHeightStart;
+    m_defaultFloorHeight = defaultFloorHeight;
+    m_width = settings.resolution.x;
+    m_height = settings.resolution.y;
+
+    m_openTop.assign(m_width, 0);
+    m_openBottom.assign(m_width, m_height);
+    m_nextOpen.resize(m_width + 1);
+    for (int x = 0; x <= m_width; ++x) {
+        m_nextOpen[x] = x;
+    }
+    m_openColumns = m_width;
+}
+
+bool TwoHalfD::ColumnOcclusion::addWall(const XYVectorf &v1, const XYVectorf &v2, float bottom, float top) {
+    // Renderer::renderSegment discards the part of a wall below the default floor
+    bottom = std::max(bottom, m_defaultFloorHeight);
+    if (bottom >= top) return false;
+
+    XYVectorf camV1 = v1 - m_cameraPos;
+    XYVectorf camV2 = v2 - m_cameraPos;
+    float depth1 = dotProduct(camV1, m_direction);
+    float depth2 = dotProduct(camV2, m_direction);
+    if (depth1 < WALL_NEAR_CLIP && depth2 < WALL_NEAR_CLIP) return false;
+
+    if (depth1 < WALL_NEAR_CLIP) {
+        float t = (WALL_NEAR_CLIP - depth1) / (depth2 - depth1);
+        camV1 = camV1 + t * (camV2 - camV1);
+        depth1 = WALL_NEAR_CLIP;
+    }
+    if (depth2 < WALL_NEAR_CLIP) {
+        float t = (WALL_NEAR_CLIP - depth2) / (depth1 - depth2);
+        camV2 = camV2 + t * (camV1 - camV2);
+        depth2 = WALL_NEAR_CLIP;
+    }
+
+    const float halfXRes = m_width / 2.f;
+    const float halfYRes = m_height / 2.f;
+    float x1 = halfXRes + m_focalLength * dotProduct(camV1, m_plane) / depth1;
+    float x2 = halfXRes + m_focalLength * dotProduct(camV2, m_plane) / depth2;
+    float top1 = halfYRes + m_focalLength * (m_eyeHeight - top) / depth1;
+    float top2 = halfYRes + m_focalLength * (m_eyeHeight - top) / depth2;
+    float bottom1 = halfYRes + m_focalLength * (m_eyeHeight - bottom) / depth1;
+    float bottom2 = halfYRes + m_focalLength * (m_eyeHeight - bottom) / depth2;
+    if (x1 > x2) {
+        std::swap(x1, x2);
+        std::swap(top1, top2);
+        std::swap(bottom1, bottom2);
+    }
+    if (x2 - x1 < 0.001f) return false;
+
+    const float xMin = std::clamp(x1 - COVERAGE_SLACK, -1.f, static_cast<float>(m_width));
+    const float xMax = std::clamp(x2 + COVERAGE_SLACK, -1.f, static_cast<float>(m_width));
+    const int first = std::max(0, static_cast<int>(std::ceil(xMin - 0.5f)));
+    const int last = std::min(m_width - 1, static_cast<int>(std::floor(xMax - 0.5f)));
+
+    bool visible = false;
+    for (int x = _findOpen(first); x <= last; x = _findOpen(x + 1)) {
+        const float columnCentre = x + 0.5f;
+        const float t = std::clamp((columnCentre - x1) / (x2 - x1), 0.f, 1.f);
+        const float columnTop = top1 + t * (top2 - top1);
+        const float columnBottom = bottom1 + t * (bottom2 - bottom1);
+
+        int &openTop = m_openTop[x];
+        int &openBottom = m_openBottom[x];
+        auto [drawnBegin, drawnEnd] = rowsBetween(columnTop - COVERAGE_SLACK, columnBottom + COVERAGE_SLACK, m_height);
+        if (std::max(drawnBegin, openTop) < std::min(drawnEnd, openBottom)) visible = true;
+
+        if (columnCentre < x1 + COVERAGE_SLACK || columnCentre > x2 - COVERAGE_SLACK) continue;
+        // Only a wall that reaches one end of the open run can shrink it; one floating in the middle leaves it as is
+        auto [coveredBegin, coveredEnd] = rowsBetween(columnTop + COVERAGE_SLACK, columnBottom - COVERAGE_SLACK, m_height);
+        if (coveredBegin >= coveredEnd) continue;
+        if (coveredBegin <= openTop && coveredEnd > openTop) openTop = coveredEnd;
+        if (coveredEnd >= openBottom && coveredBegin < openBottom) openBottom = coveredBegin;
+        if (openTop >= openBottom) {
+            m_nextOpen[x] = x + 1;
+            --m_openColumns;
+        }
+    }
+    return visible;
+}
+
+bool TwoHalfD::ColumnOcclusion::isRegionVisible(const BSPBounds &bounds, float margin) {
+    const XYVectorf min{bounds.min.x - margin, bounds.min.y - margin};
+    const XYVectorf max{bounds.max.x + margin, bounds.max.y + margin};
+    if (m_cameraPos.x >= min.x && m_cameraPos.x <= max.x && m_cameraPos.y >= min.y && m_cameraPos.y <= max.y) return true;
+
+    // Clip the box against the near plane and take the screen extent of what is left
+    const XYVectorf corners[4] = {min, {max.x, min.y}, max, {min.x, max.y}};
+    const float halfXRes = m_width / 2.f;
+    float xMin = std::numeric_limits<float>::max();
+    float xMax = std::numeric_limits<float>::lowest();
+    auto project = [&](const XYVectorf &camVec, float depth) {
+        const float x = halfXRes + m_focalLength * dotProduct(camVec, m_plane) / depth;
+        xMin = std::min(xMin, x);
+        xMax = std::max(xMax, x);
+    };
+    for (int i = 0; i < 4; ++i) {
+        const XYVectorf curr = corners[i] - m_cameraPos;
+        const XYVectorf next = corners[(i + 1) % 4] - m_cameraPos;
+        const float depthCurr = dotProduct(curr, m_direction);
+        const float depthNext = dotProduct(next, m_direction);
+        if (depthCurr >= REGION_NEAR_CLIP) project(curr, depthCurr);
+        if ((depthCurr >= REGION_NEAR_CLIP) != (depthNext >= REGION_NEAR_CLIP)) {
+            const float t = (REGION_NEAR_CLIP - depthCurr) / (depthNext - depthCurr);
+            project(curr + t * (next - curr), REGION_NEAR_CLIP);
+        }
+    }
+    if (xMin > xMax) return false;
+    return _anyOpen(xMin, xMax);
+}
+
+bool TwoHalfD::ColumnOcclusion::isBillboardVisible(const XYVectorf &pos, float halfWidth) {
+    const XYVectorf camVec = pos - m_cameraPos;
+    const float depth = dotProduct(camVec, m_direction);
+    if (depth <= 0.f) return false; // the renderer skips billboards at or behind the camera plane
+
+    const float x = m_width / 2.f + m_focalLength * dotProduct(camVec, m_plane) / depth;
+    const float halfScreenWidth = m_focalLength * halfWidth / depth;
+    return _anyOpen(x - halfScreenWidth, x + halfScreenWidth);
+}
+
+std::pair<int, int> TwoHalfD::ColumnOcclusion::visibleColumns(float left, float right, float top, float bottom) {
+    left = std::clamp(left - COVERAGE_SLACK, -1.f, static_cast<float>(m_width));
+    right = std::clamp(right + COVERAGE_SLACK, -1.f, static_cast<float>(m_width));
+    const int first = std::max(0, static_cast<int>(std::ceil(left - 0.5f)));
+    const int last = std::min(m_width - 1, static_cast<int>(std::floor(right - 0.5f)));
+    auto [rowBegin, rowEnd] = rowsBetween(top - COVERAGE_SLACK, bottom + COVERAGE_SLACK, m_height);
+    auto isVisible = [&](int x) { return std::max(rowBegin, m_openTop[x]) < std::min(rowEnd, m_openBottom[x]); };
+
+    // Scan in from both ends; the columns between the first and last visible ones are not looked at
+    int begin = first > last ? last + 1 : _findOpen(first);
+    while (begin <= last && !isVisible(begin)) {
+        begin = _findOpen(begin + 1);
+    }
+    if (begin > last) return {0, 0};
+    int end = last;
+    while (end > begin && !isVisible(end)) {
+        --end;
+    }
+    return {begin, end + 1};
+}
+
+int TwoHalfD::ColumnOcclusion::_findOpen(int column) {
+    while (m_nextOpen[column] != column) {
+        m_nextOpen[column] = m_nextOpen[m_nextOpen[column]];
+        column = m_nextOpen[column];
+    }
+    return column;
+}
+
+bool TwoHalfD::ColumnOcclusion::_anyOpen(float xMin, float xMax) {
+    xMin = std::clamp(xMin - COVERAGE_SLACK, -1.f, static_cast<float>(m_width));
+    xMax = std::clamp(xMax + COVERAGE_SLACK, -1.f, static_cast<float>(m_width));
+    const int first = std::max(0, static_cast<int>(std::ceil(xMin - 0.5f)));
+    const int last = std::min(m_width - 1, static_cast<int>(std::floor(xMax - 0.5f)));
+    return first <= last && _findOpen(first) <= last;
+}
@@ -1,14 +1,18 @@
+#include "TwoHalfD/bsp/bsp_cache.h"
 #include "TwoHalfD/types/entity_types.h"
 #include "TwoHalfD/types/math_types.h"
 #include <TwoHalfD/engine.h>
 
 #include <SFML/Window/Mouse.hpp>
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <iostream>
 #include <span>
 
 void TwoHalfD::Engine::loadLevel(std::string levelFilePath) {
     this->m_engineState = EngineState::fpsState;
-    m_window.setMouseCursorVisible(false);
+    if (!m_engineSettings.headless) m_window.setMouseCursorVisible(false);
 
     TwoHalfD::Level level = m_levelMaker.parseLevelFile(levelFilePath);
 
@@ -25,8 +29,18 @@ void TwoHalfD::Engine::loadLevel(std::string levelFilePath) {
     }
 
     m_bspManager.init(std::move(level.walls), std::move(level.floorSections), m_defaultFloorHeight, m_defaultFloorTextureId, level.seed);
-    m_bspManager.buildBSPTree();
-    m_bspManager.buildGraph();
+    const BSPBuildMode buildMode = level.bspBuildMode.value_or(m_engineSettings.bspBuildMode);
+    m_bspManager.setBuildMode(buildMode);
+
+    const std::string levelPath = fs::path(ASSETS_DIR) / levelFilePath;
+    const std::string cachePath = levelPath + ".bspcache";
+    const uint64_t cacheKey = TwoHalfD::BSPCache::computeKey(levelPath, level.seed, buildMode, m_defaultFloorHeight, m_cameraObject.cameraHeight);
+    if (!m_engineSettings.useBSPCache || !TwoHalfD::BSPCache::load(cachePath, cacheKey, m_bspManager)) {
+        m_bspManager.buildBSPTree();
+        m_bspManager.buildGraph();
+        m_bspManager.buildPVS(m_cameraObject.cameraHeight);
+        if (m_engineSettings.useBSPCache) TwoHalfD::BSPCache::save(cachePath, cacheKey, m_bspManager);
+    }
 
     auto heightStarts = m_bspManager.insertSprites(m_entityManager.getAllEntities());
     for (const auto &[entityId, heightStart] : heightStarts) {
@@ -48,7 +62,8 @@ void TwoHalfD::Engine::clearFrameInputs() {
 }
 
 void TwoHalfD::Engine::backgroundFrameUpdates() {
-    if (m_engineState == TwoHalfD::EngineState::fpsState) {
+    const auto updateStart = std::chrono::steady_clock::now();
+    if (m_engineState == TwoHalfD::EngineState::fpsState && !m_engineSettings.headless) {
         auto size = m_window.getSize();
         const XYVector middleScreen = {(int)size.x / 2, (int)size.y / 2};
         sf::Vector2i mousePosition = sf::Mouse::getPosition(m_window);
@@ -61,16 +76,14 @@ void TwoHalfD::Engine::backgroundFrameUpdates() {
 
     float deltaTime = static_cast<float>(m_engineClocks.getGameDeltaTime());
     auto movedEntities = m_entityManager.update(deltaTime, m_engineSettings);
-    for (const auto &[entityId, newPos] : movedEntities) {
-        m_bspManager.moveSprite(entityId, newPos);
-    }
+    m_bspManager.moveSprites(movedEntities);
 
     for (int effectId : m_entityManager.getExpiredEffectIds()) {
         m_bspManager.removeEffect(effectId);
     }
     m_entityManager.eraseExpiredEffects();
 
-    auto convexSection = m_bspManager.findConvexSection(m_cameraObject.cameraPos.pos);
+    auto convexSection = m_bspManager.findConvexSection(m_cameraObject.cameraPos.pos, m_cameraLeaf);
     m_cameraObject.cameraFloorHeight =
         convexSection != nullptr && convexSection->floorSection != nullptr ? convexSection->floorSection->height : m_defaultFloorHeight;
 
@@ -90,6 +103,7 @@ void TwoHalfD::Engine::backgroundFrameUpdates() {
         m_cameraObject.cameraHeightStart = m_cameraObject.cameraFloorHeight;
         m_cameraObject.velocity.z = 0.f;
     }
+    m_pendingUpdateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStart).count();
 }
 
 bool TwoHalfD::Engine::gameDeltaTimePassed() {
@@ -171,7 +185,52 @@ const std::vector<TwoHalfD::Wall> &TwoHalfD::Engine::getAllWalls() {
 }
 
 void TwoHalfD::Engine::render() {
-    m_renderer.render(m_cameraObject, m_bspManager);
+    const auto renderStart = std::chrono::steady_clock::now();
+    if (!m_renderer.render(m_cameraObject, m_bspManager)) return;
+    const double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+
+    if (m_engineSettings.headless) m_frameTimings.push_back({m_framesRendered, m_pendingUpdateMs, renderMs});
+    m_pendingUpdateMs = 0.0;
+    ++m_framesRendered;
+}
+
+uint64_t TwoHalfD::Engine::getFramesRendered() const {
+    return m_framesRendered;
+}
+
+bool TwoHalfD::Engine::saveFrame(const std::string &filePath, FrameCaptureFormat format) const {
+    sf::Image frame;
+    m_renderer.captureFrame(frame);
+
+    if (format == FrameCaptureFormat::PNG) {
+        return frame.saveToFile(filePath);
+    }
+
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open " << filePath << " to save the frame\n";
+        return false;
+    }
+    const std::streamsize byteCount = static_cast<std::streamsize>(frame.getSize().x) * frame.getSize().y * 4;
+    file.write(reinterpret_cast<const char *>(frame.getPixelsPtr()), byteCount);
+    return static_cast<bool>(file);
+}
+
+const std::vector<TwoHalfD::FrameTiming> &TwoHalfD::Engine::getFrameTimings() const {
+    return m_frameTimings;
+}
+
+bool TwoHalfD::Engine::saveFrameTimings(const std::string &filePath) const {
+    std::ofstream file(filePath);
+    if (!file) {
+        std::cerr << "Could not open " << filePath << " to save the frame timings\n";
+        return false;
+    }
+    file << "frame,update_ms,render_ms\n";
+    for (const auto &timing : m_frameTimings) {
+        file << timing.frame << ',' << timing.updateMs << ',' << timing.renderMs << '\n';
+    }
+    return static_cast<bool>(file);
 }
 
 void TwoHalfD::Engine::walkTo(const int entityId, const TwoHalfD::XYVectorf targetPos, float maxHeightDiff, float maxStepDown, float maxDistance) {
@@ -229,3 +288,11 @@ void TwoHalfD::Engine::updateColourOverlay(int id, uint8_t r, uint8_t g, uint8_t
 void TwoHalfD::Engine::removeColourOverlay(int id) {
     m_bspManager.removeColourOverlay(id);
 }
+
+int TwoHalfD::Engine::addWall(const TwoHalfD::Wall &wall) {
+    return m_bspManager.insertWall(wall);
+}
+
+void TwoHalfD::Engine::removeWall(int wallId) {
+    m_bspManager.removeWall(wallId);
+}
@@ -9,10 +9,12 @@ bool TwoHalfD::EngineClocks::graphicsTimeDeltaPassed() {
 }
 
 bool TwoHalfD::EngineClocks::gameTimeDeltaPassed() {
+    if (m_fixedGameTimestep > 0.0) return true;
     return m_gameTimeDelta.timeDeltaPassed();
 }
 
 double TwoHalfD::EngineClocks::getGameDeltaTime() const {
+    if (m_fixedGameTimestep > 0.0) return m_fixedGameTimestep;
     return m_gameTimeDelta.getLastDeltaDuration() / 1000.0;
 }
 
@@ -47,6 +47,14 @@ TwoHalfD::Level TwoHalfD::LevelMaker::parseLevelFile(std::string levelFilePath)
             std::cerr << "Level seed set to: " << result_level.seed << '\n';
             break;
         }
+        case TwoHalfD::EntityTypes::bspBuildMode: {
+            std::istringstream ss(line);
+            int skip, mode;
+            ss >> skip >> mode;
+            result_level.bspBuildMode = mode == 1 ? TwoHalfD::BSPBuildMode::Heuristic : TwoHalfD::BSPBuildMode::SeedSearch;
+            std::cerr << "Level BSP build mode set to: " << (mode == 1 ? "heuristic" : "seed search") << '\n';
+            break;
+        }
         case TwoHalfD::EntityTypes::floorDefault: {
             auto defaultFloor = _makeDefaultFloor(line);
             result_level.defaultFloorTextureId = defaultFloor.first;
@@ -100,6 +108,14 @@ TwoHalfD::TextureSignature TwoHalfD::LevelMaker::_makeTexture(std::string textur
             break;
         }
     }
+    if (!m_uploadTextures) {
+        if (!fs::exists(fs::path(ASSETS_DIR) / filePath)) {
+            std::cerr << "Incorrect filepath given: (" << filePath << ") will use default\n";
+            filePath = m_defaultTextureFilePath;
+        }
+        return TwoHalfD::TextureSignature{tex, filePath, textureId};
+    }
+
     if (!tex.loadFromFile(fs::path(ASSETS_DIR) / filePath)) {
         std::cerr << "Incorrect filepath given: (" << filePath << ") will use default\n";
         tex.loadFromFile(m_defaultTextureFilePath);
@@ -1,5 +1,6 @@
 #include "TwoHalfD/renderer.h"
 #include "TwoHalfD/utils/math_util.h"
+#include "TwoHalfD/utils/render_util.h"
 
 #include <SFML/Graphics/BlendMode.hpp>
 #include <SFML/Graphics/Color.hpp>
@@ -10,8 +11,8 @@
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Texture.hpp>
 #include <SFML/Graphics/Vertex.hpp>
-#include <SFML/Graphics/VertexArray.hpp>
 #include <SFML/System/Vector2.hpp>
+#include <array>
 #include <chrono>
 #include <cmath>
 #include <iostream>
@@ -20,7 +21,15 @@
 TwoHalfD::Renderer::Renderer(sf::RenderWindow &window, const EngineSettings &settings, EngineClocks &clocks)
     : m_window(window), m_settings(settings), m_clocks(clocks) {
 
+    if (settings.renderBackend == RenderBackend::Software) {
+        m_softwareRenderer = std::make_unique<SoftwareRenderer>(settings);
+        // Headless software frames never leave the CPU, so no GL context is ever made
+        if (!usesGpu()) return;
+        m_softwareFrame.create(settings.resolution.x, settings.resolution.y);
+    }
+
     m_renderTexture.create(settings.resolution.x, settings.resolution.y);
+    m_floorIds.create(settings.resolution.x, settings.resolution.y);
 
     if (!sf::Shader::isAvailable()) {
         std::cerr << "Shaders not available!" << std::endl;
@@ -37,6 +46,23 @@ TwoHalfD::Renderer::Renderer(sf::RenderWindow &window, const EngineSettings &set
         std::cerr << "Failed to load floor shader!" << std::endl;
         std::exit(1);
     }
+
+    std::string billboardShaderPath = static_cast<std::string>(ROOT_DIR) + "/engine/include/TwoHalfD/" + "shaders/billboardShader.frag";
+    if (!m_billboardShader.loadFromFile(billboardShaderPath, sf::Shader::Fragment)) {
+        std::cerr << "Failed to load billboard shader!" << std::endl;
+        std::exit(1);
+    }
+
+    std::string colourOverlayShaderPath = static_cast<std::string>(ROOT_DIR) + "/engine/include/TwoHalfD/" + "shaders/colourOverlayShader.frag";
+    if (!m_colourOverlayShader.loadFromFile(colourOverlayShaderPath, sf::Shader::Fragment)) {
+        std::cerr << "Failed to load colour overlay shader!" << std::endl;
+        std::exit(1);
+    }
+
+    for (sf::Shader *shader : {&m_perspectiveShader, &m_floorShader, &m_billboardShader, &m_colourOverlayShader}) {
+        shader->setUniform("floorIds", m_floorIds.getTexture());
+        shader->setUniform("resolution", sf::Vector2f(settings.resolution));
+    }
 }
 
 void TwoHalfD::Renderer::setData(const std::unordered_map<int, TextureSignature> *textures, const EntityManager *entityManager,
@@ -46,15 +72,35 @@ void TwoHalfD::Renderer::setData(const std::unordered_map<int, TextureSignature>
     m_defaultFloorHeight = defaultFloorHeight;
     m_defaultFloorTextureId = defaultFloorTextureId;
     m_defaultFloorStart = defaultFloorStart;
+
+    if (usesGpu()) m_textureAtlas.build(*textures, entityManager ? entityManager->getAnimationTemplates() : nullptr);
+
+    if (m_softwareRenderer) {
+        m_softwareRenderer->setData(textures, entityManager, defaultFloorHeight, defaultFloorTextureId, defaultFloorStart);
+    }
 }
 
-void TwoHalfD::Renderer::render(const CameraObject &camera, BSPManager &bsp) {
+bool TwoHalfD::Renderer::usesGpu() const {
+    return !(m_settings.headless && m_softwareRenderer);
+}
+
+bool TwoHalfD::Renderer::render(const CameraObject &camera, BSPManager &bsp) {
+    if (m_settings.headless) {
+        renderHeadless(camera, bsp);
+        return true;
+    }
     if (!m_clocks.graphicsTimeDeltaPassed()) {
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        return;
+        return false;
     }
     m_renderTexture.clear(sf::Color::Transparent);
-    renderBSP(camera, bsp);
+    if (m_softwareRenderer) {
+        m_softwareRenderer->render(camera, bsp);
+        m_softwareFrame.update(m_softwareRenderer->getPixels());
+        m_renderTexture.draw(sf::Sprite(m_softwareFrame), sf::RenderStates(sf::BlendNone));
+    } else {
+        renderBSP(camera, bsp);
+    }
     renderOverlays(camera);
 
     m_renderTexture.display();
@@ -64,33 +110,64 @@ void TwoHalfD::Renderer::render(const CameraObject &camera, BSPManager &bsp) {
     m_window.clear(sf::Color::Black);
     m_window.draw(sprite);
     m_window.display();
+    return true;
+}
+
+// No frame cap and no HUD, whose fps and position text would make the frames differ from run to run
+void TwoHalfD::Renderer::renderHeadless(const CameraObject &camera, BSPManager &bsp) {
+    if (m_softwareRenderer) {
+        m_softwareRenderer->render(camera, bsp);
+        return;
+    }
+    m_renderTexture.clear(sf::Color::Transparent);
+    renderBSP(camera, bsp);
+    m_renderTexture.display();
+}
+
+void TwoHalfD::Renderer::captureFrame(sf::Image &image) const {
+    if (!usesGpu()) {
+        image.create(m_softwareRenderer->getWidth(), m_softwareRenderer->getHeight(), m_softwareRenderer->getPixels());
+        return;
+    }
+    image = m_renderTexture.getTexture().copyToImage();
 }
 
 void TwoHalfD::Renderer::renderBSP(const CameraObject &camera, BSPManager &bsp) {
-    auto bspTraversal = bsp.update(const_cast<TwoHalfD::Position &>(camera.cameraPos));
-    auto &drawnCommands = bspTraversal.first;
+    bsp.update(camera, m_settings, m_drawList);
 
+    buildFloorIds(camera);
     renderFloor(camera);
-    for (const auto &command : drawnCommands) {
+
+    m_perspectiveShader.setUniform("resolution", sf::Vector2f(m_settings.resolution));
+    m_perspectiveShader.setUniform("shaderScale", m_settings.shaderScale);
+    m_perspectiveShader.setUniform("focalLength", (m_settings.resolution.x / 2.0f) / m_settings.fovScale);
+    m_perspectiveShader.setUniform("eyeHeight", camera.cameraHeight + camera.cameraHeightStart);
+    m_perspectiveShader.setUniform("floorHeight", m_defaultFloorHeight);
+
+    cullBillboards(camera, bsp);
+
+    for (size_t i = 0; i < m_drawList.commands.size(); ++i) {
+        const auto &command = m_drawList.commands[i];
+        // Anything else drawn must land on top of the walls and billboards queued before it
+        const bool isBillboard = command.type == TwoHalfD::DrawCommand::Type::Sprite || command.type == TwoHalfD::DrawCommand::Type::Effect;
+        if (command.type != TwoHalfD::DrawCommand::Type::Segment) flushSegments();
+        if (!isBillboard) flushBillboards();
+        m_floorOrder = static_cast<float>(m_commandFloorOrder[i]);
+
         switch (command.type) {
         case TwoHalfD::DrawCommand::Type::Segment: {
             renderSegment(bsp.getSegment(command.id), camera);
             break;
         }
-        case TwoHalfD::DrawCommand::Type::Sprite: {
-            auto entity = m_entityManager->getEntity(command.id);
-            if (entity) renderSprite(*entity, camera);
+        case TwoHalfD::DrawCommand::Type::Sprite:
+        case TwoHalfD::DrawCommand::Type::Effect: {
+            for (uint32_t quad = m_commandQuads[i].first; quad < m_commandQuads[i].second; ++quad) {
+                addBillboard(m_billboardQuads[quad]);
+            }
             break;
         }
         case TwoHalfD::DrawCommand::Type::FloorSection: {
-            renderFloorSection(command.floorSectionPtr, camera);
-            break;
-        }
-        case TwoHalfD::DrawCommand::Type::Effect: {
-            const auto &effects = m_entityManager->getAllEffects();
-            auto it = effects.find(command.id);
-            if (it != effects.end()) renderEffect(it->second, camera);
-            break;
+            break; // shaded with every other floor in renderFloor
         }
         case TwoHalfD::DrawCommand::Type::ColourOverlay: {
             renderColourOverlay(command.colourOverlayPtr, camera);
@@ -100,119 +177,123 @@ void TwoHalfD::Renderer::renderBSP(const CameraObject &camera, BSPManager &bsp)
             break;
         }
     }
+    flushSegments();
+    flushBillboards();
 }
 
-void TwoHalfD::Renderer::renderSegment(TwoHalfD::Segment segment, const CameraObject &camera) {
-    const float NEAR_CLIP = 50.0f;
-
-    auto wallB = segment.isWall() ? *segment.wall : TwoHalfD::Wall(segment.v1, segment.v2, 1, 1, segment.floorSection->height, 0);
-    TwoHalfD::Wall *wall = &wallB;
-
-    float p_focalLength = (m_settings.resolution.x / 2.0f) / m_settings.fovScale;
-    TwoHalfD::XYVectorf n_direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
-    TwoHalfD::XYVectorf n_plane{-n_direction.y, n_direction.x};
+// Walks the draw list from its end, adding each wall as an occluder, so when a sprite or effect comes up every wall painted over it has
+// been added. Its quads are built there, dropped when hidden and trimmed to the columns where they still show.
+void TwoHalfD::Renderer::cullBillboards(const CameraObject &camera, BSPManager &bsp) {
+    const auto &commands = m_drawList.commands;
+    const auto &entities = m_entityManager->getAllEntities();
+    const auto &effects = m_entityManager->getAllEffects();
 
-    TwoHalfD::XYVectorf vecCamV1 = segment.v1 - camera.cameraPos.pos;
-    TwoHalfD::XYVectorf vecCamV2 = segment.v2 - camera.cameraPos.pos;
+    m_billboardOcclusion.reset(camera, m_settings, m_defaultFloorHeight);
+    m_billboardQuads.clear();
+    m_commandQuads.assign(commands.size(), {0, 0});
 
-    float wallRatioStart = segment.wallRatioStart;
-    float wallRatioEnd = segment.wallRatioEnd;
+    for (size_t i = commands.size(); i-- > 0;) {
+        const auto &command = commands[i];
+        const uint32_t firstQuad = static_cast<uint32_t>(m_billboardQuads.size());
+        switch (command.type) {
+        case TwoHalfD::DrawCommand::Type::Segment: {
+            // Floor boundaries are drawn as a step from the ground up to the section's height
+            const TwoHalfD::Segment &segment = bsp.getSegment(command.id);
+            const float bottom = segment.isWall() ? segment.wall->wallHeightStart : 0.f;
+            const float top = segment.isWall() ? bottom + segment.wall->height : segment.floorSection->height;
+            m_billboardOcclusion.addWall(segment.v1, segment.v2, bottom, top);
+            continue;
+        }
+        case TwoHalfD::DrawCommand::Type::Sprite: {
+            auto it = entities.find(command.id);
+            if (it != entities.end()) buildSpriteQuads(it->second, camera);
+            break;
+        }
+        case TwoHalfD::DrawCommand::Type::Effect: {
+            auto it = effects.find(command.id);
+            if (it != effects.end()) buildEffectQuads(it->second, camera);
+            break;
+        }
+        default:
+            continue;
+        }
 
-    float singedPerpWorldDistanceStart = dotProduct(vecCamV1, n_direction);
-    float singedPerpWorldDistanceEnd = dotProduct(vecCamV2, n_direction);
+        uint32_t keptQuad = firstQuad;
+        for (uint32_t quad = firstQuad; quad < m_billboardQuads.size(); ++quad) {
+            BillboardQuad billboard = m_billboardQuads[quad];
+            const sf::FloatRect &rect = billboard.screenRect;
+            auto [begin, end] = m_billboardOcclusion.visibleColumns(rect.left, rect.left + rect.width, rect.top, rect.top + rect.height);
+            if (begin == end) continue;
+
+            // The quad is screen aligned, so its texture coordinates stay linear in x when trimmed
+            const float left = std::max(rect.left, static_cast<float>(begin));
+            const float right = std::min(rect.left + rect.width, static_cast<float>(end));
+            if (left > rect.left || right < rect.left + rect.width) {
+                const float repeatsPerPixel = (billboard.repeatsEnd.x - billboard.repeatsStart.x) / rect.width;
+                billboard.repeatsStart.x += (left - rect.left) * repeatsPerPixel;
+                billboard.repeatsEnd.x -= (rect.left + rect.width - right) * repeatsPerPixel;
+                billboard.screenRect.left = left;
+                billboard.screenRect.width = right - left;
+            }
+            m_billboardQuads[keptQuad++] = billboard;
+        }
+        m_billboardQuads.resize(keptQuad);
+        m_commandQuads[i] = {firstQuad, keptQuad};
+    }
+}
 
-    if (singedPerpWorldDistanceEnd < NEAR_CLIP && singedPerpWorldDistanceStart < NEAR_CLIP) {
+void TwoHalfD::Renderer::renderSegment(const TwoHalfD::Segment &segment, const CameraObject &camera) {
+    TwoHalfD::ProjectedWall projected;
+    if (!TwoHalfD::projectSegment(segment, camera, m_settings, projected)) {
         return;
     }
 
-    float signedLateralDistV1 = dotProduct(vecCamV1, n_plane);
-    float signedLateralDistV2 = dotProduct(vecCamV2, n_plane);
-
-    bool v1RightV2Left = signedLateralDistV1 >= 0 && signedLateralDistV2 < 0;
-    bool v2MoreLeft = std::signbit(signedLateralDistV1) == std::signbit(signedLateralDistV2) && signedLateralDistV1 > signedLateralDistV2;
-
-    if (v1RightV2Left || v2MoreLeft) {
-        std::swap(singedPerpWorldDistanceStart, singedPerpWorldDistanceEnd);
-        std::swap(vecCamV1, vecCamV2);
-        std::swap(signedLateralDistV1, signedLateralDistV2);
-        std::swap(wallRatioStart, wallRatioEnd);
+    const TwoHalfD::AtlasRegion *region = m_textureAtlas.findRegion(projected.textureId);
+    if (!region) {
+        std::cerr << "No texture found for wall: " << (segment.wall ? segment.wall->id : 1) << " with texture id: " << projected.textureId
+                  << std::endl;
+        exit(1);
     }
 
-    const float &halfYRes = m_settings.resolution.y / 2.f;
-    const float &halfXRes = m_settings.resolution.x / 2.f;
-
-    if (singedPerpWorldDistanceStart < NEAR_CLIP) {
-        float t = (NEAR_CLIP - singedPerpWorldDistanceStart) / (singedPerpWorldDistanceEnd - singedPerpWorldDistanceStart);
-        vecCamV1 = vecCamV1 + t * (vecCamV2 - vecCamV1);
-        signedLateralDistV1 = dotProduct(vecCamV1, n_plane);
-        singedPerpWorldDistanceStart = NEAR_CLIP;
-        wallRatioStart = wallRatioStart + t * (wallRatioEnd - wallRatioStart);
-    }
-    if (singedPerpWorldDistanceEnd < NEAR_CLIP) {
-        float t = (NEAR_CLIP - singedPerpWorldDistanceEnd) / (singedPerpWorldDistanceStart - singedPerpWorldDistanceEnd);
-        vecCamV2 = vecCamV2 + t * (vecCamV1 - vecCamV2);
-        signedLateralDistV2 = dotProduct(vecCamV2, n_plane);
-        singedPerpWorldDistanceEnd = NEAR_CLIP;
-        wallRatioEnd = wallRatioEnd + t * (wallRatioStart - wallRatioEnd);
+    const sf::Texture *page = &m_textureAtlas.getPage(region->page);
+    if (page != m_segmentBatch.texture || m_segmentBatch.wallParams.size() == MAX_BATCH_WALLS) {
+        flushSegments();
+        m_segmentBatch.texture = page;
     }
 
-    float p_xScreenPosV1 = halfXRes + p_focalLength * signedLateralDistV1 / singedPerpWorldDistanceStart;
-    float p_xScreenPosV2 = halfXRes + p_focalLength * signedLateralDistV2 / singedPerpWorldDistanceEnd;
+    const sf::Color batchIndex(static_cast<sf::Uint8>(m_segmentBatch.wallParams.size()), 0, 0);
+    m_segmentBatch.wallParams.emplace_back(projected.wallHeightStart + projected.height, 1.f / (projected.height * projected.scaleY));
+    m_segmentBatch.wallRects.push_back(region->uvRect);
 
-    if ((p_xScreenPosV1 > m_settings.resolution.x && p_xScreenPosV2 > m_settings.resolution.x) || (p_xScreenPosV2 < 0 && p_xScreenPosV1 < 0)) {
-        return;
-    }
+    const sf::Vector2f attributesStart(projected.ratio1 / projected.scaleX * projected.invZ1, projected.invZ1);
+    const sf::Vector2f attributesEnd(projected.ratio2 / projected.scaleX * projected.invZ2, projected.invZ2);
 
-    float p_topWallStart =
-        p_focalLength * (camera.cameraHeight + camera.cameraHeightStart - wall->wallHeightStart - wall->height) / singedPerpWorldDistanceStart +
-        halfYRes;
-    float p_bottomWallStart =
-        p_focalLength * (camera.cameraHeight + camera.cameraHeightStart - wall->wallHeightStart) / singedPerpWorldDistanceStart + halfYRes;
-
-    float p_topWallEnd =
-        p_focalLength * (camera.cameraHeight + camera.cameraHeightStart - wall->wallHeightStart - wall->height) / singedPerpWorldDistanceEnd +
-        halfYRes;
-    float p_bottomWallEnd =
-        p_focalLength * (camera.cameraHeight + camera.cameraHeightStart - wall->wallHeightStart) / singedPerpWorldDistanceEnd + halfYRes;
-
-    auto it = m_textures->find(wall->textureId);
-    if (it == m_textures->end()) {
-        std::cerr << "No texture found for wall: " << wall->id << " with texture id: " << wall->textureId << std::endl;
-        exit(1);
-    }
-
-    const sf::Texture &tex = it->second.texture;
+    auto &vertices = m_segmentBatch.vertices;
+    vertices.emplace_back(sf::Vector2f(projected.x1, projected.top1), batchIndex, attributesStart);
+    vertices.emplace_back(sf::Vector2f(projected.x1, projected.bottom1), batchIndex, attributesStart);
+    vertices.emplace_back(sf::Vector2f(projected.x2, projected.bottom2), batchIndex, attributesEnd);
+    vertices.emplace_back(sf::Vector2f(projected.x2, projected.top2), batchIndex, attributesEnd);
+}
 
-    sf::VertexArray quad(sf::Quads, 4);
+void TwoHalfD::Renderer::flushSegments() {
+    if (m_segmentBatch.vertices.empty()) return;
 
-    quad[0].position = sf::Vector2f(p_xScreenPosV1, p_topWallStart);
-    quad[1].position = sf::Vector2f(p_xScreenPosV1, p_bottomWallStart);
-    quad[2].position = sf::Vector2f(p_xScreenPosV2, p_bottomWallEnd);
-    quad[3].position = sf::Vector2f(p_xScreenPosV2, p_topWallEnd);
+    // The texture goes in as a uniform so no texture matrix rescales the attributes in the texture coordinates
+    m_perspectiveShader.setUniform("texture", *m_segmentBatch.texture);
+    m_perspectiveShader.setUniformArray("wallParams", m_segmentBatch.wallParams.data(), m_segmentBatch.wallParams.size());
+    m_perspectiveShader.setUniformArray("wallRects", m_segmentBatch.wallRects.data(), m_segmentBatch.wallRects.size());
+    m_perspectiveShader.setUniform("floorOrder", m_floorOrder);
 
     sf::RenderStates states;
-    states.texture = &tex;
     states.shader = &m_perspectiveShader;
+    m_renderTexture.draw(m_segmentBatch.vertices.data(), m_segmentBatch.vertices.size(), sf::Quads, states);
 
-    m_perspectiveShader.setUniform("topLeft", quad[0].position);
-    m_perspectiveShader.setUniform("bottomLeft", quad[1].position);
-    m_perspectiveShader.setUniform("bottomRight", quad[2].position);
-    m_perspectiveShader.setUniform("topRight", quad[3].position);
-    m_perspectiveShader.setUniform("startRatio", wallRatioStart);
-    m_perspectiveShader.setUniform("endRatio", wallRatioEnd);
-    m_perspectiveShader.setUniform("leftDepth", 1.0f / singedPerpWorldDistanceStart);
-    m_perspectiveShader.setUniform("rightDepth", 1.0f / singedPerpWorldDistanceEnd);
-    m_perspectiveShader.setUniform("resolution", sf::Vector2f(m_settings.resolution));
-    m_perspectiveShader.setUniform("shaderScale", m_settings.shaderScale);
-    m_perspectiveShader.setUniform("wallHeightFloorHeighDiff", m_defaultFloorHeight - wall->wallHeightStart);
-    m_perspectiveShader.setUniform("wallHeight", wall->height);
-    m_perspectiveShader.setUniform("scaleX", wall->scaleX);
-    m_perspectiveShader.setUniform("scaleY", wall->scaleY);
-
-    m_renderTexture.draw(quad, states);
+    m_segmentBatch.vertices.clear();
+    m_segmentBatch.wallParams.clear();
+    m_segmentBatch.wallRects.clear();
 }
 
-void TwoHalfD::Renderer::renderSprite(const TwoHalfD::SpriteEntity &spriteEntity, const CameraObject &camera) {
+void TwoHalfD::Renderer::buildSpriteQuads(const TwoHalfD::SpriteEntity &spriteEntity, const CameraObject &camera) {
     int textureId = spriteEntity.textureId;
 
     if (spriteEntity.currentAnimation) {
@@ -226,54 +307,36 @@ void TwoHalfD::Renderer::renderSprite(const TwoHalfD::SpriteEntity &spriteEntity
         }
     }
 
-    auto it = m_textures->find(textureId);
-    if (it == m_textures->end()) {
+    const TwoHalfD::AtlasRegion *region = m_textureAtlas.findRegion(textureId);
+    if (!region) {
         std::cerr << "No texture found for sprite: " << spriteEntity.id << " with texture id: " << textureId << std::endl;
         exit(1);
     }
 
-    const sf::Texture &tex = it->second.texture;
-    const sf::Vector2u texSize = tex.getSize();
+    const sf::Vector2i texSize(region->pixelRect.width, region->pixelRect.height);
 
     int tiledW = static_cast<int>(texSize.x / spriteEntity.scaleX);
     int tiledH = static_cast<int>(texSize.y / spriteEntity.scaleY);
 
-    sf::Sprite sprite;
-    sprite.setTexture(tex);
-    sprite.setTextureRect(sf::IntRect(0, 0, tiledW, tiledH));
-    sprite.setOrigin(tiledW / 2.0f, tiledH / 2.0f);
-
-    float cameraDirRad = camera.cameraPos.direction;
-    sf::Vector2f direction{std::cos(cameraDirRad), std::sin(cameraDirRad)};
-    sf::Vector2f n_plane{-direction.y, direction.x};
-
     float focalLength = (m_settings.resolution.x / 2.0f) / m_settings.fovScale;
 
-    const sf::Vector2f spritePos = {spriteEntity.pos.pos.x, spriteEntity.pos.pos.y};
-    const sf::Vector2f toSpriteVec = spritePos - camera.cameraPos.posf;
-
-    float perpWorldDistance = dotProduct(toSpriteVec, direction);
-
-    if (perpWorldDistance <= 0) {
+    TwoHalfD::ProjectedBillboard projected;
+    if (!TwoHalfD::projectBillboard(spriteEntity.pos.pos, spriteEntity.heightStart, spriteEntity.height, camera, m_settings, projected)) {
         return;
     }
 
-    const float bottomOfSpriteScreen = focalLength * (camera.cameraHeight + camera.cameraHeightStart - spriteEntity.heightStart) / perpWorldDistance +
-                                       m_settings.resolution.y / 2.0f;
-    const float topSpriteScreen =
-        focalLength * (camera.cameraHeight + camera.cameraHeightStart - spriteEntity.height - spriteEntity.heightStart) / perpWorldDistance +
-        m_settings.resolution.y / 2.0f;
-
-    const float spriteHeightScreen = bottomOfSpriteScreen - topSpriteScreen;
+    const float perpWorldDistance = projected.distance;
+    const float topSpriteScreen = projected.top;
+    const float spriteHeightScreen = projected.bottom - projected.top;
+    const float spriteScreenX = projected.screenX;
 
-    const float spriteScreenX = (m_settings.resolution.x / 2.0f) + focalLength * dotProduct(toSpriteVec, n_plane) / perpWorldDistance;
-
-    sprite.setPosition(spriteScreenX, topSpriteScreen + spriteHeightScreen / 2.0f);
-    sprite.setScale(spriteHeightScreen / tiledH, spriteHeightScreen / tiledH);
+    // Scaled evenly so the tiled texture keeps its aspect
+    const float tiledWidthScreen = tiledW * spriteHeightScreen / tiledH;
     float shade = std::min(1.0f, m_settings.shaderScale / perpWorldDistance);
     sf::Uint8 shadeValue = static_cast<sf::Uint8>(255 * shade);
-    sprite.setColor(sf::Color(shadeValue, shadeValue, shadeValue, 255));
-    m_renderTexture.draw(sprite);
+    const sf::FloatRect spriteRect(spriteScreenX - tiledWidthScreen / 2.0f, topSpriteScreen, tiledWidthScreen, spriteHeightScreen);
+    m_billboardQuads.push_back(
+        {region, spriteRect, {0.f, 0.f}, sf::Vector2f(static_cast<float>(tiledW) / texSize.x, static_cast<float>(tiledH) / texSize.y), shadeValue});
 
     // Render overlays (already sorted by zOrder)
     const auto *templates = m_entityManager->getAnimationTemplates();
@@ -291,33 +354,28 @@ void TwoHalfD::Renderer::renderSprite(const TwoHalfD::SpriteEntity &spriteEntity
         if (tmplIt == templates->end() || tmplIt->second.frames.empty()) continue;
 
         int overlayTexId = tmplIt->second.frames[overlay.animState.frameIndex].textureId;
-        auto overlayTexIt = m_textures->find(overlayTexId);
-        if (overlayTexIt == m_textures->end()) continue;
+        const TwoHalfD::AtlasRegion *overlayRegion = m_textureAtlas.findRegion(overlayTexId);
+        if (!overlayRegion) continue;
 
-        const sf::Texture &overlayTex = overlayTexIt->second.texture;
-        const sf::Vector2u overlayTexSize = overlayTex.getSize();
+        const sf::Vector2i overlayTexSize(overlayRegion->pixelRect.width, overlayRegion->pixelRect.height);
 
         int tiledW = static_cast<int>(overlayTexSize.x / overlay.textureScaleX);
         int tiledH = static_cast<int>(overlayTexSize.y / overlay.textureScaleY);
 
-        sf::Sprite overlaySprite;
-        overlaySprite.setTexture(overlayTex);
-        overlaySprite.setTextureRect(sf::IntRect(0, 0, tiledW, tiledH));
-        overlaySprite.setOrigin(tiledW / 2.0f, tiledH / 2.0f);
         float overlayWidthScreen = focalLength * overlay.width / perpWorldDistance;
         float overlayHeightScreen = focalLength * overlay.height / perpWorldDistance;
-        overlaySprite.setScale(overlayWidthScreen / tiledW, overlayHeightScreen / tiledH);
 
+        // Overlays are centred on their point on the sprite
         float ox = spriteLeft + overlay.x * spriteWidthScreen;
         float oy = spriteTop + overlay.y * spriteHeightScreen;
-        overlaySprite.setPosition(ox, oy);
 
-        overlaySprite.setColor(sf::Color(shadeValue, shadeValue, shadeValue, 255));
-        m_renderTexture.draw(overlaySprite);
+        const sf::FloatRect overlayRect(ox - overlayWidthScreen / 2.0f, oy - overlayHeightScreen / 2.0f, overlayWidthScreen, overlayHeightScreen);
+        const sf::Vector2f overlayRepeats(static_cast<float>(tiledW) / overlayTexSize.x, static_cast<float>(tiledH) / overlayTexSize.y);
+        m_billboardQuads.push_back({overlayRegion, overlayRect, {0.f, 0.f}, overlayRepeats, shadeValue});
     }
 }
 
-void TwoHalfD::Renderer::renderEffect(const TwoHalfD::AnimationEffect &effect, const CameraObject &camera) {
+void TwoHalfD::Renderer::buildEffectQuads(const TwoHalfD::AnimationEffect &effect, const CameraObject &camera) {
     const auto *templates = m_entityManager->getAnimationTemplates();
     if (!templates) return;
 
@@ -325,157 +383,150 @@ void TwoHalfD::Renderer::renderEffect(const TwoHalfD::AnimationEffect &effect, c
     if (tmplIt == templates->end() || tmplIt->second.frames.empty()) return;
 
     int texId = tmplIt->second.frames[effect.animState.frameIndex].textureId;
-    auto texIt = m_textures->find(texId);
-    if (texIt == m_textures->end()) return;
+    const TwoHalfD::AtlasRegion *region = m_textureAtlas.findRegion(texId);
+    if (!region) return;
 
-    const sf::Texture &tex = texIt->second.texture;
-    const sf::Vector2u texSize = tex.getSize();
+    const sf::Vector2i texSize(region->pixelRect.width, region->pixelRect.height);
 
-    float cameraDirRad = camera.cameraPos.direction;
-    sf::Vector2f direction{std::cos(cameraDirRad), std::sin(cameraDirRad)};
-    sf::Vector2f n_plane{-direction.y, direction.x};
     float focalLength = (m_settings.resolution.x / 2.0f) / m_settings.fovScale;
 
-    sf::Vector2f toEffect = sf::Vector2f(effect.pos.x, effect.pos.y) - camera.cameraPos.posf;
-    float signedPerpWorldDistance = dotProduct(toEffect, direction);
-    if (signedPerpWorldDistance <= 0) return;
+    TwoHalfD::ProjectedBillboard projected;
+    if (!TwoHalfD::projectBillboard(effect.pos, effect.heightStart, effect.height, camera, m_settings, projected)) return;
 
-    float bottomScreen = focalLength * (camera.cameraHeight + camera.cameraHeightStart - effect.heightStart) / signedPerpWorldDistance +
-                         m_settings.resolution.y / 2.0f;
-    float topScreen = focalLength * (camera.cameraHeight + camera.cameraHeightStart - effect.height - effect.heightStart) / signedPerpWorldDistance +
-                      m_settings.resolution.y / 2.0f;
-    float heightScreen = bottomScreen - topScreen;
+    float signedPerpWorldDistance = projected.distance;
+    float topScreen = projected.top;
+    float heightScreen = projected.bottom - projected.top;
     float widthScreen = focalLength * effect.width / signedPerpWorldDistance;
-    float screenX = (m_settings.resolution.x / 2.0f) + focalLength * dotProduct(toEffect, n_plane) / signedPerpWorldDistance;
+    float screenX = projected.screenX;
 
     int tiledW = static_cast<int>(texSize.x / effect.scaleX);
     int tiledH = static_cast<int>(texSize.y / effect.scaleY);
 
-    sf::Sprite sprite;
-    sprite.setTexture(tex);
-    sprite.setTextureRect(sf::IntRect(0, 0, tiledW, tiledH));
-    sprite.setOrigin(tiledW / 2.0f, tiledH / 2.0f);
-    sprite.setPosition(screenX, topScreen + heightScreen / 2.0f);
-    sprite.setScale(widthScreen / tiledW, heightScreen / tiledH);
-
     float shade = std::min(1.0f, m_settings.shaderScale / signedPerpWorldDistance);
     sf::Uint8 shadeValue = static_cast<sf::Uint8>(255 * shade);
-    sprite.setColor(sf::Color(shadeValue, shadeValue, shadeValue, 255));
-    m_renderTexture.draw(sprite);
+    m_billboardQuads.push_back({region, sf::FloatRect(screenX - widthScreen / 2.0f, topScreen, widthScreen, heightScreen), {0.f, 0.f},
+                                sf::Vector2f(static_cast<float>(tiledW) / texSize.x, static_cast<float>(tiledH) / texSize.y), shadeValue});
 }
 
-void TwoHalfD::Renderer::renderFloorSection(const TwoHalfD::FloorSection *floorSection, const CameraObject &camera) {
-    float focalLength = (m_settings.resolution.x / 2.0f) / m_settings.fovScale;
-    XYVectorf n_direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
-    XYVectorf n_plane{-n_direction.y, n_direction.x};
-    const float NEAR_CLIP = 100.0f;
-
-    auto texIt = m_textures->find(floorSection->textureId);
-    if (texIt == m_textures->end()) {
-        std::cerr << "No texture found for floor section with texture id: " << floorSection->textureId << std::endl;
-        return;
+void TwoHalfD::Renderer::addBillboard(const BillboardQuad &billboard) {
+    const sf::Texture *page = &m_textureAtlas.getPage(billboard.region->page);
+    if (page != m_billboardBatch.texture || m_billboardBatch.rects.size() == MAX_BATCH_BILLBOARDS) {
+        flushBillboards();
+        m_billboardBatch.texture = page;
     }
-    const sf::Texture &floorTileTexture = texIt->second.texture;
-
-    std::vector<XYVectorf> vertices{};
-    size_t n = floorSection->vertices.size();
-    vertices.reserve(n);
 
-    for (size_t i{}; i < n; ++i) {
-        const XYVectorf &curr = floorSection->vertices[i];
-        const XYVectorf &next = floorSection->vertices[(i + 1) % n];
+    const sf::Color batchIndexAndShade(static_cast<sf::Uint8>(m_billboardBatch.rects.size()), billboard.shade, 0);
+    m_billboardBatch.rects.push_back(billboard.region->uvRect);
 
-        float dotCurr = dotProduct(curr - camera.cameraPos.posf, n_direction);
-        float dotNext = dotProduct(next - camera.cameraPos.posf, n_direction);
+    const sf::FloatRect &rect = billboard.screenRect;
+    const float right = rect.left + rect.width;
+    const float bottom = rect.top + rect.height;
+    const sf::Vector2f &start = billboard.repeatsStart;
+    const sf::Vector2f &end = billboard.repeatsEnd;
 
-        bool currInFront = dotCurr > NEAR_CLIP;
-        bool nextInFront = dotNext > NEAR_CLIP;
-
-        if (currInFront) vertices.push_back(curr);
+    auto &vertices = m_billboardBatch.vertices;
+    vertices.emplace_back(sf::Vector2f(rect.left, rect.top), batchIndexAndShade, start);
+    vertices.emplace_back(sf::Vector2f(right, rect.top), batchIndexAndShade, sf::Vector2f(end.x, start.y));
+    vertices.emplace_back(sf::Vector2f(right, bottom), batchIndexAndShade, end);
+    vertices.emplace_back(sf::Vector2f(rect.left, bottom), batchIndexAndShade, sf::Vector2f(start.x, end.y));
+}
 
-        if (currInFront != nextInFront) {
-            float t = (NEAR_CLIP - dotCurr) / (dotNext - dotCurr);
-            XYVectorf intersectionPoint = curr + t * (next - curr);
-            vertices.push_back(intersectionPoint);
-        }
-    }
+void TwoHalfD::Renderer::flushBillboards() {
+    if (m_billboardBatch.vertices.empty()) return;
 
-    sf::VertexArray floorShape(sf::PrimitiveType::TriangleFan, vertices.size());
-    for (size_t i = 0; i < vertices.size(); ++i) {
-        XYVectorf cameraVertexVec = vertices[i] - camera.cameraPos.posf;
-        float perpWorldDistance = dotProduct(cameraVertexVec, n_direction);
-        float lateralDist = dotProduct(cameraVertexVec, n_plane);
-        float p_xScreenPos = (m_settings.resolution.x / 2.0f) + focalLength * lateralDist / perpWorldDistance;
-        float p_yScreenPos = (m_settings.resolution.y / 2.0f) +
-                             focalLength * (camera.cameraHeight + camera.cameraHeightStart - floorSection->height) / perpWorldDistance;
-        floorShape[i].position = sf::Vector2f(p_xScreenPos, p_yScreenPos);
-    }
+    m_billboardShader.setUniform("texture", *m_billboardBatch.texture);
+    m_billboardShader.setUniformArray("billboardRects", m_billboardBatch.rects.data(), m_billboardBatch.rects.size());
+    m_billboardShader.setUniform("floorOrder", m_floorOrder);
 
     sf::RenderStates states;
-    states.texture = &floorTileTexture;
-    states.shader = &m_floorShader;
-
-    m_floorShader.setUniform("textureStartCord", sf::Vector2f(floorSection->floorTextureStart.x, floorSection->floorTextureStart.y));
-    m_floorShader.setUniform("texture", floorTileTexture);
-    m_floorShader.setUniform("textureSize", sf::Vector2f(floorTileTexture.getSize()));
-    m_floorShader.setUniform("cameraPos", camera.cameraPos.posf);
-    m_floorShader.setUniform("n_plane", sf::Vector2f(n_plane.x, n_plane.y));
-    m_floorShader.setUniform("relativeCameraHeight", camera.cameraHeight + camera.cameraHeightStart - floorSection->height);
-    m_floorShader.setUniform("direction", sf::Vector2f(n_direction.x, n_direction.y));
-    m_floorShader.setUniform("focalLength", focalLength);
-    m_floorShader.setUniform("resolution", sf::Vector2f(m_settings.resolution));
-    m_floorShader.setUniform("distanceCutoff", 3000.0f);
-    m_floorShader.setUniform("shaderScale", m_settings.shaderScale);
+    states.shader = &m_billboardShader;
+    m_renderTexture.draw(m_billboardBatch.vertices.data(), m_billboardBatch.vertices.size(), sf::Quads, states);
 
-    m_renderTexture.draw(floorShape, states);
+    m_billboardBatch.vertices.clear();
+    m_billboardBatch.rects.clear();
 }
 
 void TwoHalfD::Renderer::renderColourOverlay(const TwoHalfD::FloorColourOverlay *overlay, const CameraObject &camera) {
-    float focalLength = (m_settings.resolution.x / 2.0f) / m_settings.fovScale;
-    XYVectorf n_direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
-    XYVectorf n_plane{-n_direction.y, n_direction.x};
-    const float NEAR_CLIP = 100.0f;
-
-    std::vector<XYVectorf> vertices{};
-    size_t n = overlay->vertices.size();
-    vertices.reserve(n);
+    TwoHalfD::projectFloorPolygon(overlay->vertices, camera.cameraHeight - overlay->height, camera, m_settings, m_floorVertices);
+    if (m_floorVertices.size() < 3) return;
 
-    for (size_t i{}; i < n; ++i) {
-        const XYVectorf &curr = overlay->vertices[i];
-        const XYVectorf &next = overlay->vertices[(i + 1) % n];
+    const sf::Color colour(overlay->r, overlay->g, overlay->b, overlay->a);
+    m_overlayVertices.clear();
+    for (const sf::Vector2f &position : m_floorVertices) {
+        m_overlayVertices.emplace_back(position, colour);
+    }
 
-        float dotCurr = dotProduct(curr - camera.cameraPos.posf, n_direction);
-        float dotNext = dotProduct(next - camera.cameraPos.posf, n_direction);
+    sf::RenderStates states;
+    states.blendMode = sf::BlendAlpha;
+    states.shader = &m_colourOverlayShader;
+    m_colourOverlayShader.setUniform("floorOrder", m_floorOrder);
+    m_renderTexture.draw(m_overlayVertices.data(), m_overlayVertices.size(), sf::TriangleFan, states);
+}
 
-        bool currInFront = dotCurr > NEAR_CLIP;
-        bool nextInFront = dotNext > NEAR_CLIP;
+void TwoHalfD::Renderer::buildFloorIds(const CameraObject &camera) {
+    const auto &commands = m_drawList.commands;
+    const float eyeHeight = camera.cameraHeight + camera.cameraHeightStart;
+    const float focalLength = (m_settings.resolution.x / 2.0f) / m_settings.fovScale;
 
-        if (currInFront) vertices.push_back(curr);
+    m_floorSlots.clear();
+    m_floorIdVertices.clear();
+    m_commandFloorOrder.resize(commands.size());
 
-        if (currInFront != nextInFront) {
-            float t = (NEAR_CLIP - dotCurr) / (dotNext - dotCurr);
-            XYVectorf intersectionPoint = curr + t * (next - curr);
-            vertices.push_back(intersectionPoint);
+    const TwoHalfD::AtlasRegion *defaultRegion = nullptr;
+    if (m_defaultFloorTextureId != -1) {
+        defaultRegion = m_textureAtlas.findRegion(m_defaultFloorTextureId);
+        if (!defaultRegion) {
+            std::cerr << "No texture found for default floor with texture id: " << m_defaultFloorTextureId << std::endl;
+            exit(1);
         }
     }
+    const sf::Vector2f defaultSize = defaultRegion ? sf::Vector2f(defaultRegion->pixelRect.width, defaultRegion->pixelRect.height) : sf::Vector2f();
+    m_floorSlots.push_back({defaultRegion, sf::Glsl::Vec4(m_defaultFloorStart.x, m_defaultFloorStart.y, defaultSize.x, defaultSize.y),
+                            eyeHeight - m_defaultFloorHeight});
+
+    uint32_t floorOrder = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        m_commandFloorOrder[i] = floorOrder;
+        if (commands[i].type != TwoHalfD::DrawCommand::Type::FloorSection || m_floorSlots.size() == MAX_FLOOR_SLOTS) continue;
+
+        const TwoHalfD::FloorSection *floorSection = commands[i].floorSectionPtr;
+        const TwoHalfD::AtlasRegion *region = m_textureAtlas.findRegion(floorSection->textureId);
+        if (!region) {
+            std::cerr << "No texture found for floor section with texture id: " << floorSection->textureId << std::endl;
+            continue;
+        }
 
-    if (vertices.size() < 3) return;
-
-    sf::VertexArray floorShape(sf::PrimitiveType::TriangleFan, vertices.size());
-    sf::Color colour(overlay->r, overlay->g, overlay->b, overlay->a);
-    for (size_t i = 0; i < vertices.size(); ++i) {
-        XYVectorf cameraVertexVec = vertices[i] - camera.cameraPos.posf;
-        float perpWorldDistance = dotProduct(cameraVertexVec, n_direction);
-        float lateralDist = dotProduct(cameraVertexVec, n_plane);
-        float p_xScreenPos = (m_settings.resolution.x / 2.0f) + focalLength * lateralDist / perpWorldDistance;
-        float p_yScreenPos = (m_settings.resolution.y / 2.0f) + focalLength * (camera.cameraHeight - overlay->height) / perpWorldDistance;
-        floorShape[i].position = sf::Vector2f(p_xScreenPos, p_yScreenPos);
-        floorShape[i].color = colour;
+        const float relativeHeight = eyeHeight - floorSection->height;
+        TwoHalfD::projectFloorPolygon(floorSection->vertices, relativeHeight, camera, m_settings, m_floorVertices);
+        // Past the cutoff the floor shader draws nothing, so there the pixel keeps the floor beneath, as when each floor was its own pass
+        const float cutoffRow = m_settings.resolution.y / 2.0f + relativeHeight * focalLength / TwoHalfD::FLOOR_DISTANCE_CUTOFF;
+        const float nearRow = m_settings.resolution.y / 2.0f + relativeHeight * focalLength / 0.001f;
+        if (m_floorVertices.size() >= 3) {
+            TwoHalfD::clipPolygonRows(m_floorVertices, std::min(cutoffRow, nearRow), std::max(cutoffRow, nearRow), m_floorClipVertices);
+        }
+        if (m_floorVertices.size() < 3) continue;
+
+        floorOrder = static_cast<uint32_t>(m_floorSlots.size());
+        m_commandFloorOrder[i] = floorOrder;
+        m_floorSlots.push_back({region,
+                                sf::Glsl::Vec4(floorSection->floorTextureStart.x, floorSection->floorTextureStart.y, region->pixelRect.width,
+                                               region->pixelRect.height),
+                                relativeHeight});
+
+        // The fan split into triangles the way the GPU splits it, so every floor goes out in one call
+        const sf::Color slotColour(static_cast<sf::Uint8>(floorOrder & 0xFF), static_cast<sf::Uint8>(floorOrder >> 8), 0);
+        for (size_t v = 1; v + 1 < m_floorVertices.size(); ++v) {
+            m_floorIdVertices.emplace_back(m_floorVertices[0], slotColour);
+            m_floorIdVertices.emplace_back(m_floorVertices[v], slotColour);
+            m_floorIdVertices.emplace_back(m_floorVertices[v + 1], slotColour);
+        }
     }
 
-    sf::RenderStates states;
-    states.blendMode = sf::BlendAlpha;
-    m_renderTexture.draw(floorShape, states);
+    m_floorIds.clear(sf::Color::Transparent);
+    if (!m_floorIdVertices.empty()) {
+        m_floorIds.draw(m_floorIdVertices.data(), m_floorIdVertices.size(), sf::Triangles, sf::RenderStates(sf::BlendNone));
+    }
+    m_floorIds.display();
 }
 
 void TwoHalfD::Renderer::renderFloor(const CameraObject &camera) {
@@ -483,37 +534,52 @@ void TwoHalfD::Renderer::renderFloor(const CameraObject &camera) {
     XYVectorf n_direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
     XYVectorf n_plane{-n_direction.y, n_direction.x};
 
-    if (m_defaultFloorTextureId != -1) {
-        auto it = m_textures->find(m_defaultFloorTextureId);
-        if (it == m_textures->end()) {
-            std::cerr << "No texture found for default floor with texture id: " << m_defaultFloorTextureId << std::endl;
-            exit(1);
+    m_floorShader.setUniform("cameraPos", sf::Vector2f(camera.cameraPos.pos.x, camera.cameraPos.pos.y));
+    m_floorShader.setUniform("n_plane", sf::Vector2f(n_plane.x, n_plane.y));
+    m_floorShader.setUniform("direction", sf::Vector2f(n_direction.x, n_direction.y));
+    m_floorShader.setUniform("focalLength", focalLength);
+    m_floorShader.setUniform("distanceCutoff", TwoHalfD::FLOOR_DISTANCE_CUTOFF);
+    m_floorShader.setUniform("shaderScale", m_settings.shaderScale);
+
+    m_floorQuad[0].position = sf::Vector2f(0, 0);
+    m_floorQuad[1].position = sf::Vector2f(0, m_settings.resolution.y);
+    m_floorQuad[2].position = sf::Vector2f(m_settings.resolution.x, m_settings.resolution.y);
+    m_floorQuad[3].position = sf::Vector2f(m_settings.resolution.x, 0);
+
+    sf::RenderStates states;
+    states.shader = &m_floorShader;
+
+    // One pass per atlas page the slots of a range use; with the usual single page and up to 64 floors that is one pass in all
+    std::array<sf::Glsl::Vec4, FLOOR_SLOTS_PER_PASS> rects;
+    std::array<sf::Glsl::Vec4, FLOOR_SLOTS_PER_PASS> textures;
+    std::array<float, FLOOR_SLOTS_PER_PASS> heights;
+    for (size_t slotBase = 0; slotBase < m_floorSlots.size(); slotBase += FLOOR_SLOTS_PER_PASS) {
+        const size_t slotEnd = std::min(m_floorSlots.size(), slotBase + FLOOR_SLOTS_PER_PASS);
+        for (size_t first = slotBase; first < slotEnd; ++first) {
+            const TwoHalfD::AtlasRegion *region = m_floorSlots[first].region;
+            if (!region) continue;
+            bool pageDrawn = false;
+            for (size_t earlier = slotBase; earlier < first && !pageDrawn; ++earlier) {
+                pageDrawn = m_floorSlots[earlier].region && m_floorSlots[earlier].region->page == region->page;
+            }
+            if (pageDrawn) continue;
+
+            // Slots on other pages get height 0, which the shader discards as it does any floor level with the eye
+            for (size_t slot = slotBase; slot < slotEnd; ++slot) {
+                const FloorSlot &floor = m_floorSlots[slot];
+                const bool onPage = floor.region && floor.region->page == region->page;
+                rects[slot - slotBase] = onPage ? floor.region->uvRect : sf::Glsl::Vec4();
+                textures[slot - slotBase] = floor.texture;
+                heights[slot - slotBase] = onPage ? floor.relativeHeight : 0.f;
+            }
+
+            m_floorShader.setUniform("texture", m_textureAtlas.getPage(region->page));
+            m_floorShader.setUniform("slotBase", static_cast<float>(slotBase));
+            m_floorShader.setUniformArray("floorRects", rects.data(), slotEnd - slotBase);
+            m_floorShader.setUniformArray("floorTextures", textures.data(), slotEnd - slotBase);
+            m_floorShader.setUniformArray("floorHeights", heights.data(), slotEnd - slotBase);
+            m_renderTexture.draw(m_floorQuad.data(), m_floorQuad.size(), sf::Quads, states);
         }
-        const sf::Texture &floorTileTexture = it->second.texture;
-
-        sf::VertexArray quad(sf::Quads, 4);
-        quad[0].position = sf::Vector2f(0, m_settings.resolution.y / 2.0f);
-        quad[1].position = sf::Vector2f(0, m_settings.resolution.y);
-        quad[2].position = sf::Vector2f(m_settings.resolution.x, m_settings.resolution.y);
-        quad[3].position = sf::Vector2f(m_settings.resolution.x, m_settings.resolution.y / 2.0f);
-
-        sf::RenderStates states;
-        states.texture = &floorTileTexture;
-        states.shader = &m_floorShader;
-
-        m_floorShader.setUniform("textureStartCord", sf::Vector2f(m_defaultFloorStart.x, m_defaultFloorStart.y));
-        m_floorShader.setUniform("texture", floorTileTexture);
-        m_floorShader.setUniform("textureSize", sf::Vector2f(floorTileTexture.getSize()));
-        m_floorShader.setUniform("cameraPos", sf::Vector2f(camera.cameraPos.pos.x, camera.cameraPos.pos.y));
-        m_floorShader.setUniform("relativeCameraHeight", camera.cameraHeight + camera.cameraHeightStart - m_defaultFloorHeight);
-        m_floorShader.setUniform("n_plane", sf::Vector2f(n_plane.x, n_plane.y));
-        m_floorShader.setUniform("direction", sf::Vector2f(n_direction.x, n_direction.y));
-        m_floorShader.setUniform("focalLength", focalLength);
-        m_floorShader.setUniform("resolution", sf::Vector2f(m_settings.resolution));
-        m_floorShader.setUniform("distanceCutoff", 3000.0f);
-        m_floorShader.setUniform("shaderScale", m_settings.shaderScale);
-
-        m_renderTexture.draw(quad, states);
     }
 }
 
@@ -0,0 +1,610 @@
+#include "TwoHalfD/software_renderer.h"
+#include "TwoHalfD/utils/render_util.h"
+
+#include <SFML/Graphics/Image.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+
+// SSE2 is part of every x86-64 target, so no compiler flags are needed for it
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TWOHALFD_SSE2
+#endif
+
+namespace {
+constexpr uint32_t packColour(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+// Writes src over dst the way sf::BlendAlpha does: colour by source alpha, alpha added on top of what is left of the destination's
+inline void blendPixel(uint32_t &dst, uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    if (a == 255) {
+        dst = packColour(r, g, b, 255);
+        return;
+    }
+    if (a == 0) return;
+    const uint32_t inv = 255 - a;
+    const uint32_t dr = dst & 0xff, dg = (dst >> 8) & 0xff, db = (dst >> 16) & 0xff, da = dst >> 24;
+    dst = packColour((r * a + dr * inv + 127) / 255, (g * a + dg * inv + 127) / 255, (b * a + db * inv + 127) / 255, a + (da * inv + 127) / 255);
+}
+
+// A texel scaled by a distance shade in [0, 1], as the shaders do before blending
+inline void shadeAndBlend(uint32_t &dst, uint32_t texel, float shade) {
+    const uint32_t r = static_cast<uint32_t>((texel & 0xff) * shade + 0.5f);
+    const uint32_t g = static_cast<uint32_t>(((texel >> 8) & 0xff) * shade + 0.5f);
+    const uint32_t b = static_cast<uint32_t>(((texel >> 16) & 0xff) * shade + 0.5f);
+    blendPixel(dst, r, g, b, texel >> 24);
+}
+
+// Index of the texel a repeating coordinate in [0, 1) texture units lands on
+inline int wrapTexel(float coord, unsigned int size) {
+    const float wrapped = coord - std::floor(coord);
+    return std::min(static_cast<int>(wrapped * size), static_cast<int>(size) - 1);
+}
+
+// First pixel whose centre is at or past edge, clamped to [lo, hi]. Keeps huge or non-finite edges away from the int conversion.
+inline int pixelFrom(float edge, int lo, int hi) {
+    const float first = std::ceil(edge - 0.5f);
+    if (!(first > lo)) return lo;
+    if (first >= hi) return hi;
+    return static_cast<int>(first);
+}
+} // namespace
+
+TwoHalfD::SoftwareRenderer::SoftwareRenderer(const EngineSettings &settings)
+    : m_settings(settings), m_width(settings.resolution.x), m_height(settings.resolution.y) {
+    m_framebuffer.assign(static_cast<size_t>(m_width) * m_height, 0);
+
+    // The calling thread draws strips too, so it counts as one of the threads
+    const unsigned int threadCount = settings.softwareRenderThreads ? settings.softwareRenderThreads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        m_workers.emplace_back(&SoftwareRenderer::_workerLoop, this);
+    }
+}
+
+TwoHalfD::SoftwareRenderer::~SoftwareRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        m_stopping = true;
+    }
+    m_workReady.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::setData(const std::unordered_map<int, TextureSignature> *textures, const EntityManager *entityManager,
+                                         float defaultFloorHeight, int defaultFloorTextureId, XYVectorf defaultFloorStart) {
+    m_entityManager = entityManager;
+    m_defaultFloorHeight = defaultFloorHeight;
+    m_defaultFloorTextureId = defaultFloorTextureId;
+    m_defaultFloorStart = defaultFloorStart;
+
+    // Pixels come from the image files so nothing has to be read back from the GPU, which may not exist
+    m_textures.clear();
+    for (const auto &[id, signature] : *textures) {
+        if (id < 0) continue;
+        sf::Image image;
+        if (!image.loadFromFile(std::filesystem::path(ASSETS_DIR) / signature.filePath)) {
+            image = signature.texture.copyToImage();
+        }
+        const sf::Vector2u size = image.getSize();
+        if (size.x == 0 || size.y == 0) {
+            std::cerr << "Software renderer could not read texture id: " << id << " (" << signature.filePath << ")\n";
+            continue;
+        }
+
+        if (static_cast<size_t>(id) >= m_textures.size()) m_textures.resize(id + 1);
+        SoftwareTexture &texture = m_textures[id];
+        texture.width = size.x;
+        texture.height = size.y;
+        texture.pixels.resize(static_cast<size_t>(size.x) * size.y);
+        std::memcpy(texture.pixels.data(), image.getPixelsPtr(), texture.pixels.size() * sizeof(uint32_t));
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::render(const CameraObject &camera, BSPManager &bsp) {
+    bsp.update(camera, m_settings, m_drawList);
+    _prepareFrame(camera, bsp);
+
+    m_stripCount = static_cast<int>((m_height + STRIP_HEIGHT - 1) / STRIP_HEIGHT);
+    m_nextStrip.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        ++m_frameNumber;
+        m_workersBusy = static_cast<unsigned int>(m_workers.size());
+    }
+    m_workReady.notify_all();
+
+    _drawStrips();
+
+    std::unique_lock<std::mutex> lock(m_workMutex);
+    m_workDone.wait(lock, [this] { return m_workersBusy == 0; });
+}
+
+const TwoHalfD::SoftwareRenderer::SoftwareTexture *TwoHalfD::SoftwareRenderer::_findTexture(int textureId) const {
+    if (textureId < 0 || static_cast<size_t>(textureId) >= m_textures.size()) return nullptr;
+    const SoftwareTexture &texture = m_textures[textureId];
+    return texture.pixels.empty() ? nullptr : &texture;
+}
+
+void TwoHalfD::SoftwareRenderer::_prepareFrame(const CameraObject &camera, BSPManager &bsp) {
+    m_frame.halfX = m_settings.resolution.x / 2.0f;
+    m_frame.halfY = m_settings.resolution.y / 2.0f;
+    m_frame.focalLength = m_frame.halfX / m_settings.fovScale;
+    m_frame.eyeHeight = camera.cameraHeight + camera.cameraHeightStart;
+    m_frame.defaultFloorHeight = m_defaultFloorHeight;
+    m_frame.shaderScale = m_settings.shaderScale;
+    m_frame.cameraPos = camera.cameraPos.pos;
+    m_frame.direction = {std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
+    m_frame.plane = {-m_frame.direction.y, m_frame.direction.x};
+
+    m_commands.clear();
+    m_walls.clear();
+    m_floors.clear();
+    m_billboards.clear();
+    m_colourOverlays.clear();
+    m_polygonVertices.clear();
+
+    if (m_defaultFloorTextureId != -1) {
+        const SoftwareTexture *texture = _findTexture(m_defaultFloorTextureId);
+        if (!texture) {
+            std::cerr << "No texture found for default floor with texture id: " << m_defaultFloorTextureId << std::endl;
+            exit(1);
+        }
+        const float width = static_cast<float>(m_settings.resolution.x);
+        const float height = static_cast<float>(m_settings.resolution.y);
+        const uint32_t firstVertex = static_cast<uint32_t>(m_polygonVertices.size());
+        m_polygonVertices.insert(m_polygonVertices.end(), {{0.f, m_frame.halfY}, {0.f, height}, {width, height}, {width, m_frame.halfY}});
+        m_floors.push_back({firstVertex, 4, m_frame.eyeHeight - m_defaultFloorHeight, m_defaultFloorStart, texture});
+        m_commands.push_back({RasterCommand::Type::Floor, static_cast<uint32_t>(m_floors.size() - 1)});
+    }
+
+    for (const auto &command : m_drawList.commands) {
+        switch (command.type) {
+        case TwoHalfD::DrawCommand::Type::Segment: {
+            _prepareSegment(bsp.getSegment(command.id), camera);
+            break;
+        }
+        case TwoHalfD::DrawCommand::Type::Sprite: {
+            const auto &entities = m_entityManager->getAllEntities();
+            auto it = entities.find(command.id);
+            if (it != entities.end()) _prepareSprite(it->second, camera);
+            break;
+        }
+        case TwoHalfD::DrawCommand::Type::FloorSection: {
+            const FloorSection *floorSection = command.floorSectionPtr;
+            _prepareFloor(floorSection->vertices, floorSection->height, floorSection->textureId, floorSection->floorTextureStart, camera);
+            break;
+        }
+        case TwoHalfD::DrawCommand::Type::Effect: {
+            const auto &effects = m_entityManager->getAllEffects();
+            auto it = effects.find(command.id);
+            if (it != effects.end()) _prepareEffect(it->second, camera);
+            break;
+        }
+        case TwoHalfD::DrawCommand::Type::ColourOverlay: {
+            _prepareColourOverlay(*command.colourOverlayPtr, camera);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_prepareSegment(const Segment &segment, const CameraObject &camera) {
+    ProjectedWall projected;
+    if (!projectSegment(segment, camera, m_settings, projected)) return;
+
+    const SoftwareTexture *texture = _findTexture(projected.textureId);
+    if (!texture) {
+        std::cerr << "No texture found for wall: " << (segment.wall ? segment.wall->id : 1) << " with texture id: " << projected.textureId
+                  << std::endl;
+        exit(1);
+    }
+
+    RasterWall wall{projected.x1,
+                    projected.x2,
+                    projected.top1,
+                    projected.top2,
+                    projected.bottom1,
+                    projected.bottom2,
+                    projected.invZ1,
+                    projected.invZ2,
+                    projected.ratio1 / projected.scaleX * projected.invZ1,
+                    projected.ratio2 / projected.scaleX * projected.invZ2,
+                    projected.wallHeightStart + projected.height,
+                    1.f / (projected.height * projected.scaleY),
+                    texture};
+    if (wall.x2 < wall.x1) {
+        std::swap(wall.x1, wall.x2);
+        std::swap(wall.top1, wall.top2);
+        std::swap(wall.bottom1, wall.bottom2);
+        std::swap(wall.invZ1, wall.invZ2);
+        std::swap(wall.uOverZ1, wall.uOverZ2);
+    }
+    m_walls.push_back(wall);
+    m_commands.push_back({RasterCommand::Type::Wall, static_cast<uint32_t>(m_walls.size() - 1)});
+}
+
+void TwoHalfD::SoftwareRenderer::_prepareFloor(const Polygon &vertices, float height, int textureId, XYVectorf textureStart,
+                                               const CameraObject &camera) {
+    const SoftwareTexture *texture = _findTexture(textureId);
+    if (!texture) {
+        std::cerr << "No texture found for floor section with texture id: " << textureId << std::endl;
+        return;
+    }
+
+    projectFloorPolygon(vertices, m_frame.eyeHeight - height, camera, m_settings, m_projectScratch);
+    if (m_projectScratch.size() < 3) return;
+
+    const uint32_t firstVertex = static_cast<uint32_t>(m_polygonVertices.size());
+    m_polygonVertices.insert(m_polygonVertices.end(), m_projectScratch.begin(), m_projectScratch.end());
+    m_floors.push_back({firstVertex, static_cast<uint32_t>(m_projectScratch.size()), m_frame.eyeHeight - height, textureStart, texture});
+    m_commands.push_back({RasterCommand::Type::Floor, static_cast<uint32_t>(m_floors.size() - 1)});
+}
+
+void TwoHalfD::SoftwareRenderer::_prepareSprite(const SpriteEntity &spriteEntity, const CameraObject &camera) {
+    const auto *templates = m_entityManager->getAnimationTemplates();
+
+    int textureId = spriteEntity.textureId;
+    if (spriteEntity.currentAnimation && templates) {
+        const auto &animState = *spriteEntity.currentAnimation;
+        auto tmplIt = templates->find(animState.templateId);
+        if (tmplIt != templates->end() && !tmplIt->second.frames.empty()) {
+            textureId = tmplIt->second.frames[animState.frameIndex].textureId;
+        }
+    }
+
+    const SoftwareTexture *texture = _findTexture(textureId);
+    if (!texture) {
+        std::cerr << "No texture found for sprite: " << spriteEntity.id << " with texture id: " << textureId << std::endl;
+        exit(1);
+    }
+
+    ProjectedBillboard projected;
+    if (!projectBillboard(spriteEntity.pos.pos, spriteEntity.heightStart, spriteEntity.height, camera, m_settings, projected)) return;
+
+    const int tiledW = static_cast<int>(texture->width / spriteEntity.scaleX);
+    const int tiledH = static_cast<int>(texture->height / spriteEntity.scaleY);
+    if (tiledW <= 0 || tiledH <= 0) return;
+
+    // Scaled uniformly to the projected height, centred on the projected point
+    const float spriteHeightScreen = projected.bottom - projected.top;
+    const float scale = spriteHeightScreen / tiledH;
+    const float left = projected.screenX - tiledW / 2.0f * scale;
+    const uint32_t shade = static_cast<uint8_t>(255 * std::min(1.0f, m_settings.shaderScale / projected.distance));
+    m_billboards.push_back({left, projected.top, left + tiledW * scale, projected.top + spriteHeightScreen, static_cast<float>(tiledW),
+                            static_cast<float>(tiledH), shade, texture});
+    m_commands.push_back({RasterCommand::Type::Billboard, static_cast<uint32_t>(m_billboards.size() - 1)});
+
+    // Overlays, already sorted by zOrder, anchored relative to the untiled texture's aspect
+    if (!templates) return;
+    const float spriteWidthScreen = spriteHeightScreen * (static_cast<float>(texture->width) / texture->height);
+    const float spriteLeft = projected.screenX - spriteWidthScreen / 2.0f;
+    for (size_t i = 0; i < spriteEntity.overlays.count; ++i) {
+        const auto &overlay = spriteEntity.overlays.overlays[i];
+        if (!overlay.active) continue;
+
+        auto tmplIt = templates->find(overlay.animState.templateId);
+        if (tmplIt == templates->end() || tmplIt->second.frames.empty()) continue;
+        const SoftwareTexture *overlayTexture = _findTexture(tmplIt->second.frames[overlay.animState.frameIndex].textureId);
+        if (!overlayTexture) continue;
+
+        const int overlayTiledW = static_cast<int>(overlayTexture->width / overlay.textureScaleX);
+        const int overlayTiledH = static_cast<int>(overlayTexture->height / overlay.textureScaleY);
+        if (overlayTiledW <= 0 || overlayTiledH <= 0) continue;
+
+        const float overlayWidthScreen = m_frame.focalLength * overlay.width / projected.distance;
+        const float overlayHeightScreen = m_frame.focalLength * overlay.height / projected.distance;
+        const float centreX = spriteLeft + overlay.x * spriteWidthScreen;
+        const float centreY = projected.top + overlay.y * spriteHeightScreen;
+        const float overlayLeft = centreX - overlayWidthScreen / 2.0f;
+        const float overlayTop = centreY - overlayHeightScreen / 2.0f;
+        m_billboards.push_back({overlayLeft, overlayTop, overlayLeft + overlayWidthScreen, overlayTop + overlayHeightScreen,
+                                static_cast<float>(overlayTiledW), static_cast<float>(overlayTiledH), shade, overlayTexture});
+        m_commands.push_back({RasterCommand::Type::Billboard, static_cast<uint32_t>(m_billboards.size() - 1)});
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_prepareEffect(const AnimationEffect &effect, const CameraObject &camera) {
+    const auto *templates = m_entityManager->getAnimationTemplates();
+    if (!templates) return;
+
+    auto tmplIt = templates->find(effect.animState.templateId);
+    if (tmplIt == templates->end() || tmplIt->second.frames.empty()) return;
+    const SoftwareTexture *texture = _findTexture(tmplIt->second.frames[effect.animState.frameIndex].textureId);
+    if (!texture) return;
+
+    ProjectedBillboard projected;
+    if (!projectBillboard(effect.pos, effect.heightStart, effect.height, camera, m_settings, projected)) return;
+
+    const int tiledW = static_cast<int>(texture->width / effect.scaleX);
+    const int tiledH = static_cast<int>(texture->height / effect.scaleY);
+    if (tiledW <= 0 || tiledH <= 0) return;
+
+    const float widthScreen = m_frame.focalLength * effect.width / projected.distance;
+    const float left = projected.screenX - widthScreen / 2.0f;
+    const uint32_t shade = static_cast<uint8_t>(255 * std::min(1.0f, m_settings.shaderScale / projected.distance));
+    m_billboards.push_back({left, projected.top, left + widthScreen, projected.bottom, static_cast<float>(tiledW), static_cast<float>(tiledH),
+                            shade, texture});
+    m_commands.push_back({RasterCommand::Type::Billboard, static_cast<uint32_t>(m_billboards.size() - 1)});
+}
+
+void TwoHalfD::SoftwareRenderer::_prepareColourOverlay(const FloorColourOverlay &overlay, const CameraObject &camera) {
+    projectFloorPolygon(overlay.vertices, camera.cameraHeight - overlay.height, camera, m_settings, m_projectScratch);
+    if (m_projectScratch.size() < 3) return;
+
+    const uint32_t firstVertex = static_cast<uint32_t>(m_polygonVertices.size());
+    m_polygonVertices.insert(m_polygonVertices.end(), m_projectScratch.begin(), m_projectScratch.end());
+    m_colourOverlays.push_back({firstVertex, static_cast<uint32_t>(m_projectScratch.size()), packColour(overlay.r, overlay.g, overlay.b, overlay.a)});
+    m_commands.push_back({RasterCommand::Type::ColourOverlay, static_cast<uint32_t>(m_colourOverlays.size() - 1)});
+}
+
+void TwoHalfD::SoftwareRenderer::_workerLoop() {
+    uint64_t lastFrame = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_workMutex);
+            m_workReady.wait(lock, [&] { return m_stopping || m_frameNumber != lastFrame; });
+            if (m_stopping) return;
+            lastFrame = m_frameNumber;
+        }
+
+        _drawStrips();
+
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        if (--m_workersBusy == 0) m_workDone.notify_one();
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_drawStrips() {
+    for (int strip = m_nextStrip.fetch_add(1, std::memory_order_relaxed); strip < m_stripCount;
+         strip = m_nextStrip.fetch_add(1, std::memory_order_relaxed)) {
+        const int rowBegin = strip * STRIP_HEIGHT;
+        _drawStrip(rowBegin, std::min(rowBegin + STRIP_HEIGHT, static_cast<int>(m_height)));
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_drawStrip(int rowBegin, int rowEnd) {
+    std::fill(m_framebuffer.begin() + static_cast<size_t>(rowBegin) * m_width, m_framebuffer.begin() + static_cast<size_t>(rowEnd) * m_width, 0u);
+
+    for (const auto &command : m_commands) {
+        switch (command.type) {
+        case RasterCommand::Type::Wall:
+            _drawWall(m_walls[command.index], rowBegin, rowEnd);
+            break;
+        case RasterCommand::Type::Floor:
+            _drawFloor(m_floors[command.index], rowBegin, rowEnd);
+            break;
+        case RasterCommand::Type::Billboard:
+            _drawBillboard(m_billboards[command.index], rowBegin, rowEnd);
+            break;
+        case RasterCommand::Type::ColourOverlay:
+            _drawColourOverlay(m_colourOverlays[command.index], rowBegin, rowEnd);
+            break;
+        }
+    }
+}
+
+// A wall is drawn a column at a time: depth, shade and the horizontal texel are fixed down a column, and each row only changes the world
+// height the pixel sees. Rows below the default floor are left alone, as perspectiveShader.frag discards them.
+void TwoHalfD::SoftwareRenderer::_drawWall(const RasterWall &wall, int rowBegin, int rowEnd) {
+    const int colBegin = pixelFrom(wall.x1, 0, static_cast<int>(m_width));
+    const int colEnd = pixelFrom(wall.x2, 0, static_cast<int>(m_width));
+    if (colBegin >= colEnd) return;
+
+    const SoftwareTexture &texture = *wall.texture;
+    const float invSpan = 1.0f / (wall.x2 - wall.x1);
+
+    for (int x = colBegin; x < colEnd; ++x) {
+        const float t = (x + 0.5f - wall.x1) * invSpan;
+        const float top = wall.top1 + (wall.top2 - wall.top1) * t;
+        const float bottom = wall.bottom1 + (wall.bottom2 - wall.bottom1) * t;
+        const int y0 = pixelFrom(top, rowBegin, rowEnd);
+        const int y1 = pixelFrom(bottom, rowBegin, rowEnd);
+        if (y0 >= y1) continue;
+
+        const float invZ = wall.invZ1 + (wall.invZ2 - wall.invZ1) * t;
+        const float z = 1.0f / invZ;
+        const float u = (wall.uOverZ1 + (wall.uOverZ2 - wall.uOverZ1) * t) * z;
+        const uint32_t *texColumn = texture.pixels.data() + wrapTexel(u, texture.width);
+        const float shade = std::min(1.0f, m_frame.shaderScale / z);
+        const float floorHeight = m_frame.defaultFloorHeight;
+        uint32_t *out = m_framebuffer.data() + x;
+
+        int y = y0;
+#ifdef TWOHALFD_SSE2
+        const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 halfY = _mm_set1_ps(m_frame.halfY);
+        const __m128 eye = _mm_set1_ps(m_frame.eyeHeight);
+        const __m128 zV = _mm_set1_ps(z);
+        const __m128 focal = _mm_set1_ps(m_frame.focalLength);
+        const __m128 floorV = _mm_set1_ps(floorHeight);
+        const __m128 topHeight = _mm_set1_ps(wall.topHeight);
+        const __m128 invHeightScale = _mm_set1_ps(wall.invHeightScale);
+        const __m128 texHeight = _mm_set1_ps(static_cast<float>(texture.height));
+        const __m128i maxRow = _mm_set1_epi32(static_cast<int>(texture.height) - 1);
+        const __m128 one = _mm_set1_ps(1.0f);
+        alignas(16) int rows[4];
+        for (; y + 4 <= y1; y += 4) {
+            const __m128 yc = _mm_add_ps(_mm_set1_ps(static_cast<float>(y)), laneOffsets);
+            const __m128 worldHeight = _mm_sub_ps(eye, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(yc, halfY), zV), focal));
+            const int visible = _mm_movemask_ps(_mm_cmpge_ps(worldHeight, floorV));
+            if (visible == 0) continue;
+
+            // fract, with floor built from a truncation that is one too high for negatives
+            const __m128 v = _mm_mul_ps(_mm_sub_ps(topHeight, worldHeight), invHeightScale);
+            __m128 floored = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+            floored = _mm_sub_ps(floored, _mm_and_ps(_mm_cmpgt_ps(floored, v), one));
+            __m128i row = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(v, floored), texHeight));
+            const __m128i over = _mm_cmpgt_epi32(row, maxRow);
+            row = _mm_or_si128(_mm_and_si128(over, maxRow), _mm_andnot_si128(over, row));
+            _mm_store_si128(reinterpret_cast<__m128i *>(rows), row);
+
+            for (int lane = 0; lane < 4; ++lane) {
+                if (visible & (1 << lane)) {
+                    shadeAndBlend(out[static_cast<size_t>(y + lane) * m_width], texColumn[static_cast<size_t>(rows[lane]) * texture.width], shade);
+                }
+            }
+        }
+#endif
+        for (; y < y1; ++y) {
+            const float worldHeight = m_frame.eyeHeight - (y + 0.5f - m_frame.halfY) * z / m_frame.focalLength;
+            if (worldHeight < floorHeight) continue;
+            const int row = wrapTexel((wall.topHeight - worldHeight) * wall.invHeightScale, texture.height);
+            shadeAndBlend(out[static_cast<size_t>(y) * m_width], texColumn[static_cast<size_t>(row) * texture.width], shade);
+        }
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_drawFloor(const RasterFloor &floor, int rowBegin, int rowEnd) {
+    _rasterizeFan(floor.firstVertex, floor.vertexCount, rowBegin, rowEnd,
+                  [&](int row, int xBegin, int xEnd) { _drawFloorSpan(floor, row, xBegin, xEnd); });
+}
+
+// One row of floor, as floorShader.frag: the row fixes the distance and the shade, and the world point seen moves along the camera plane
+// with x. The arithmetic follows the shader's order so both land on the same texels.
+void TwoHalfD::SoftwareRenderer::_drawFloorSpan(const RasterFloor &floor, int row, int xBegin, int xEnd) {
+    const float pixelsFromCenterY = row + 0.5f - m_frame.halfY;
+    const float perpWorldDistance = (floor.relativeHeight * m_frame.focalLength) / pixelsFromCenterY;
+    if (!(perpWorldDistance >= 0.001f && perpWorldDistance <= FLOOR_DISTANCE_CUTOFF)) return;
+
+    const SoftwareTexture &texture = *floor.texture;
+    const float texWidth = static_cast<float>(texture.width);
+    const float texHeight = static_cast<float>(texture.height);
+    const float shade = std::min(1.f, m_frame.shaderScale / perpWorldDistance);
+    const XYVectorf directionScaled = m_frame.direction * perpWorldDistance;
+    uint32_t *out = m_framebuffer.data() + static_cast<size_t>(row) * m_width;
+
+    int x = xBegin;
+#ifdef TWOHALFD_SSE2
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 halfX = _mm_set1_ps(m_frame.halfX);
+    const __m128 perp = _mm_set1_ps(perpWorldDistance);
+    const __m128 focal = _mm_set1_ps(m_frame.focalLength);
+    const __m128 planeX = _mm_set1_ps(m_frame.plane.x);
+    const __m128 planeY = _mm_set1_ps(m_frame.plane.y);
+    const __m128 cameraX = _mm_set1_ps(m_frame.cameraPos.x);
+    const __m128 cameraY = _mm_set1_ps(m_frame.cameraPos.y);
+    const __m128 dirX = _mm_set1_ps(directionScaled.x);
+    const __m128 dirY = _mm_set1_ps(directionScaled.y);
+    const __m128 startX = _mm_set1_ps(floor.textureStart.x);
+    const __m128 startY = _mm_set1_ps(floor.textureStart.y);
+    const __m128 sizeX = _mm_set1_ps(texWidth);
+    const __m128 sizeY = _mm_set1_ps(texHeight);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i maxX = _mm_set1_epi32(static_cast<int>(texture.width) - 1);
+    const __m128i maxY = _mm_set1_epi32(static_cast<int>(texture.height) - 1);
+    // floor from a truncation, which is one too high for negatives
+    auto floorPs = [&](__m128 value) {
+        const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), one));
+    };
+    auto clampIndex = [](__m128i index, __m128i max) {
+        const __m128i over = _mm_cmpgt_epi32(index, max);
+        return _mm_or_si128(_mm_and_si128(over, max), _mm_andnot_si128(over, index));
+    };
+    alignas(16) int texXs[4];
+    alignas(16) int texYs[4];
+    for (; x + 4 <= xEnd; x += 4) {
+        const __m128 pixelsFromCenterX = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets), halfX);
+        const __m128 planeDist = _mm_div_ps(_mm_mul_ps(perp, pixelsFromCenterX), focal);
+        const __m128 floorX = _mm_sub_ps(_mm_add_ps(_mm_add_ps(cameraX, _mm_mul_ps(planeX, planeDist)), dirX), startX);
+        const __m128 floorY = _mm_sub_ps(_mm_add_ps(_mm_add_ps(cameraY, _mm_mul_ps(planeY, planeDist)), dirY), startY);
+        // GLSL mod: x - y * floor(x / y)
+        const __m128 modX = _mm_sub_ps(floorX, _mm_mul_ps(sizeX, floorPs(_mm_div_ps(floorX, sizeX))));
+        const __m128 modY = _mm_sub_ps(floorY, _mm_mul_ps(sizeY, floorPs(_mm_div_ps(floorY, sizeY))));
+        _mm_store_si128(reinterpret_cast<__m128i *>(texXs), clampIndex(_mm_cvttps_epi32(modX), maxX));
+        _mm_store_si128(reinterpret_cast<__m128i *>(texYs), clampIndex(_mm_cvttps_epi32(modY), maxY));
+        for (int lane = 0; lane < 4; ++lane) {
+            shadeAndBlend(out[x + lane], texture.pixels[static_cast<size_t>(texYs[lane]) * texture.width + texXs[lane]], shade);
+        }
+    }
+#endif
+    for (; x < xEnd; ++x) {
+        const float planeDist = perpWorldDistance * (x + 0.5f - m_frame.halfX) / m_frame.focalLength;
+        const float floorX = m_frame.cameraPos.x + m_frame.plane.x * planeDist + directionScaled.x - floor.textureStart.x;
+        const float floorY = m_frame.cameraPos.y + m_frame.plane.y * planeDist + directionScaled.y - floor.textureStart.y;
+        const float modX = floorX - texWidth * std::floor(floorX / texWidth);
+        const float modY = floorY - texHeight * std::floor(floorY / texHeight);
+        const int texX = std::min(static_cast<int>(modX), static_cast<int>(texture.width) - 1);
+        const int texY = std::min(static_cast<int>(modY), static_cast<int>(texture.height) - 1);
+        shadeAndBlend(out[x], texture.pixels[static_cast<size_t>(texY) * texture.width + texX], shade);
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_drawBillboard(const RasterBillboard &billboard, int rowBegin, int rowEnd) {
+    const int colBegin = pixelFrom(billboard.left, 0, static_cast<int>(m_width));
+    const int colEnd = pixelFrom(billboard.right, 0, static_cast<int>(m_width));
+    const int y0 = pixelFrom(billboard.top, rowBegin, rowEnd);
+    const int y1 = pixelFrom(billboard.bottom, rowBegin, rowEnd);
+    if (colBegin >= colEnd || y0 >= y1) return;
+
+    const SoftwareTexture &texture = *billboard.texture;
+    // Texture units per screen pixel, in whole textures so wrapTexel can repeat them
+    const float uPerPixel = billboard.uMax / (billboard.right - billboard.left) / texture.width;
+    const float vPerPixel = billboard.vMax / (billboard.bottom - billboard.top) / texture.height;
+    const float shade = billboard.shade / 255.0f;
+
+    for (int y = y0; y < y1; ++y) {
+        const int texY = wrapTexel((y + 0.5f - billboard.top) * vPerPixel, texture.height);
+        const uint32_t *texRow = texture.pixels.data() + static_cast<size_t>(texY) * texture.width;
+        uint32_t *out = m_framebuffer.data() + static_cast<size_t>(y) * m_width;
+        for (int x = colBegin; x < colEnd; ++x) {
+            shadeAndBlend(out[x], texRow[wrapTexel((x + 0.5f - billboard.left) * uPerPixel, texture.width)], shade);
+        }
+    }
+}
+
+void TwoHalfD::SoftwareRenderer::_drawColourOverlay(const RasterColourOverlay &overlay, int rowBegin, int rowEnd) {
+    const uint32_t r = overlay.colour & 0xff, g = (overlay.colour >> 8) & 0xff, b = (overlay.colour >> 16) & 0xff, a = overlay.colour >> 24;
+    _rasterizeFan(overlay.firstVertex, overlay.vertexCount, rowBegin, rowEnd, [&](int row, int xBegin, int xEnd) {
+        uint32_t *out = m_framebuffer.data() + static_cast<size_t>(row) * m_width;
+        for (int x = xBegin; x < xEnd; ++x) {
+            blendPixel(out[x], r, g, b, a);
+        }
+    });
+}
+
+// Splits the fan into triangles the way the GPU does and hands drawSpan each row of each triangle as the pixels whose centres are inside.
+// Overlapping triangles of a concave polygon are drawn twice, as they are on the GPU.
+template <typename SpanFn>
+void TwoHalfD::SoftwareRenderer::_rasterizeFan(uint32_t firstVertex, uint32_t vertexCount, int rowBegin, int rowEnd, SpanFn &&drawSpan) const {
+    const sf::Vector2f *vertices = m_polygonVertices.data() + firstVertex;
+    const int width = static_cast<int>(m_width);
+
+    for (uint32_t i = 1; i + 1 < vertexCount; ++i) {
+        const sf::Vector2f corners[3] = {vertices[0], vertices[i], vertices[i + 1]};
+        const float minY = std::min({corners[0].y, corners[1].y, corners[2].y});
+        const float maxY = std::max({corners[0].y, corners[1].y, corners[2].y});
+        const int y0 = pixelFrom(minY, rowBegin, rowEnd);
+        const int y1 = pixelFrom(maxY, rowBegin, rowEnd);
+
+        for (int y = y0; y < y1; ++y) {
+            const float yc = y + 0.5f;
+            float left = std::numeric_limits<float>::infinity();
+            float right = -std::numeric_limits<float>::infinity();
+            for (int edge = 0; edge < 3; ++edge) {
+                const sf::Vector2f &a = corners[edge];
+                const sf::Vector2f &b = corners[(edge + 1) % 3];
+                const float edgeMinY = std::min(a.y, b.y);
+                const float edgeMaxY = std::max(a.y, b.y);
+                if (yc < edgeMinY || yc >= edgeMaxY) continue;
+                const float x = a.x + (b.x - a.x) * (yc - a.y) / (b.y - a.y);
+                left = std::min(left, x);
+                right = std::max(right, x);
+            }
+            if (!(left < right)) continue;
+
+            const int xBegin = pixelFrom(left, 0, width);
+            const int xEnd = pixelFrom(right, 0, width);
+            if (xBegin < xEnd) drawSpan(y, xBegin, xEnd);
+        }
+    }
+}
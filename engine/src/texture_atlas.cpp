@@ -0,0 +1,147 @@
+#include "TwoHalfD/texture_atlas.h"
+
+#include <algorithm>
+#include <iostream>
+
+void TwoHalfD::TextureAtlas::build(const std::unordered_map<int, TextureSignature> &textures,
+                                   const std::unordered_map<int, AnimationTemplate> *animationTemplates) {
+    clear();
+
+    if (animationTemplates) {
+        for (const auto &[templateId, animTemplate] : *animationTemplates) {
+            for (const auto &frame : animTemplate.frames) {
+                if (textures.find(frame.textureId) == textures.end()) {
+                    std::cerr << "Animation template " << templateId << " uses texture id " << frame.textureId << " which is not loaded\n";
+                }
+            }
+        }
+    }
+
+    struct Entry {
+        int id;
+        sf::Image image;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(textures.size());
+    int maxId = -1;
+    for (const auto &[id, signature] : textures) {
+        if (id < 0) continue;
+        sf::Image image = signature.texture.copyToImage();
+        if (image.getSize().x == 0 || image.getSize().y == 0) continue;
+        entries.push_back({id, std::move(image)});
+        maxId = std::max(maxId, id);
+    }
+    m_regions.assign(maxId + 1, AtlasRegion{});
+    if (entries.empty()) return;
+
+    // Tallest first so shelves waste little height; ties by id keep the layout the same from run to run
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        if (a.image.getSize().y != b.image.getSize().y) return a.image.getSize().y > b.image.getSize().y;
+        if (a.image.getSize().x != b.image.getSize().x) return a.image.getSize().x > b.image.getSize().x;
+        return a.id < b.id;
+    });
+
+    // Shelf packing: textures go left to right along a shelf, a texture that does not fit starts a new shelf below and one that does not
+    // fit below starts a new page. Textures too big for a page get a page of their own.
+    const unsigned int pageSize = std::min(MAX_PAGE_SIZE, sf::Texture::getMaximumSize());
+    struct Placement {
+        size_t entry;
+        unsigned int x;
+        unsigned int y;
+    };
+    std::vector<std::vector<Placement>> pagePlacements;
+    std::vector<sf::Vector2u> pageExtents;
+    int shelfPage = -1;
+    unsigned int shelfX = 0, shelfY = 0, shelfHeight = 0;
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const sf::Vector2u size = entries[i].image.getSize();
+        const unsigned int width = size.x + 2 * BORDER;
+        const unsigned int height = size.y + 2 * BORDER;
+
+        if (width > pageSize || height > pageSize) {
+            pagePlacements.push_back({{i, 0, 0}});
+            pageExtents.emplace_back(width, height);
+            continue;
+        }
+
+        if (shelfPage != -1 && shelfX + width > pageSize) {
+            shelfY += shelfHeight;
+            shelfX = 0;
+            shelfHeight = 0;
+        }
+        if (shelfPage == -1 || shelfY + height > pageSize) {
+            shelfPage = static_cast<int>(pagePlacements.size());
+            pagePlacements.emplace_back();
+            pageExtents.emplace_back(0, 0);
+            shelfX = shelfY = shelfHeight = 0;
+        }
+
+        pagePlacements[shelfPage].push_back({i, shelfX, shelfY});
+        pageExtents[shelfPage].x = std::max(pageExtents[shelfPage].x, shelfX + width);
+        pageExtents[shelfPage].y = std::max(pageExtents[shelfPage].y, shelfY + height);
+        shelfX += width;
+        shelfHeight = std::max(shelfHeight, height);
+    }
+
+    for (size_t pageIndex = 0; pageIndex < pagePlacements.size(); ++pageIndex) {
+        const sf::Vector2u extent = pageExtents[pageIndex];
+        sf::Image pageImage;
+        pageImage.create(extent.x, extent.y, sf::Color::Transparent);
+        for (const auto &placement : pagePlacements[pageIndex]) {
+            _copyWithBorder(pageImage, entries[placement.entry].image, placement.x, placement.y);
+        }
+
+        auto page = std::make_unique<sf::Texture>();
+        if (!page->loadFromImage(pageImage)) {
+            std::cerr << "Failed to create texture atlas page of size " << extent.x << "x" << extent.y << '\n';
+            continue;
+        }
+        page->setRepeated(false);
+        page->setSmooth(false);
+        m_pages.push_back(std::move(page));
+
+        const int pageNumber = static_cast<int>(m_pages.size()) - 1;
+        for (const auto &placement : pagePlacements[pageIndex]) {
+            const Entry &entry = entries[placement.entry];
+            const sf::Vector2u size = entry.image.getSize();
+            AtlasRegion &region = m_regions[entry.id];
+            region.page = pageNumber;
+            region.pixelRect = sf::IntRect(placement.x + BORDER, placement.y + BORDER, size.x, size.y);
+            region.uvRect = sf::Glsl::Vec4(static_cast<float>(region.pixelRect.left) / extent.x, static_cast<float>(region.pixelRect.top) / extent.y,
+                                           static_cast<float>(size.x) / extent.x, static_cast<float>(size.y) / extent.y);
+        }
+    }
+
+    std::cout << "Packed " << entries.size() << " textures into " << m_pages.size() << " atlas page(s)\n";
+}
+
+void TwoHalfD::TextureAtlas::clear() {
+    m_pages.clear();
+    m_regions.clear();
+}
+
+const TwoHalfD::AtlasRegion *TwoHalfD::TextureAtlas::findRegion(int textureId) const {
+    if (textureId < 0 || static_cast<size_t>(textureId) >= m_regions.size()) return nullptr;
+    const AtlasRegion &region = m_regions[textureId];
+    return region.page == -1 ? nullptr : &region;
+}
+
+void TwoHalfD::TextureAtlas::_copyWithBorder(sf::Image &page, const sf::Image &image, unsigned int x, unsigned int y) const {
+    const sf::Vector2u size = image.getSize();
+    page.copy(image, x + BORDER, y + BORDER);
+
+    // Repeat the outermost pixels into the border, corners included
+    for (unsigned int row = 0; row < size.y + 2 * BORDER; ++row) {
+        const unsigned int sourceY = std::min(size.y - 1, row > BORDER ? row - BORDER : 0);
+        for (unsigned int col = 0; col < size.x + 2 * BORDER; ++col) {
+            const bool inside = row >= BORDER && row < size.y + BORDER && col >= BORDER && col < size.x + BORDER;
+            if (inside) {
+                col = size.x + BORDER - 1;
+                continue;
+            }
+            const unsigned int sourceX = std::min(size.x - 1, col > BORDER ? col - BORDER : 0);
+            page.setPixel(x + col, y + row, image.getPixel(sourceX, sourceY));
+        }
+    }
+}
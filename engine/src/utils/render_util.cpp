@@ -0,0 +1,163 @@
+#include "TwoHalfD/utils/render_util.h"
+#include "TwoHalfD/utils/math_util.h"
+
+#include <cmath>
+
+bool TwoHalfD::projectSegment(const Segment &segment, const CameraObject &camera, const EngineSettings &settings, ProjectedWall &out) {
+    const float NEAR_CLIP = 50.0f;
+
+    // Floor boundaries are drawn as a wall from 0 up to the floor section
+    const TwoHalfD::Wall *wall = segment.wall;
+    out.textureId = wall ? wall->textureId : 1;
+    out.wallHeightStart = wall ? wall->wallHeightStart : 0.f;
+    out.height = wall ? wall->height : segment.floorSection->height;
+    out.scaleX = wall ? wall->scaleX : 1.f;
+    out.scaleY = wall ? wall->scaleY : 1.f;
+
+    float p_focalLength = (settings.resolution.x / 2.0f) / settings.fovScale;
+    TwoHalfD::XYVectorf n_direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
+    TwoHalfD::XYVectorf n_plane{-n_direction.y, n_direction.x};
+
+    TwoHalfD::XYVectorf vecCamV1 = segment.v1 - camera.cameraPos.pos;
+    TwoHalfD::XYVectorf vecCamV2 = segment.v2 - camera.cameraPos.pos;
+
+    float wallRatioStart = segment.wallRatioStart;
+    float wallRatioEnd = segment.wallRatioEnd;
+
+    float singedPerpWorldDistanceStart = dotProduct(vecCamV1, n_direction);
+    float singedPerpWorldDistanceEnd = dotProduct(vecCamV2, n_direction);
+
+    if (singedPerpWorldDistanceEnd < NEAR_CLIP && singedPerpWorldDistanceStart < NEAR_CLIP) {
+        return false;
+    }
+
+    float signedLateralDistV1 = dotProduct(vecCamV1, n_plane);
+    float signedLateralDistV2 = dotProduct(vecCamV2, n_plane);
+
+    bool v1RightV2Left = signedLateralDistV1 >= 0 && signedLateralDistV2 < 0;
+    bool v2MoreLeft = std::signbit(signedLateralDistV1) == std::signbit(signedLateralDistV2) && signedLateralDistV1 > signedLateralDistV2;
+
+    if (v1RightV2Left || v2MoreLeft) {
+        std::swap(singedPerpWorldDistanceStart, singedPerpWorldDistanceEnd);
+        std::swap(vecCamV1, vecCamV2);
+        std::swap(signedLateralDistV1, signedLateralDistV2);
+        std::swap(wallRatioStart, wallRatioEnd);
+    }
+
+    const float halfYRes = settings.resolution.y / 2.f;
+    const float halfXRes = settings.resolution.x / 2.f;
+
+    if (singedPerpWorldDistanceStart < NEAR_CLIP) {
+        float t = (NEAR_CLIP - singedPerpWorldDistanceStart) / (singedPerpWorldDistanceEnd - singedPerpWorldDistanceStart);
+        vecCamV1 = vecCamV1 + t * (vecCamV2 - vecCamV1);
+        signedLateralDistV1 = dotProduct(vecCamV1, n_plane);
+        singedPerpWorldDistanceStart = NEAR_CLIP;
+        wallRatioStart = wallRatioStart + t * (wallRatioEnd - wallRatioStart);
+    }
+    if (singedPerpWorldDistanceEnd < NEAR_CLIP) {
+        float t = (NEAR_CLIP - singedPerpWorldDistanceEnd) / (singedPerpWorldDistanceStart - singedPerpWorldDistanceEnd);
+        vecCamV2 = vecCamV2 + t * (vecCamV1 - vecCamV2);
+        signedLateralDistV2 = dotProduct(vecCamV2, n_plane);
+        singedPerpWorldDistanceEnd = NEAR_CLIP;
+        wallRatioEnd = wallRatioEnd + t * (wallRatioStart - wallRatioEnd);
+    }
+
+    float p_xScreenPosV1 = halfXRes + p_focalLength * signedLateralDistV1 / singedPerpWorldDistanceStart;
+    float p_xScreenPosV2 = halfXRes + p_focalLength * signedLateralDistV2 / singedPerpWorldDistanceEnd;
+
+    if ((p_xScreenPosV1 > settings.resolution.x && p_xScreenPosV2 > settings.resolution.x) || (p_xScreenPosV2 < 0 && p_xScreenPosV1 < 0)) {
+        return false;
+    }
+
+    const float eyeHeight = camera.cameraHeight + camera.cameraHeightStart;
+    out.x1 = p_xScreenPosV1;
+    out.x2 = p_xScreenPosV2;
+    out.top1 = p_focalLength * (eyeHeight - out.wallHeightStart - out.height) / singedPerpWorldDistanceStart + halfYRes;
+    out.bottom1 = p_focalLength * (eyeHeight - out.wallHeightStart) / singedPerpWorldDistanceStart + halfYRes;
+    out.top2 = p_focalLength * (eyeHeight - out.wallHeightStart - out.height) / singedPerpWorldDistanceEnd + halfYRes;
+    out.bottom2 = p_focalLength * (eyeHeight - out.wallHeightStart) / singedPerpWorldDistanceEnd + halfYRes;
+    out.invZ1 = 1.0f / singedPerpWorldDistanceStart;
+    out.invZ2 = 1.0f / singedPerpWorldDistanceEnd;
+    out.ratio1 = wallRatioStart;
+    out.ratio2 = wallRatioEnd;
+    return true;
+}
+
+bool TwoHalfD::projectBillboard(const XYVectorf &pos, float heightStart, float height, const CameraObject &camera, const EngineSettings &settings,
+                                ProjectedBillboard &out) {
+    XYVectorf direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
+    XYVectorf n_plane{-direction.y, direction.x};
+    float focalLength = (settings.resolution.x / 2.0f) / settings.fovScale;
+
+    XYVectorf toBillboard = pos - camera.cameraPos.pos;
+    float perpWorldDistance = dotProduct(toBillboard, direction);
+    if (perpWorldDistance <= 0) return false;
+
+    const float eyeHeight = camera.cameraHeight + camera.cameraHeightStart;
+    out.bottom = focalLength * (eyeHeight - heightStart) / perpWorldDistance + settings.resolution.y / 2.0f;
+    out.top = focalLength * (eyeHeight - height - heightStart) / perpWorldDistance + settings.resolution.y / 2.0f;
+    out.screenX = (settings.resolution.x / 2.0f) + focalLength * dotProduct(toBillboard, n_plane) / perpWorldDistance;
+    out.distance = perpWorldDistance;
+    return true;
+}
+
+void TwoHalfD::projectFloorPolygon(const Polygon &vertices, float relativeHeight, const CameraObject &camera, const EngineSettings &settings,
+                                   std::vector<sf::Vector2f> &out) {
+    const float NEAR_CLIP = 100.0f;
+    float focalLength = (settings.resolution.x / 2.0f) / settings.fovScale;
+    XYVectorf n_direction{std::cos(camera.cameraPos.direction), std::sin(camera.cameraPos.direction)};
+    XYVectorf n_plane{-n_direction.y, n_direction.x};
+
+    out.clear();
+    const size_t n = vertices.size();
+    auto project = [&](const XYVectorf &vertex) {
+        XYVectorf cameraVertexVec = vertex - camera.cameraPos.posf;
+        float perpWorldDistance = dotProduct(cameraVertexVec, n_direction);
+        float lateralDist = dotProduct(cameraVertexVec, n_plane);
+        float p_xScreenPos = (settings.resolution.x / 2.0f) + focalLength * lateralDist / perpWorldDistance;
+        float p_yScreenPos = (settings.resolution.y / 2.0f) + focalLength * relativeHeight / perpWorldDistance;
+        out.emplace_back(p_xScreenPos, p_yScreenPos);
+    };
+
+    for (size_t i{}; i < n; ++i) {
+        const XYVectorf &curr = vertices[i];
+        const XYVectorf &next = vertices[(i + 1) % n];
+
+        float dotCurr = dotProduct(curr - camera.cameraPos.posf, n_direction);
+        float dotNext = dotProduct(next - camera.cameraPos.posf, n_direction);
+
+        bool currInFront = dotCurr > NEAR_CLIP;
+        bool nextInFront = dotNext > NEAR_CLIP;
+
+        if (currInFront) project(curr);
+
+        if (currInFront != nextInFront) {
+            float t = (NEAR_CLIP - dotCurr) / (dotNext - dotCurr);
+            project(curr + t * (next - curr));
+        }
+    }
+}
+
+void TwoHalfD::clipPolygonRows(std::vector<sf::Vector2f> &polygon, float minY, float maxY, std::vector<sf::Vector2f> &scratch) {
+    // One pass per edge of the band, keeping the side where sign * (y - edge) >= 0
+    auto clip = [&](float edge, float sign) {
+        scratch.clear();
+        const size_t n = polygon.size();
+        for (size_t i{}; i < n; ++i) {
+            const sf::Vector2f &curr = polygon[i];
+            const sf::Vector2f &next = polygon[(i + 1) % n];
+            float distCurr = sign * (curr.y - edge);
+            float distNext = sign * (next.y - edge);
+
+            if (distCurr >= 0.f) scratch.push_back(curr);
+            if ((distCurr >= 0.f) != (distNext >= 0.f)) {
+                float t = distCurr / (distCurr - distNext);
+                scratch.push_back(curr + t * (next - curr));
+            }
+        }
+        polygon.swap(scratch);
+    };
+
+    clip(minY, 1.f);
+    if (polygon.size() >= 3) clip(maxY, -1.f);
+}
@@ -1,9 +1,12 @@
 #include "game.h"
 #include "TwoHalfD/engine.h"
 #include "TwoHalfD/engine_types.h"
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <iostream>
 #include <numbers>
 
 namespace fs = std::filesystem;
@@ -25,6 +28,45 @@ void Game::run() {
     }
 }
 
+// Walks forward while turning a full circle every 240 frames, sliding along the walls it meets. Inputs are still handled every update
+// since that is what runs the engine's own per-update work; headless none arrive.
+void Game::runHeadless(const HeadlessRun &headlessRun) {
+    fs::path levelFile = fs::path(ASSETS_DIR) / "levels" / "level1.txt";
+    m_engine.loadLevel(levelFile);
+    m_engine.addColourOverlay(OVERLAY_ID, OVERLAY_POLYGON, 0.f, 255, 0, 0, 128);
+
+    const fs::path outputDir = headlessRun.outputDir;
+    fs::create_directories(outputDir);
+    const bool raw = headlessRun.captureFormat == TwoHalfD::FrameCaptureFormat::RawRGBA;
+
+    for (int frame = 0; frame < headlessRun.frames; ++frame) {
+        if (m_engine.gameDeltaTimePassed()) {
+            handleFrameInputs();
+            TwoHalfD::Position cameraPos = m_engine.getCameraPosition();
+            cameraPos.direction = std::fmod(cameraPos.direction + 2 * std::numbers::pi_v<float> / 240.f, 2 * std::numbers::pi_v<float>);
+            m_engine.setCameraPosition(cameraPos);
+            m_engine.updateCameraPosition({8.f * std::cos(cameraPos.direction), 8.f * std::sin(cameraPos.direction), 0.f});
+        }
+        m_engine.render();
+
+        const uint64_t renderedFrame = m_engine.getFramesRendered() - 1;
+        if (std::find(headlessRun.captureFrames.begin(), headlessRun.captureFrames.end(), renderedFrame) != headlessRun.captureFrames.end()) {
+            std::string fileName = "frame_" + std::to_string(renderedFrame) + (raw ? ".rgba" : ".png");
+            m_engine.saveFrame(outputDir / fileName, headlessRun.captureFormat);
+        }
+    }
+
+    m_engine.saveFrameTimings(outputDir / "frame_timings.csv");
+    double totalRenderMs = 0.0;
+    for (const auto &timing : m_engine.getFrameTimings()) {
+        totalRenderMs += timing.renderMs;
+    }
+    if (!m_engine.getFrameTimings().empty()) {
+        std::cout << "Rendered " << m_engine.getFrameTimings().size() << " frames, average " << totalRenderMs / m_engine.getFrameTimings().size()
+                  << " ms per frame\n";
+    }
+}
+
 // Game Logic
 int frameCount = 0;
 bool overlayVisible = true;
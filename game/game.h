@@ -19,15 +19,24 @@ struct GameState {
     GameState() = default;
 };
 
+// A headless run renders a scripted camera path for a fixed number of frames, saving the listed frames and every frame's timings
+struct HeadlessRun {
+    int frames = 600;
+    std::string outputDir = "headless_output";
+    std::vector<uint64_t> captureFrames;
+    TwoHalfD::FrameCaptureFormat captureFormat = TwoHalfD::FrameCaptureFormat::PNG;
+};
+
 class Game {
   private:
     GameState m_gameState;
     TwoHalfD::Engine m_engine;
 
   public:
-    Game() : m_gameState{}, m_engine(TwoHalfD::EngineSettings{}){};
+    explicit Game(const TwoHalfD::EngineSettings &engineSettings = TwoHalfD::EngineSettings{}) : m_gameState{}, m_engine(engineSettings){};
 
     void run();
+    void runHeadless(const HeadlessRun &headlessRun);
     void updateGameState();
     // Input handleing
     void handleFrameInputs();
@@ -1,16 +1,43 @@
 #include <SFML/Graphics.hpp>
 #include <TwoHalfD/engine.h>
 #include <iostream>
+#include <string>
 
 #include "game.h"
 
-int main() {
+// game [--headless <frames> <output dir>] [--software] [--capture <frame>]... [--raw]
+int main(int argc, char *argv[]) {
     std::cerr << "Starting\n";
     TwoHalfD::EngineSettings engineSettings;
-    TwoHalfD::Engine engine(engineSettings);
+    HeadlessRun headlessRun;
+    bool headless = false;
 
-    Game game{};
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless" && i + 2 < argc) {
+            headless = true;
+            headlessRun.frames = std::stoi(argv[++i]);
+            headlessRun.outputDir = argv[++i];
+        } else if (arg == "--software") {
+            engineSettings.renderBackend = TwoHalfD::RenderBackend::Software;
+        } else if (arg == "--capture" && i + 1 < argc) {
+            headlessRun.captureFrames.push_back(std::stoull(argv[++i]));
+        } else if (arg == "--raw") {
+            headlessRun.captureFormat = TwoHalfD::FrameCaptureFormat::RawRGBA;
+        } else {
+            std::cerr << "Unknown argument: " << arg << '\n';
+            std::cerr << "Usage: game [--headless <frames> <output dir>] [--software] [--capture <frame>]... [--raw]\n";
+            return 1;
+        }
+    }
 
-    game.run();
+    if (headless) {
+        engineSettings.headless = true;
+        engineSettings.fixedTimestep = 1.0 / engineSettings.gameFpsCap;
+    }
+
+    Game game{engineSettings};
+    if (headless) game.runHeadless(headlessRun);
+    else game.run();
     return 0;
-}
\ No newline at end of file
+}
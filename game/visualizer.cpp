@@ -148,7 +148,7 @@ int main() {
 
         // --- Dark grey: convex region outlines ---
         for (const auto &node : graph.getNodes()) {
-            const auto &bounds = node.bspNode->bounds;
+            const auto &bounds = node.leaf->bounds;
             int n = static_cast<int>(bounds.size());
             for (int i = 0; i < n; ++i)
                 drawLine(bounds[i], bounds[(i + 1) % n], sf::Color(70, 70, 70));
@@ -0,0 +1,391 @@
+// Procedural stress-level generator. Writes a level in the LevelMaker text format (see notes/level_design.md): a grid of square rooms
+// joined by doorways, with pillars, raised floor sections and sprites scattered through them. The same settings and seed always
+// produce the same file, so levels can be regenerated instead of committed.
+//
+//   level_gen --out assets/levels/stress_10k.txt --rooms 1600 --pillars 1.0 --sprites 2000
+//
+// Standalone on purpose: it only writes text and does not link the engine.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Line types, must match TwoHalfD::EntityTypes in level_maker.h
+enum LineType {
+    texture = 0,
+    wall = 1,
+    sprite = 2,
+    seed = 3,
+    floorDefault = 4,
+    floorSection = 5,
+    bspBuildMode = 7,
+};
+
+struct GeneratorSettings {
+    std::string outputPath;
+    uint32_t seed = 1;
+    int rooms = 100;
+    int roomSize = 512;
+    int wallHeight = 256;
+    int doorWidth = 128;
+    float corridorDensity = 0.3f;   // chance of an extra doorway between neighbouring rooms, on top of the ones keeping the map connected
+    float pillarDensity = 0.5f;     // average pillars per room
+    float floorSectionRatio = 0.2f; // share of rooms with a raised floor section
+    int minFloorHeight = 8;
+    int maxFloorHeight = 96;
+    int sprites = 50;
+    std::vector<int> wallTextureIds{1, 2, 4, 5};
+    int spriteTextureId = 3;
+    int floorTextureId = 1;
+    int levelBspMode = 1; // heuristic: seed search is far too slow at these sizes
+    int levelBspSeed = 0;
+};
+
+struct Rect {
+    int x0, y0, x1, y1;
+
+    bool overlaps(const Rect &other, int margin) const {
+        return x0 - margin < other.x1 && other.x0 - margin < x1 && y0 - margin < other.y1 && other.y0 - margin < y1;
+    }
+    bool contains(int x, int y, int margin) const {
+        return x > x0 - margin && x < x1 + margin && y > y0 - margin && y < y1 + margin;
+    }
+};
+
+// Textures the generated levels can reference; ids are what --wall-textures / --sprite-texture / --floor-texture pick from
+static const std::vector<std::pair<int, std::string>> TEXTURE_TABLE = {
+    {1, "textures/stone_1.png"}, {2, "textures/brick.png"}, {3, "textures/enemy_1.png"}, {4, "textures/pattern_16.png"}, {5, "textures/pattern_24.png"},
+};
+
+// std::uniform_*_distribution output differs between standard libraries; mt19937 itself does not, so ranges are derived by hand to
+// keep a seed's level identical on every platform
+static int randomInt(std::mt19937 &rng, int lo, int hi) {
+    if (hi <= lo) return lo;
+    return lo + static_cast<int>(rng() % static_cast<uint32_t>(hi - lo + 1));
+}
+
+static float randomChance(std::mt19937 &rng) {
+    return static_cast<float>(rng() >> 8) / static_cast<float>(1u << 24);
+}
+
+static void printUsage() {
+    std::cerr << "usage: level_gen --out <file> [options]\n"
+                 "  --seed <n>              generator seed (default 1)\n"
+                 "  --rooms <n>             number of rooms (default 100)\n"
+                 "  --room-size <n>         room side length (default 512)\n"
+                 "  --wall-height <n>       (default 256)\n"
+                 "  --door-width <n>        (default 128)\n"
+                 "  --corridors <0..1>      chance of extra doorways between rooms (default 0.3)\n"
+                 "  --pillars <n>           average pillars per room (default 0.5)\n"
+                 "  --floor-sections <0..1> share of rooms with a raised floor (default 0.2)\n"
+                 "  --floor-heights <lo> <hi> floor section height range (default 8 96)\n"
+                 "  --sprites <n>           number of sprites (default 50)\n"
+                 "  --wall-textures <ids>   comma separated texture ids for walls (default 1,2,4,5)\n"
+                 "  --sprite-texture <id>   (default 3)\n"
+                 "  --floor-texture <id>    (default 1)\n"
+                 "  --bsp-mode <0|1>        level bspBuildMode line, 0 seed search, 1 heuristic (default 1)\n"
+                 "  --bsp-seed <n>          level seed line (default 0)\n";
+}
+
+static bool parseArguments(int argc, char **argv, GeneratorSettings &settings) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *value = next();
+        if (value == nullptr) return false;
+
+        if (arg == "--out") settings.outputPath = value;
+        else if (arg == "--seed") settings.seed = static_cast<uint32_t>(std::stoul(value));
+        else if (arg == "--rooms") settings.rooms = std::stoi(value);
+        else if (arg == "--room-size") settings.roomSize = std::stoi(value);
+        else if (arg == "--wall-height") settings.wallHeight = std::stoi(value);
+        else if (arg == "--door-width") settings.doorWidth = std::stoi(value);
+        else if (arg == "--corridors") settings.corridorDensity = std::stof(value);
+        else if (arg == "--pillars") settings.pillarDensity = std::stof(value);
+        else if (arg == "--floor-sections") settings.floorSectionRatio = std::stof(value);
+        else if (arg == "--floor-heights") {
+            const char *hi = next();
+            if (hi == nullptr) return false;
+            settings.minFloorHeight = std::stoi(value);
+            settings.maxFloorHeight = std::stoi(hi);
+        } else if (arg == "--sprites") settings.sprites = std::stoi(value);
+        else if (arg == "--wall-textures") {
+            settings.wallTextureIds.clear();
+            std::stringstream ss(value);
+            std::string id;
+            while (std::getline(ss, id, ',')) {
+                settings.wallTextureIds.push_back(std::stoi(id));
+            }
+        } else if (arg == "--sprite-texture") settings.spriteTextureId = std::stoi(value);
+        else if (arg == "--floor-texture") settings.floorTextureId = std::stoi(value);
+        else if (arg == "--bsp-mode") settings.levelBspMode = std::stoi(value);
+        else if (arg == "--bsp-seed") settings.levelBspSeed = std::stoi(value);
+        else return false;
+    }
+
+    const int minRoomSize = settings.doorWidth + 128;
+    if (settings.outputPath.empty() || settings.rooms < 1 || settings.roomSize < minRoomSize || settings.wallTextureIds.empty()) return false;
+    return true;
+}
+
+class LevelGenerator {
+  public:
+    explicit LevelGenerator(const GeneratorSettings &settings) : m_settings(settings), m_rng(settings.seed) {
+        m_columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(settings.rooms))));
+        m_rows = (settings.rooms + m_columns - 1) / m_columns;
+    }
+
+    void generate(std::ostream &out) {
+        _writeHeader(out);
+        _connectRooms();
+
+        out << "\n# Room walls\n";
+        for (int room = 0; room < m_settings.rooms; ++room) {
+            _writeRoomEdges(out, room);
+        }
+
+        out << "\n# Floor sections\n";
+        m_obstacles.assign(m_settings.rooms, {});
+        for (int room = 0; room < m_settings.rooms; ++room) {
+            if (randomChance(m_rng) < m_settings.floorSectionRatio) _writeFloorSection(out, room);
+        }
+
+        out << "\n# Pillars\n";
+        for (int room = 0; room < m_settings.rooms; ++room) {
+            int count = static_cast<int>(m_settings.pillarDensity);
+            if (randomChance(m_rng) < m_settings.pillarDensity - static_cast<float>(count)) ++count;
+            for (int i = 0; i < count; ++i) {
+                _writePillar(out, room);
+            }
+        }
+
+        out << "\n# Sprites\n";
+        for (int i = 0; i < m_settings.sprites; ++i) {
+            _writeSprite(out, randomInt(m_rng, 0, m_settings.rooms - 1));
+        }
+    }
+
+    int wallCount() const {
+        return m_wallCount;
+    }
+    int floorSectionCount() const {
+        return m_floorSectionCount;
+    }
+    int spriteCount() const {
+        return m_spriteCount;
+    }
+
+  private:
+    const GeneratorSettings &m_settings;
+    std::mt19937 m_rng;
+    int m_columns;
+    int m_rows;
+    std::vector<uint8_t> m_doorEast;           // room → has a doorway to the room on its right
+    std::vector<uint8_t> m_doorSouth;          // room → has a doorway to the room below
+    std::vector<std::vector<Rect>> m_obstacles; // room → floor section and pillars already placed, kept clear of each other
+    int m_wallCount = 0;
+    int m_floorSectionCount = 0;
+    int m_spriteCount = 0;
+
+    bool _roomExists(int column, int row) const {
+        return column >= 0 && column < m_columns && row >= 0 && row < m_rows && row * m_columns + column < m_settings.rooms;
+    }
+
+    void _writeHeader(std::ostream &out) {
+        out << "# Generated by level_gen: seed " << m_settings.seed << ", " << m_settings.rooms << " rooms\n";
+        out << seed << ' ' << m_settings.levelBspSeed << '\n';
+        out << bspBuildMode << ' ' << m_settings.levelBspMode << '\n';
+
+        out << "\n# Textures\n";
+        for (const auto &[id, path] : TEXTURE_TABLE) {
+            out << texture << ' ' << id << ' ' << path << '\n';
+        }
+
+        out << "\n# Floor default\n";
+        out << floorDefault << ' ' << m_settings.floorTextureId << " 0 0\n";
+    }
+
+    // Random spanning tree over the room grid (so every room is reachable), then extra doorways at corridorDensity
+    void _connectRooms() {
+        m_doorEast.assign(m_settings.rooms, 0);
+        m_doorSouth.assign(m_settings.rooms, 0);
+
+        std::vector<uint8_t> visited(m_settings.rooms, 0);
+        std::vector<int> stack{0};
+        visited[0] = 1;
+        while (!stack.empty()) {
+            const int room = stack.back();
+            const int column = room % m_columns, row = room / m_columns;
+
+            int candidates[4];
+            int candidateCount = 0;
+            const int offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+            for (const auto &offset : offsets) {
+                const int nc = column + offset[0], nr = row + offset[1];
+                if (_roomExists(nc, nr) && !visited[nr * m_columns + nc]) candidates[candidateCount++] = nr * m_columns + nc;
+            }
+            if (candidateCount == 0) {
+                stack.pop_back();
+                continue;
+            }
+
+            const int next = candidates[randomInt(m_rng, 0, candidateCount - 1)];
+            _openDoor(room, next);
+            visited[next] = 1;
+            stack.push_back(next);
+        }
+
+        for (int room = 0; room < m_settings.rooms; ++room) {
+            const int column = room % m_columns, row = room / m_columns;
+            if (_roomExists(column + 1, row) && randomChance(m_rng) < m_settings.corridorDensity) m_doorEast[room] = 1;
+            if (_roomExists(column, row + 1) && randomChance(m_rng) < m_settings.corridorDensity) m_doorSouth[room] = 1;
+        }
+    }
+
+    void _openDoor(int roomA, int roomB) {
+        const int low = std::min(roomA, roomB), high = std::max(roomA, roomB);
+        if (high == low + 1) m_doorEast[low] = 1;
+        else m_doorSouth[low] = 1;
+    }
+
+    // Each room writes its top and left edges, plus its right and bottom edges where there is no neighbour to write them
+    void _writeRoomEdges(std::ostream &out, int room) {
+        const int column = room % m_columns, row = room / m_columns;
+        const int x0 = column * m_settings.roomSize, y0 = row * m_settings.roomSize;
+        const int x1 = x0 + m_settings.roomSize, y1 = y0 + m_settings.roomSize;
+
+        const bool topDoor = _roomExists(column, row - 1) && m_doorSouth[room - m_columns];
+        const bool leftDoor = _roomExists(column - 1, row) && m_doorEast[room - 1];
+        _writeEdge(out, x0, y0, x1, y0, topDoor);
+        _writeEdge(out, x0, y1, x0, y0, leftDoor);
+        if (!_roomExists(column + 1, row)) _writeEdge(out, x1, y0, x1, y1, false);
+        if (!_roomExists(column, row + 1)) _writeEdge(out, x1, y1, x0, y1, false);
+    }
+
+    void _writeEdge(std::ostream &out, int x0, int y0, int x1, int y1, bool hasDoor) {
+        if (!hasDoor) {
+            _writeWall(out, x0, y0, x1, y1);
+            return;
+        }
+
+        const int length = std::abs(x1 - x0) + std::abs(y1 - y0);
+        const int dx = (x1 > x0) - (x1 < x0), dy = (y1 > y0) - (y1 < y0);
+        const int doorStart = randomInt(m_rng, 64, length - 64 - m_settings.doorWidth);
+        const int doorEnd = doorStart + m_settings.doorWidth;
+        _writeWall(out, x0, y0, x0 + dx * doorStart, y0 + dy * doorStart);
+        _writeWall(out, x0 + dx * doorEnd, y0 + dy * doorEnd, x1, y1);
+    }
+
+    void _writeWall(std::ostream &out, int x0, int y0, int x1, int y1) {
+        const int textureId = m_settings.wallTextureIds[randomInt(m_rng, 0, static_cast<int>(m_settings.wallTextureIds.size()) - 1)];
+        // One square texture copy per wallHeight of length
+        const float length = std::hypot(static_cast<float>(x1 - x0), static_cast<float>(y1 - y0));
+        out << wall << ' ' << x0 << ' ' << y0 << ' ' << x1 << ' ' << y1 << ' ' << m_settings.wallHeight << ' ' << textureId << ' '
+            << static_cast<float>(m_settings.wallHeight) / length << " 1.0\n";
+        ++m_wallCount;
+    }
+
+    // Interior of a room that stays clear of its walls and doorways
+    Rect _roomInterior(int room, int margin) const {
+        const int column = room % m_columns, row = room / m_columns;
+        const int x0 = column * m_settings.roomSize, y0 = row * m_settings.roomSize;
+        return {x0 + margin, y0 + margin, x0 + m_settings.roomSize - margin, y0 + m_settings.roomSize - margin};
+    }
+
+    bool _placeRect(int room, int minSize, int maxSize, int spacing, Rect &placed) {
+        const Rect interior = _roomInterior(room, 96);
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            const int width = randomInt(m_rng, minSize, maxSize), height = randomInt(m_rng, minSize, maxSize);
+            if (interior.x1 - interior.x0 <= width || interior.y1 - interior.y0 <= height) return false;
+            const int x = randomInt(m_rng, interior.x0, interior.x1 - width), y = randomInt(m_rng, interior.y0, interior.y1 - height);
+            const Rect candidate{x, y, x + width, y + height};
+
+            bool clear = true;
+            for (const auto &obstacle : m_obstacles[room]) {
+                if (candidate.overlaps(obstacle, spacing)) {
+                    clear = false;
+                    break;
+                }
+            }
+            if (clear) {
+                m_obstacles[room].push_back(candidate);
+                placed = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _writeFloorSection(std::ostream &out, int room) {
+        Rect rect;
+        const int roomSize = m_settings.roomSize;
+        if (!_placeRect(room, roomSize / 5, roomSize / 2, 0, rect)) return;
+
+        const int height = randomInt(m_rng, m_settings.minFloorHeight / 8, m_settings.maxFloorHeight / 8) * 8;
+        out << floorSection << ' ' << m_settings.floorTextureId << ' ' << rect.x0 << ' ' << rect.y0 << ' ' << height << ' ' << rect.x0 << ' '
+            << rect.y0 << ' ' << rect.x1 << ' ' << rect.y0 << ' ' << rect.x1 << ' ' << rect.y1 << ' ' << rect.x0 << ' ' << rect.y1 << '\n';
+        ++m_floorSectionCount;
+    }
+
+    void _writePillar(std::ostream &out, int room) {
+        Rect rect;
+        if (!_placeRect(room, 32, 96, 48, rect)) return;
+
+        _writeWall(out, rect.x0, rect.y0, rect.x1, rect.y0);
+        _writeWall(out, rect.x1, rect.y0, rect.x1, rect.y1);
+        _writeWall(out, rect.x1, rect.y1, rect.x0, rect.y1);
+        _writeWall(out, rect.x0, rect.y1, rect.x0, rect.y0);
+    }
+
+    void _writeSprite(std::ostream &out, int room) {
+        const Rect interior = _roomInterior(room, 48);
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            const int x = randomInt(m_rng, interior.x0, interior.x1), y = randomInt(m_rng, interior.y0, interior.y1);
+            bool clear = true;
+            for (const auto &obstacle : m_obstacles[room]) {
+                if (obstacle.contains(x, y, 40)) {
+                    clear = false;
+                    break;
+                }
+            }
+            if (clear) {
+                out << sprite << ' ' << x << ' ' << y << " 32 128 " << m_settings.spriteTextureId << " 1.0 1.0\n";
+                ++m_spriteCount;
+                return;
+            }
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    GeneratorSettings settings;
+    bool valid = false;
+    try {
+        valid = parseArguments(argc, argv, settings);
+    } catch (const std::exception &) {
+        valid = false;
+    }
+    if (!valid) {
+        printUsage();
+        return 1;
+    }
+
+    std::ofstream out(settings.outputPath);
+    if (!out.is_open()) {
+        std::cerr << "Could not open " << settings.outputPath << " for writing\n";
+        return 1;
+    }
+
+    LevelGenerator generator(settings);
+    generator.generate(out);
+    std::cerr << "Wrote " << settings.outputPath << ": " << settings.rooms << " rooms, " << generator.wallCount() << " walls, "
+              << generator.floorSectionCount() << " floor sections, " << generator.spriteCount() << " sprites\n";
+    return 0;
+}